@@ -0,0 +1,345 @@
+/*
+Microbenchmarks of the codec primitives. Host build only, see README.
+
+    modernbus_bench [filter] [--workers=n] [--connections=n]
+
+Runs each benchmark whose name contains filter for at least 200 ms
+and reports ns per operation and the bytes processed per second.
+The link benchmarks run client and server over a SimulatedLink for 1 s
+each and report transactions, time per transaction and line bytes per second.
+The tcp benchmark runs a ShardedTcpServer of n workers (default one per core)
+against n masters on loopback (default 8) for 1 s and reports the same.
+*/
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#if defined(__linux__)
+    #include <arpa/inet.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#include "modernbus_client.h"
+#include "modernbus_crosslink.h"
+#include "modernbus_frame.h"
+#include "modernbus_frame_parser.h"
+#include "modernbus_provider.h"
+#include "modernbus_server.h"
+#include "modernbus_tcp_server.h"
+#include "modernbus_util.h"
+
+// results land here, so the compiler cannot drop the work
+static volatile uint32_t sink;
+
+static const char *filter{nullptr};
+
+/*
+Runs op until at least 200 ms passed. bytes is the number of bytes one op processes.
+*/
+template <typename TOp>
+static void bench(const char *name, size_t bytes, TOp op){
+    if (filter && !strstr(name, filter)){
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    uint64_t iterations{1};
+    double elapsed{0};
+    while (true){
+        clock::time_point start{clock::now()};
+        for (uint64_t idx = 0; idx < iterations; idx++){
+            op();
+        }
+        elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if (elapsed >= 200e6){
+            break;
+        }
+        iterations *= 2;
+    }
+    double nsPerOp{elapsed / iterations};
+    printf("%-34s %12llu %12.1f", name, static_cast<unsigned long long>(iterations), nsPerOp);
+    if (bytes){
+        printf(" %14.0f", bytes * 1e9 / nsPerOp);
+    }
+    printf("\n");
+}
+
+
+/*
+Stream and provider which drop all writes and never have data.
+*/
+struct NullStream{};
+
+class NullProvider: public ProviderBase<NullStream>{
+    public:
+        NullProvider(NullStream &stream)
+        :   ProviderBase<NullStream>{stream}
+        {};
+
+        int read() override {return -1;};
+        size_t write(uint8_t v) override {_written++; return 1;};
+        size_t available() override {return 0;};
+
+        uint32_t written() const {return _written;};
+
+    private:
+        uint32_t _written{0};
+};
+
+/*
+Exposes the routing of the server.
+*/
+class BenchServer: public ModbusServer<NullProvider>{
+    public:
+        using ModbusServer<NullProvider>::ModbusServer;
+
+        ModbusResponse<NullProvider>* route(uint8_t functionCode, uint16_t address){
+            _request.functionCode = functionCode;
+            _request.address = address;
+            return _findResponse();
+        };
+};
+
+
+static void benchCRC(){
+    uint8_t frame[MODBUS_MAX_FRAME_SIZE];
+    for (uint16_t idx = 0; idx < sizeof(frame); idx++){
+        frame[idx] = idx * 7;
+    }
+    bench("crc16_update (1 byte)", 1, [&](){
+        sink = crc16_update(sink, frame[sink & 0xFF]);
+    });
+    bench("crc16_update (256 bytes)", sizeof(frame), [&](){
+        uint16_t crc{0xFFFF};
+        for (uint16_t idx = 0; idx < sizeof(frame); idx++){
+            crc = crc16_update(crc, frame[idx]);
+        }
+        sink = crc;
+    });
+    bench("crc16 (256 bytes)", sizeof(frame), [&](){
+        sink = crc16(frame, sizeof(frame));
+    });
+}
+
+static void benchFrames(){
+    uint8_t frame[MODBUS_MAX_FRAME_SIZE];
+    uint8_t data[246];
+    memset(data, 0x5A, sizeof(data));
+    uint16_t address{0};
+    bench("buildReadFrame (fc 03)", 8, [&](){
+        sink = buildReadFrame(frame, 1, 3, address++, 10);
+    });
+    bench("buildWriteMultipleFrame (fc 16)", 9 + sizeof(data), [&](){
+        sink = buildWriteMultipleFrame(frame, 1, 16, address++, sizeof(data) / 2, data, sizeof(data));
+    });
+}
+
+static void benchParser(){
+    uint8_t data[246];
+    memset(data, 0xA5, sizeof(data));
+    uint8_t frame[MODBUS_MAX_FRAME_SIZE];
+    uint16_t len{buildWriteMultipleFrame(frame, 1, 16, 0, sizeof(data) / 2, data, sizeof(data))};
+    FrameParser parser{true};
+    parser.setSlaveAddress(1);
+    bench("FrameParser span (fc 16, 255 B)", len, [&](){
+        parser.parse(frame, len);
+        sink = parser.isComplete();
+    });
+    bench("FrameParser per byte (fc 16, 255 B)", len, [&](){
+        for (uint16_t idx = 0; idx < len; idx++){
+            parser.parse(frame[idx]);
+        }
+        sink = parser.isComplete();
+    });
+    uint8_t read[8];
+    uint16_t readLen{buildReadFrame(read, 1, 3, 0, 10)};
+    bench("FrameParser span (fc 03, 8 B)", readLen, [&](){
+        parser.parse(read, readLen);
+        sink = parser.isComplete();
+    });
+}
+
+static void benchServer(){
+    ExecutorLoop scheduler{};
+    NullStream stream{};
+    NullProvider provider{stream};
+    BenchServer server{&scheduler, &provider, 1};
+    // 64 ranges of 16 registers on fc 03 and 04
+    for (uint16_t idx = 0; idx < 64; idx++){
+        server.responseTo(3, idx * 16, [](ModbusResponse<NullProvider> *response){}).range(16);
+        server.responseTo(4, idx * 16, [](ModbusResponse<NullProvider> *response){}).range(16);
+    }
+    uint16_t address{0};
+    bench("_findResponse (128 routes)", 0, [&](){
+        sink = server.route(3 + (address & 1), address % 1024) != nullptr;
+        address += 7;
+    });
+
+    uint8_t payload[240];
+    memset(payload, 0x3C, sizeof(payload));
+    ModbusResponse<NullProvider> *response{server.route(3, 0)};
+    bench("ResponseBase send (fc 03, 10 regs)", 25, [&](){
+        sink = response->send(payload, 20);
+    });
+    bench("ResponseBase send (fc 03, 120 regs)", 245, [&](){
+        sink = response->send(payload, 240);
+    });
+}
+
+/*
+Polls 40 input registers over a simulated 8E1 line for 1 s.
+Bound by the line and the delays of client and server, not by the cpu.
+*/
+static void benchLink(uint32_t baudRate){
+    char name[40];
+    snprintf(name, sizeof(name), "link %lu 8E1 (fc 04, 40 regs)", static_cast<unsigned long>(baudRate));
+    if (filter && !strstr(name, filter)){
+        return;
+    }
+    SimulatedLink link{};
+    link.configure(LineSettings{baudRate, 8, LineParity::even, 1, 0, 0});
+    SimulatedLinkProvider clientLine{link.first};
+    SimulatedLinkProvider serverLine{link.second};
+    ExecutorLoop scheduler{};
+    ModbusClient<SimulatedLinkProvider> client{&scheduler, &clientLine};
+    ModbusServer<SimulatedLinkProvider> server{&scheduler, &serverLine, 1};
+    server.setInterval(1);
+
+    static uint8_t request[8];
+    buildReadFrame(request, 1, 4, 0, 40);
+    uint8_t payload[80];
+    memset(payload, 0x3C, sizeof(payload));
+    client.poll(request, sizeof(request), [](ServerResponse *response){}).setDeviceDelay(1);
+    server.responseTo(4, 0, [&](ModbusResponse<SimulatedLinkProvider> *response){
+        response->send(payload, sizeof(payload));
+    }).range(40);
+
+    using clock = std::chrono::steady_clock;
+    client.start();
+    server.start();
+    clock::time_point start{clock::now()};
+    double elapsed{0};
+    while (elapsed < 1e9){
+        scheduler.execute();
+        elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    }
+    uint32_t transactions{client.completeCount()};
+    // request and response frame
+    size_t bytes{sizeof(request) + sizeof(payload) + 5};
+    printf("%-34s %12lu %12.1f %14.0f\n", name, static_cast<unsigned long>(transactions),
+        transactions ? elapsed / transactions : 0.0, transactions * bytes * 1e9 / elapsed);
+}
+
+#if defined(__linux__)
+/*
+Masters on loopback, each on its own connection and thread, read 10 holding
+registers in lock step for 1 s. Bound by the kernel round trips, which the
+workers spread over the cores.
+*/
+static void benchTcp(uint8_t workers, uint16_t connections){
+    char name[40];
+    snprintf(name, sizeof(name), "tcp %u workers %u conns (fc 03)", workers, connections);
+    if (filter && !strstr(name, filter)){
+        return;
+    }
+    static RegisterBank<0, 0, 100, 0> bank{};
+    ShardedTcpServer server{bank, workers};
+    if (!server.start(0)){
+        printf("%-34s could not listen\n", name);
+        return;
+    }
+    // mbap header 7, fc, address and quantity
+    static const uint8_t request[12]{0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+    const size_t replyLen{7 + 2 + 20};
+
+    std::atomic<bool> running{true};
+    std::atomic<uint32_t> transactions{0};
+    std::thread *masters{new std::thread[connections]};
+    for (uint16_t idx = 0; idx < connections; idx++){
+        masters[idx] = std::thread{[&](){
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            int one{1};
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(server.port());
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+                close(fd);
+                return;
+            }
+            uint8_t reply[MODBUS_TCP_FRAME];
+            uint32_t done{0};
+            while (running.load(std::memory_order_relaxed)){
+                if (send(fd, request, sizeof(request), 0) != sizeof(request)){
+                    break;
+                }
+                size_t received{0};
+                while (received < replyLen){
+                    ssize_t n{recv(fd, reply + received, sizeof(reply) - received, 0)};
+                    if (n <= 0){
+                        break;
+                    }
+                    received += n;
+                }
+                if (received < replyLen){
+                    break;
+                }
+                done++;
+            }
+            transactions.fetch_add(done, std::memory_order_relaxed);
+            close(fd);
+        }};
+    }
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point start{clock::now()};
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    running.store(false, std::memory_order_relaxed);
+    for (uint16_t idx = 0; idx < connections; idx++){
+        masters[idx].join();
+    }
+    double elapsed{std::chrono::duration<double, std::nano>(clock::now() - start).count()};
+    delete [] masters;
+    server.stop();
+
+    uint32_t total{transactions.load()};
+    printf("%-34s %12lu %12.1f %14.0f\n", name, static_cast<unsigned long>(total),
+        total ? elapsed / total : 0.0, total * (sizeof(request) + replyLen) * 1e9 / elapsed);
+}
+#endif
+
+int main(int argc, char **argv){
+    uint8_t workers{0};
+    uint16_t connections{8};
+    for (int idx = 1; idx < argc; idx++){
+        if (!strncmp(argv[idx], "--workers=", 10)){
+            workers = atoi(argv[idx] + 10);
+        } else if (!strncmp(argv[idx], "--connections=", 14)){
+            connections = atoi(argv[idx] + 14);
+        } else {
+            filter = argv[idx];
+        }
+    }
+    if (!workers){
+        unsigned int cores{std::thread::hardware_concurrency()};
+        workers = cores ? (cores > 255 ? 255 : cores) : 1;
+    }
+    printf("%-34s %12s %12s %14s\n", "benchmark", "iterations", "ns/op", "bytes/s");
+    benchCRC();
+    benchFrames();
+    benchParser();
+    benchServer();
+    benchLink(9600);
+    benchLink(19200);
+    benchLink(115200);
+#if defined(__linux__)
+    benchTcp(workers, connections);
+#endif
+    return 0;
+}
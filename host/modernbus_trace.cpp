@@ -0,0 +1,154 @@
+/*
+Converts a trace log to Chrome trace JSON. Host build only, see README.
+
+    modernbus_trace trace.mbtr > trace.json
+
+Open the JSON in chrome://tracing or ui.perfetto.dev. Client and server are
+processes, each request and each server a thread of its process. Every
+record is an instant event, the phases between records are spans:
+    transmit   clientBegin until clientEnd
+    response   clientEnd until clientComplete, clientError or clientTimeout
+    request    first serverReceive until serverComplete or serverError
+    reply      serverTransmit until serverEnd
+*/
+#include <Arduino.h>
+
+#include <inttypes.h>
+#include <map>
+#include <stdio.h>
+#include <vector>
+
+#include "modernbus_trace.h"
+
+#define CLIENT_PID 1
+#define SERVER_PID 2
+
+/*
+Start of the open spans of one request or server, 0 if none is open.
+*/
+struct Spans{
+    uint32_t tid{0};
+    uint64_t transmit{0};
+    uint64_t response{0};
+    uint64_t request{0};
+    uint64_t reply{0};
+};
+
+static bool first{true};
+
+static void separate(){
+    printf(first ? "\n" : ",\n");
+    first = false;
+}
+
+static void span(const char *name, uint32_t pid, uint32_t tid, uint64_t &start, uint64_t end){
+    if (!start){
+        return;
+    }
+    separate();
+    printf("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%" PRIu32 ",\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 "}",
+        name, pid, tid, start, end - start);
+    start = 0;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data){
+    FILE *file{fopen(path, "rb")};
+    if (!file){
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0){
+        data.insert(data.end(), buffer, buffer + len);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv){
+    if (argc != 2){
+        fprintf(stderr, "usage: %s trace.mbtr > trace.json\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint8_t> log;
+    if (!readFile(argv[1], log)){
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    TraceReader reader{log.data(), log.size()};
+    if (!reader.isValid()){
+        fprintf(stderr, "%s is no trace log\n", argv[1]);
+        return 1;
+    }
+
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    separate();
+    printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"client\"}}", CLIENT_PID);
+    separate();
+    printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"server\"}}", SERVER_PID);
+
+    std::map<uint64_t, Spans> threads;
+    TraceRecord record{};
+    uint32_t last{0};
+    // timestamps wrap after 71 minutes. Start at 1 so 0 means no open span.
+    uint64_t now{1};
+    bool started{false};
+    while (reader.next(record)){
+        // records of several threads may be stored slightly out of order. Never step back.
+        // Such a record is placed at the latest time seen so far.
+        int32_t delta{static_cast<int32_t>(record.timestamp - last)};
+        if (!started || delta > 0){
+            now += started ? delta : 0;
+            last = record.timestamp;
+        }
+        started = true;
+
+        bool server{record.event >= TraceEvent::serverReceive};
+        uint32_t pid = server ? SERVER_PID : CLIENT_PID;
+        auto inserted = threads.emplace(record.request, Spans{});
+        Spans &spans{inserted.first->second};
+        if (inserted.second){
+            spans.tid = threads.size();
+            separate();
+            printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%" PRIu32 ",\"tid\":%" PRIu32 ",\"args\":{\"name\":\"%s 0x%" PRIx64 "\"}}",
+                pid, spans.tid, server ? "server" : "request", record.request);
+        }
+
+        switch (record.event){
+            case TraceEvent::clientBegin:
+                spans.transmit = now;
+                break;
+            case TraceEvent::clientEnd:
+                span("transmit", pid, spans.tid, spans.transmit, now);
+                spans.response = now;
+                break;
+            case TraceEvent::clientComplete:
+            case TraceEvent::clientError:
+            case TraceEvent::clientTimeout:
+                span("response", pid, spans.tid, spans.response, now);
+                break;
+            case TraceEvent::serverReceive:
+                if (!spans.request){
+                    spans.request = now;
+                }
+                break;
+            case TraceEvent::serverComplete:
+            case TraceEvent::serverError:
+                span("request", pid, spans.tid, spans.request, now);
+                break;
+            case TraceEvent::serverTransmit:
+                spans.reply = now;
+                break;
+            case TraceEvent::serverEnd:
+                span("reply", pid, spans.tid, spans.reply, now);
+                break;
+            default:
+                break;
+        }
+        separate();
+        printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%" PRIu32 ",\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ",\"args\":{\"count\":%u}}",
+            traceEventName(record.event), pid, spans.tid, now, record.count);
+    }
+    printf("\n]}\n");
+    return 0;
+}
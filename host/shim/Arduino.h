@@ -0,0 +1,78 @@
+#if !defined(MODERNBUS_HOST_ARDUINO_H)
+#define MODERNBUS_HOST_ARDUINO_H
+
+/*
+Host (Linux) shim of the Arduino core. Covers what modernbus,
+its tests and benchmarks use. Not a general Arduino emulation.
+*/
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+
+// ms and us since start of the process, monotonic
+unsigned long millis();
+unsigned long micros();
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// pins do nothing, digitalRead returns what was written
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+
+/*
+Serial port without a port. Reads nothing, drops writes,
+print and printf go to stdout.
+*/
+class HardwareSerial{
+    public:
+        void begin(unsigned long baudRate){_baudRate = baudRate;};
+        int read(){return -1;};
+        size_t write(uint8_t value){return 1;};
+        size_t available(){return 0;};
+        unsigned long baudRate(){return _baudRate;};
+
+        size_t print(const char *text){return fputs(text, stdout) < 0 ? 0 : strlen(text);};
+
+        size_t printf(const char *format, ...){
+            va_list args;
+            va_start(args, format);
+            int written{vprintf(format, args)};
+            va_end(args);
+            return written < 0 ? 0 : written;
+        };
+
+    private:
+        unsigned long _baudRate{9600};
+};
+
+extern HardwareSerial Serial;
+
+
+/*
+ESP core functions the tests use.
+*/
+class EspClass{
+    public:
+        uint32_t getFreeHeap(){return 0;};
+        void restart(){abort();};
+};
+
+extern EspClass ESP;
+
+#endif // MODERNBUS_HOST_ARDUINO_H
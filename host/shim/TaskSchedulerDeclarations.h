@@ -0,0 +1,165 @@
+#if !defined(MODERNBUS_HOST_TASKSCHEDULER_H)
+#define MODERNBUS_HOST_TASKSCHEDULER_H
+
+/*
+Host (Linux) shim of TaskScheduler with the std::function callbacks
+of _TASK_STD_FUNCTION. Covers the Task and Scheduler calls modernbus makes,
+with the timing rules of TaskScheduler:
+    - enable() runs the task at the next pass
+    - a task then runs every interval
+    - delay(0) delays by the interval
+    - a pass running no task sleeps TASK_IDLE_SLEEP_US (_TASK_SLEEP_ON_IDLE_RUN)
+*/
+
+#include <Arduino.h>
+#include <functional>
+
+#define TASK_IMMEDIATE 0
+#define TASK_FOREVER (-1)
+#define TASK_ONCE 1
+
+#ifndef TASK_IDLE_SLEEP_US
+#define TASK_IDLE_SLEEP_US 20
+#endif
+
+using TaskCallback = std::function<void()>;
+
+class Scheduler;
+
+class Task{
+    friend class Scheduler;
+    public:
+        Task() = default;
+        Task(const Task&) = delete;
+
+        void set(unsigned long interval, long iterations, TaskCallback callback){
+            _interval = interval;
+            _iterations = iterations;
+            _callback = callback;
+        };
+
+        void setCallback(TaskCallback callback){_callback = callback;};
+
+        void setInterval(unsigned long interval){
+            _interval = interval;
+            delay();
+        };
+
+        void setIterations(long iterations){_iterations = iterations;};
+
+        unsigned long getInterval() const {return _interval;};
+
+        /*
+        Next run in ms from now. 0 delays by the interval.
+        */
+        void delay(unsigned long ms = 0){
+            _delay = ms ? ms : _interval;
+            _previous = millis();
+        };
+
+        bool enable(){
+            _enabled = true;
+            _delay = 0;
+            _previous = millis();
+            return true;
+        };
+
+        bool disable(){
+            bool wasEnabled{_enabled};
+            _enabled = false;
+            return wasEnabled;
+        };
+
+        void abort(){_enabled = false;};
+
+        bool isEnabled() const {return _enabled;};
+
+    private:
+        TaskCallback _callback{nullptr};
+        unsigned long _interval{0};
+        long _iterations{TASK_FOREVER};
+        unsigned long _delay{0};
+        unsigned long _previous{0};
+        bool _enabled{false};
+        Scheduler *_scheduler{nullptr};
+        Task *_prev{nullptr};
+        Task *_next{nullptr};
+
+        bool _run(unsigned long now){
+            if (!_enabled || now - _previous < _delay){
+                return false;
+            }
+            _previous = now;
+            _delay = _interval;
+            if (_iterations > 0 && --_iterations == 0){
+                _enabled = false;
+            }
+            if (_callback){
+                _callback();
+            }
+            return true;
+        };
+};
+
+
+class Scheduler{
+    public:
+        Scheduler() = default;
+        Scheduler(const Scheduler&) = delete;
+
+        void addTask(Task &task){
+            if (task._scheduler){
+                return;
+            }
+            task._scheduler = this;
+            task._prev = _last;
+            task._next = nullptr;
+            if (_last){
+                _last->_next = &task;
+            } else {
+                _first = &task;
+            }
+            _last = &task;
+        };
+
+        void deleteTask(Task &task){
+            if (task._scheduler != this){
+                return;
+            }
+            if (_current == &task){
+                _current = task._next;
+            }
+            (task._prev ? task._prev->_next : _first) = task._next;
+            (task._next ? task._next->_prev : _last) = task._prev;
+            task._scheduler = nullptr;
+            task._prev = task._next = nullptr;
+        };
+
+        /*
+        Runs all tasks which are due. Returns true if none was.
+        */
+        bool execute(){
+            bool idle{true};
+            unsigned long now{millis()};
+            _current = _first;
+            while (_current){
+                Task *task{_current};
+                // a callback may delete the next task. deleteTask moves _current then.
+                _current = task->_next;
+                if (task->_run(now)){
+                    idle = false;
+                }
+            }
+            if (idle){
+                delayMicroseconds(TASK_IDLE_SLEEP_US);
+            }
+            return idle;
+        };
+
+    private:
+        Task *_first{nullptr};
+        Task *_last{nullptr};
+        Task *_current{nullptr};
+};
+
+#endif // MODERNBUS_HOST_TASKSCHEDULER_H
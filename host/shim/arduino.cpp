@@ -0,0 +1,38 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+
+static uint8_t pins[256];
+
+unsigned long millis(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned long micros(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void delay(unsigned long ms){
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us){
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode){}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+    pins[pin] = value;
+}
+
+int digitalRead(uint8_t pin){
+    return pins[pin];
+}
+
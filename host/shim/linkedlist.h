@@ -0,0 +1,161 @@
+#if !defined(MODERNBUS_HOST_LINKEDLIST_H)
+#define MODERNBUS_HOST_LINKEDLIST_H
+
+/*
+Host (Linux) shim of tinylinkedlist. Covers the calls modernbus makes.
+
+    while (list.iter()){
+        T value = list.iter.next();
+    }
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T>
+class TinyLinkedList{
+    struct Node{
+        T value;
+        Node *next;
+    };
+
+    public:
+        /*
+        Cursor of the list. iter() tells if next() has an element,
+        loopNext() starts over at the end.
+        */
+        class Iterator{
+            friend class TinyLinkedList;
+            public:
+                Iterator(TinyLinkedList *list)
+                :   _list{list}
+                {};
+
+                bool operator()(){
+                    if (!_following()){
+                        reset();
+                        return false;
+                    }
+                    return true;
+                };
+
+                T next(){
+                    _current = _following();
+                    _started = true;
+                    return _current->value;
+                };
+
+                T loopNext(){
+                    if (!_following()){
+                        reset();
+                    }
+                    return next();
+                };
+
+                void reset(){
+                    _current = nullptr;
+                    _started = false;
+                };
+
+            private:
+                TinyLinkedList *_list;
+                Node *_current{nullptr};
+                bool _started{false};
+
+                Node* _following() const {
+                    return _started ? (_current ? _current->next : nullptr) : _list->_head;
+                };
+        };
+
+        Iterator iter{this};
+
+        TinyLinkedList() = default;
+        TinyLinkedList(const TinyLinkedList&) = delete;
+
+        ~TinyLinkedList(){
+            clear();
+        };
+
+        void append(T value){
+            Node *node{new Node{value, nullptr}};
+            if (_tail){
+                _tail->next = node;
+            } else {
+                _head = node;
+            }
+            _tail = node;
+            _size++;
+        };
+
+        size_t size() const {return _size;};
+
+        T popLeft(){
+            return remove(0);
+        };
+
+        T pop(){
+            return remove(_size - 1);
+        };
+
+        /*
+        Index of the first element equal to value. -1 if not found.
+        */
+        int16_t index(T value) const {
+            int16_t idx{0};
+            for (Node *node = _head; node; node = node->next, idx++){
+                if (node->value == value){
+                    return idx;
+                }
+            }
+            return -1;
+        };
+
+        T get(size_t idx) const {
+            Node *node{_head};
+            while (idx--){
+                node = node->next;
+            }
+            return node->value;
+        };
+
+        /*
+        Removes the element at idx. Returns T{} if idx is out of range.
+        */
+        T remove(int16_t idx){
+            if (idx < 0 || static_cast<size_t>(idx) >= _size){
+                return T{};
+            }
+            Node *previous{nullptr};
+            Node *node{_head};
+            while (idx--){
+                previous = node;
+                node = node->next;
+            }
+            (previous ? previous->next : _head) = node->next;
+            if (_tail == node){
+                _tail = previous;
+            }
+            if (iter._current == node){
+                // the cursor goes on with the element behind
+                iter._current = previous;
+                iter._started = previous != nullptr;
+            }
+            T value{node->value};
+            delete node;
+            _size--;
+            return value;
+        };
+
+        void clear(){
+            while (_size){
+                popLeft();
+            }
+        };
+
+    private:
+        Node *_head{nullptr};
+        Node *_tail{nullptr};
+        size_t _size{0};
+};
+
+#endif // MODERNBUS_HOST_LINKEDLIST_H
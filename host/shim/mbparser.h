@@ -0,0 +1,32 @@
+#if !defined(MODERNBUS_HOST_MBPARSER_H)
+#define MODERNBUS_HOST_MBPARSER_H
+
+/*
+Host (Linux) shim of mbparser. modernbus parses frames with its own
+FrameParser and takes only parser states and error codes from mbparser.
+Error codes 1 - 4 are the modbus exception codes.
+*/
+
+enum class ParserState{
+    slaveAddress,
+    functionCode,
+    address,
+    quantity,
+    byteCount,
+    data,
+    crc,
+    complete,
+    error
+};
+
+enum class ErrorCode : int {
+    noError = 0,
+    illegalFunction = 1,
+    illegalDataAddress = 2,
+    illegalDataValue = 3,
+    slaveDeviceFailure = 4,
+    CRCError = 20,
+    slaveError = 21
+};
+
+#endif // MODERNBUS_HOST_MBPARSER_H
@@ -0,0 +1,18 @@
+// Host runner of the test suites in test/. Asserts stay on in every build type.
+#undef NDEBUG
+
+#include <Arduino.h>
+
+#include "../test/test_client.hpp"
+#include "../test/test_server.hpp"
+#include "../test/test_integration.hpp"
+#include "../test/test_sniffer.hpp"
+
+int main(){
+    runClientTest();
+    runServerTest();
+    runIntegrationTests();
+    runSnifferTest();
+    printf("\nAll tests passed\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "modernbus_capture.h"
+#include "modernbus_util.h"
+
+void CaptureSink::begin(uint32_t baudRate){
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    memcpy(header, CAPTURE_MAGIC, 4);
+    putWord(header + 4, CAPTURE_VERSION);
+    putWord(header + 6, 0);
+    putLong(header + 8, baudRate);
+    _write(header, sizeof(header));
+}
+
+void CaptureSink::record(CaptureDirection direction, uint64_t timestamp, const uint8_t *data, uint16_t length){
+    // one write per record, so a record is not torn by a concurrent writer of the same file
+    uint8_t record[CAPTURE_RECORD_HEADER_SIZE + MODBUS_MAX_FRAME_SIZE];
+    if (length > MODBUS_MAX_FRAME_SIZE){
+        length = MODBUS_MAX_FRAME_SIZE;
+    }
+    putWord(record, length);
+    record[2] = static_cast<uint8_t>(direction);
+    record[3] = length >= 4 && !crc16(data, length) ? CAPTURE_CRC_OK : 0;
+    putLongLong(record + 4, timestamp);
+    memcpy(record + CAPTURE_RECORD_HEADER_SIZE, data, length);
+    _write(record, CAPTURE_RECORD_HEADER_SIZE + length);
+    _records++;
+}
+
+CaptureReader::CaptureReader(const uint8_t *log, size_t size)
+:   _log{log},
+    _size{size}
+{
+    uint16_t version{size >= CAPTURE_HEADER_SIZE ? getWord(log + 4) : static_cast<uint16_t>(0)};
+    _valid = size >= CAPTURE_HEADER_SIZE && !memcmp(log, CAPTURE_MAGIC, 4) && (version == CAPTURE_VERSION || version == 1);
+    if (_valid){
+        _baudRate = getLong(log + 8);
+        _recordHeaderSize = version == 1 ? CAPTURE_V1_RECORD_HEADER_SIZE : CAPTURE_RECORD_HEADER_SIZE;
+    }
+}
+
+bool CaptureReader::next(CaptureRecord &record){
+    if (!_valid || _offset + _recordHeaderSize > _size){
+        return false;
+    }
+    const uint8_t *header{_log + _offset};
+    uint16_t length{getWord(header)};
+    if (_offset + _recordHeaderSize + length > _size){
+        return false;
+    }
+    record.length = length;
+    record.direction = static_cast<CaptureDirection>(header[2]);
+    record.crcOk = header[3] & CAPTURE_CRC_OK;
+    record.timestamp = _recordHeaderSize == CAPTURE_V1_RECORD_HEADER_SIZE ? getLong(header + 4) : getLongLong(header + 4);
+    record.data = header + _recordHeaderSize;
+    _offset += _recordHeaderSize + length;
+    return true;
+}
+
+void CaptureReader::rewind(){
+    _offset = CAPTURE_HEADER_SIZE;
+}
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+CaptureFile::CaptureFile(const char *path, uint32_t baudRate){
+    _fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd >= 0 && lseek(_fd, 0, SEEK_END) == 0){
+        begin(baudRate);
+    }
+}
+
+CaptureFile::~CaptureFile(){
+    if (_fd >= 0){
+        close(_fd);
+    }
+}
+
+void CaptureFile::_write(const uint8_t *data, size_t length){
+    if (_fd < 0){
+        return;
+    }
+    while (length){
+        ssize_t written{write(_fd, data, length)};
+        if (written < 0 && errno == EINTR){
+            continue;
+        }
+        if (written <= 0){
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,247 @@
+#if !defined(MODERNBUS_CAPTURE_H)
+#define MODERNBUS_CAPTURE_H
+
+#include <Arduino.h>
+#include <utility>
+
+#include "modernbus_frame.h"
+#include "modernbus_util.h"
+
+/*
+Binary capture log. Little endian, append only.
+
+    header   "MBCP", uint16 version, uint16 reserved, uint32 baud rate
+    record   uint16 length, uint8 direction, uint8 flags, uint64 timestamp (us), length raw bytes
+    ...
+
+A record holds one frame. Records are length prefixed, so a log cut off
+while writing loses its last record only.
+Version 1 logs hold uint32 timestamps, which wrap after 71.6 minutes. They are still read.
+*/
+#define CAPTURE_MAGIC "MBCP"
+#define CAPTURE_VERSION 2
+#define CAPTURE_HEADER_SIZE 12
+#define CAPTURE_RECORD_HEADER_SIZE 12
+#define CAPTURE_V1_RECORD_HEADER_SIZE 8
+
+// flags of a record
+#define CAPTURE_CRC_OK 0x01
+
+enum class CaptureDirection : uint8_t {
+    // received by the capturing side
+    rx = 0,
+    // sent by the capturing side
+    tx = 1
+};
+
+struct CaptureRecord{
+    CaptureDirection direction{CaptureDirection::rx};
+    bool crcOk{false};
+    uint64_t timestamp{0};
+    const uint8_t *data{nullptr};
+    uint16_t length{0};
+};
+
+
+/*
+Encodes frames into the capture format. Subclasses store the bytes.
+*/
+class CaptureSink{
+    public:
+        virtual ~CaptureSink() = default;
+
+        /*
+        Writes the file header. Call once before the first record of a new log.
+        */
+        void begin(uint32_t baudRate);
+
+        void record(CaptureDirection direction, uint64_t timestamp, const uint8_t *data, uint16_t length);
+
+        uint32_t recordCount() const {return _records;};
+
+    protected:
+        virtual void _write(const uint8_t *data, size_t length) = 0;
+
+    private:
+        uint32_t _records{0};
+};
+
+
+/*
+Capture sink writing to an Arduino stream, e.g. a File of SD or LittleFS.
+The stream must provide size_t write(const uint8_t*, size_t).
+*/
+template <typename TStream>
+class CaptureStream: public CaptureSink{
+    public:
+        CaptureStream(TStream &stream)
+        :   _stream{stream}
+        {};
+
+    protected:
+        void _write(const uint8_t *data, size_t length) override {
+            _stream.write(data, length);
+        };
+
+    private:
+        TStream &_stream;
+};
+
+
+/*
+Iterates the records of a capture log held in memory.
+*/
+class CaptureReader{
+    public:
+        CaptureReader(const uint8_t *log, size_t size);
+
+        /*
+        False if the header is missing or of an unknown version.
+        */
+        bool isValid() const {return _valid;};
+
+        uint32_t baudRate() const {return _baudRate;};
+
+        /*
+        Reads the next record. Returns false at the end of the log
+        or at a record cut off.
+        */
+        bool next(CaptureRecord &record);
+
+        void rewind();
+
+    private:
+        const uint8_t *_log;
+        size_t _size;
+        size_t _offset{CAPTURE_HEADER_SIZE};
+        size_t _recordHeaderSize{CAPTURE_RECORD_HEADER_SIZE};
+        bool _valid{false};
+        uint32_t _baudRate{0};
+};
+
+
+/*
+Wraps a provider and records every frame it receives and sends to sink.
+
+    CaptureFile capture{"/var/log/bus.mbcap", 19200};
+    CaptureProvider<ProviderRS485<HardwareSerial>> provider{capture, Serial, 4};
+
+Sent frames are delimited by begin and end of transmission.
+Received frames end once their crc checks, or as a broken frame
+once the next transmission starts.
+Timestamps are micros() extended to 64 bit. The wrap of micros() is
+tracked on every available(), which client and server poll all the time.
+*/
+template <typename TProvider>
+class CaptureProvider: public TProvider{
+    public:
+        template <typename... Args>
+        CaptureProvider(CaptureSink &sink, Args&&... args)
+        :   TProvider{std::forward<Args>(args)...},
+            _sink{sink}
+        {};
+
+        int read() override {
+            int value{TProvider::read()};
+            if (value >= 0 && !_inBulk){
+                _receive(static_cast<uint8_t>(value));
+            }
+            return value;
+        };
+
+        size_t readBytes(uint8_t *buffer, size_t len) override {
+            // the default readBytes reads through read()
+            _inBulk = true;
+            size_t count{TProvider::readBytes(buffer, len)};
+            _inBulk = false;
+            for (size_t i = 0; i < count; i++){
+                _receive(buffer[i]);
+            }
+            return count;
+        };
+
+        size_t available() override {
+            _clock.now();
+            return TProvider::available();
+        };
+
+        size_t write(uint8_t value) override {
+            if (_txLength < MODBUS_MAX_FRAME_SIZE){
+                _tx[_txLength++] = value;
+            }
+            return TProvider::write(value);
+        };
+
+        void _beginTransmission() override {
+            _flushReceived();
+            _txLength = 0;
+            _txStart = _clock.now();
+            TProvider::_beginTransmission();
+        };
+
+        void _endTransmission() override {
+            TProvider::_endTransmission();
+            if (_txLength){
+                _sink.record(CaptureDirection::tx, _txStart, _tx, _txLength);
+                _txLength = 0;
+            }
+        };
+
+    private:
+        CaptureSink &_sink;
+        uint8_t _rx[MODBUS_MAX_FRAME_SIZE];
+        uint8_t _tx[MODBUS_MAX_FRAME_SIZE];
+        uint16_t _rxLength{0};
+        uint16_t _txLength{0};
+        uint16_t _rxCrc{0xFFFF};
+        WideMicros _clock{};
+        uint64_t _rxStart{0};
+        uint64_t _txStart{0};
+        bool _inBulk{false};
+
+        void _receive(uint8_t value){
+            if (!_rxLength){
+                _rxStart = _clock.now();
+                _rxCrc = 0xFFFF;
+            }
+            _rx[_rxLength++] = value;
+            // crc over a frame including its crc is 0
+            _rxCrc = crc16_update(_rxCrc, value);
+            if ((_rxLength >= 4 && !_rxCrc) || _rxLength == MODBUS_MAX_FRAME_SIZE){
+                _flushReceived();
+            }
+        };
+
+        void _flushReceived(){
+            if (_rxLength){
+                _sink.record(CaptureDirection::rx, _rxStart, _rx, _rxLength);
+                _rxLength = 0;
+            }
+        };
+};
+
+
+#if defined(__linux__)
+
+/*
+Capture sink appending to a file (Linux).
+A new or empty file gets the header, an existing log is continued.
+*/
+class CaptureFile: public CaptureSink{
+    public:
+        CaptureFile(const char *path, uint32_t baudRate);
+        CaptureFile(const CaptureFile&) = delete;
+        ~CaptureFile();
+
+        bool isOpen() const {return _fd >= 0;};
+
+    protected:
+        void _write(const uint8_t *data, size_t length) override;
+
+    private:
+        int _fd{-1};
+};
+
+#endif // __linux__
+
+#endif // MODERNBUS_CAPTURE_H
@@ -0,0 +1,116 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "modernbus_change_filter.h"
+
+ChangeFilter::~ChangeFilter(){
+    if (_shadow != _shadowStorage){
+        delete [] _shadow;
+    }
+    if (_deadbands != _deadbandStorage){
+        delete [] _deadbands;
+    }
+}
+
+void ChangeFilter::setStorage(uint8_t *shadow, uint16_t size, uint16_t *deadbands, uint16_t registerCount){
+    _shadowStorage = shadow;
+    _storageSize = size;
+    _deadbandStorage = deadbands;
+    _storageRegisters = registerCount;
+}
+
+void ChangeFilter::enable(uint16_t size, uint16_t heartbeat){
+    if (size > _size){
+        if (_shadow != _shadowStorage){
+            delete [] _shadow;
+        }
+        if (_shadowStorage && size <= _storageSize){
+            _shadow = _shadowStorage;
+            _size = _storageSize;
+        } else {
+            _shadow = new uint8_t[size];
+            _size = size;
+        }
+    }
+    _heartbeat = heartbeat;
+    _primed = false;
+}
+
+bool ChangeFilter::setDeadband(uint16_t registerIdx, uint16_t deadband, uint16_t registerCount){
+    if (!_shadow || registerIdx >= registerCount){
+        return false;
+    }
+    if (!_deadbands){
+        if (_deadbandStorage && registerCount <= _storageRegisters){
+            _deadbands = _deadbandStorage;
+            memset(_deadbands, 0, registerCount * sizeof(uint16_t));
+        } else {
+            _deadbands = new uint16_t[registerCount]{};
+        }
+        _registerCount = registerCount;
+    }
+    if (registerIdx >= _registerCount){
+        return false;
+    }
+    _deadbands[registerIdx] = deadband;
+    return true;
+}
+
+bool ChangeFilter::accept(const uint8_t *payload, uint16_t len){
+    if (!_shadow){
+        return true;
+    }
+    if (len > _size){
+        len = _size;
+    }
+    bool publish{!_primed || _hasChanged(payload, len)};
+    if (!publish && _heartbeat && ++_sinceLast >= _heartbeat){
+        publish = true;
+    }
+    if (publish){
+        memcpy(_shadow, payload, len);
+        _shadowLen = len;
+        _sinceLast = 0;
+        _primed = true;
+    } else {
+        _suppressed++;
+    }
+    return publish;
+}
+
+void ChangeFilter::setSigned(bool isSigned){
+    _signed = isSigned;
+}
+
+bool ChangeFilter::isEnabled() const{
+    return _shadow != nullptr;
+}
+
+uint32_t ChangeFilter::suppressed() const{
+    return _suppressed;
+}
+
+bool ChangeFilter::_hasChanged(const uint8_t *payload, uint16_t len) const{
+    if (len != _shadowLen){
+        return true;
+    }
+    if (!_deadbands){
+        return memcmp(payload, _shadow, len) != 0;
+    }
+    uint16_t idx{0};
+    for (uint16_t reg = 0; reg < _registerCount && idx + 1 < len; reg++, idx += 2){
+        int32_t now{_value(payload + idx)};
+        int32_t last{_value(_shadow + idx)};
+        int32_t diff{now > last ? now - last : last - now};
+        if (diff > _deadbands[reg]){
+            return true;
+        }
+    }
+    // bytes not covered by a register compare exact
+    return memcmp(payload + idx, _shadow + idx, len - idx) != 0;
+}
+
+int32_t ChangeFilter::_value(const uint8_t *bytes) const{
+    uint16_t raw = (bytes[0] << 8) | bytes[1];
+    return _signed ? static_cast<int16_t>(raw) : raw;
+}
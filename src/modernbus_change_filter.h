@@ -0,0 +1,89 @@
+#if !defined(MODERNBUS_CHANGE_FILTER_H)
+#define MODERNBUS_CHANGE_FILTER_H
+
+#include <Arduino.h>
+
+/*
+ChangeFilter keeps a copy of the last published payload of a request.
+A response only passes if its payload differs from that copy.
+Registers can be given a numeric deadband, so only changes larger than the band pass.
+Optionally every n-th suppressed response passes anyway (heartbeat).
+
+Filter is disabled by default and then passes everything.
+Shadow copy and deadbands are taken from the heap, unless storage is handed in
+by setStorage, e.g. a ChangeFilterStorage.
+*/
+class ChangeFilter{
+    public:
+        ChangeFilter() = default;
+        ChangeFilter(const ChangeFilter&) = delete;
+        ~ChangeFilter();
+
+        /*
+        Enables the filter for payloads up to size bytes.
+        heartbeat = 0 disables the heartbeat.
+        */
+        void enable(uint16_t size, uint16_t heartbeat);
+
+        /*
+        Uses shadow of size bytes and deadbands of registerCount entries instead of the heap.
+        Storage is owned by the caller and must outlive the filter. Call before enable.
+        */
+        void setStorage(uint8_t* shadow, uint16_t size, uint16_t* deadbands, uint16_t registerCount);
+
+        /*
+        Sets the deadband of one register. Registers are compared as unsigned 16 bit values,
+        or signed ones after setSigned(true).
+        Requires registerCount registers. Returns false if disabled or out of range.
+        */
+        bool setDeadband(uint16_t registerIdx, uint16_t deadband, uint16_t registerCount);
+
+        /*
+        Registers hold two's complement values, e.g. temperatures. A step from -1 to 1 is then 2, not 65534.
+        */
+        void setSigned(bool isSigned);
+
+        /*
+        Returns true if the payload should be published and remembers it.
+        */
+        bool accept(const uint8_t* payload, uint16_t len);
+
+        bool isEnabled() const;
+        uint32_t suppressed() const;
+
+    private:
+        uint8_t* _shadow{nullptr};
+        uint16_t* _deadbands{nullptr};
+        // storage handed in by setStorage, not freed
+        uint8_t* _shadowStorage{nullptr};
+        uint16_t* _deadbandStorage{nullptr};
+        uint16_t _size{0};
+        uint16_t _storageSize{0};
+        uint16_t _storageRegisters{0};
+        uint16_t _registerCount{0};
+        bool _signed{false};
+        uint16_t _shadowLen{0};
+        uint16_t _heartbeat{0};
+        uint16_t _sinceLast{0};
+        uint32_t _suppressed{0};
+        bool _primed{false};
+
+        bool _hasChanged(const uint8_t* payload, uint16_t len) const;
+        int32_t _value(const uint8_t* bytes) const;
+};
+
+
+/*
+Fixed storage of a change filter for payloads up to SizeBytes bytes,
+so neither shadow copy nor deadbands touch the heap:
+
+    static ChangeFilterStorage<80> levels{};
+    client.poll(request, sizeof(request), handler).onChange(levels, 50).setDeadband(2);
+*/
+template <uint16_t SizeBytes>
+struct ChangeFilterStorage{
+    uint8_t shadow[SizeBytes];
+    uint16_t deadbands[(SizeBytes + 1) / 2];
+};
+
+#endif // MODERNBUS_CHANGE_FILTER_H
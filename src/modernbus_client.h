@@ -2,14 +2,23 @@
 #define modbus_client_h
 
 #include <Arduino.h>
-#include <TaskSchedulerDeclarations.h>
 #include <mbparser.h>
 #include <linkedlist.h>
 
+#include "modernbus_executor.h"
 #include "modernbus_request.h"
 #include "modernbus_provider.h"
 #include "modernbus_util.h"
 #include "modernbus_server_response.h"
+#include "modernbus_pool.h"
+#include "modernbus_write_buffer.h"
+#include "modernbus_coroutine.h"
+#include "modernbus_future.h"
+#include "modernbus_frame_parser.h"
+#include "modernbus_trace.h"
+#ifdef MODERNBUS_METRICS
+    #include "modernbus_metrics.h"
+#endif
 #ifdef STD_FUNCTIONAL
     #include <functional>
 #endif
@@ -18,69 +27,54 @@
 // protos
 class ServerResponse;
 class ModbusRequest;
-template <typename T> class ModbusClient;
+template <typename, uint16_t, uint16_t> class ModbusClient;
 uint16_t crc16_update(uint16_t crc, uint8_t a);
 
-#ifndef STD_FUNCTIONAL
-    // parser callback function protos
-    template <typename U>
-    void _parserComplete(ResponseParser *parser);
-
-    template <typename U>
-    void _handleError(ResponseParser *parser);
-#endif
-
 
 /*
 Implements a simple modbus client which is reading holding register,
 from a RTU slave.
+
+By default polled requests and queued single requests are kept on the heap.
+When MaxRequests and QueueDepth are given, requests and queue slots are taken
+from static pools of that size instead. The client then does not allocate
+once setup is done.
 */
-template <typename T>
+template <typename T, uint16_t MaxRequests = 0, uint16_t QueueDepth = 0>
 class ModbusClient{
-    
-    #ifndef STD_FUNCTIONAL
-        friend void _parserComplete<T>(ResponseParser *parser);
-        friend void _handleError<T>(ResponseParser *parser);
-    #endif
-    
     public:   
-        ModbusClient(Scheduler *scheduler, T *provider)
+        ModbusClient(ExecutorLoop *scheduler, T *provider)
             :   _provider{provider},
                 _scheduler{scheduler}
         {   
             _scheduler->addTask(_mainTask);
+            _mainTask.watch(_provider->_descriptor());
             _parser.setSlaveAddress(0);
-            // Set callbacks
-            #ifdef STD_FUNCTIONAL
-                _parser.setOnCompleteCB([this](ResponseParser *parser){_parserComplete();});
-                _parser.setOnErrorCB([this](ResponseParser *parser){_handleError();});
-            #else
-                _parser.setExtension(this);
-                _parser.setOnCompleteCB(_parserComplete<T>);
-                _parser.setOnErrorCB(_handleError<T>);
-            #endif
+            _parser.setByteCountLimit(96);
         }
 
         ~ModbusClient(){
             _mainTask.abort();
             _scheduler->deleteTask(_mainTask);
+            // owners of queued single requests, e.g. futures, must not wait forever
+            _abortSingleRequests();
             _free();
             };
 
         /*
         Appends a request instance to the client.
         Client requests data periodical in order of submission.
+        Returns false if the client runs with fixed capacity and is full.
         */
-        void append(ModbusRequest *request){
-            _requests.append(request);
+        bool append(ModbusRequest *request){
+            return _requests.append(request);
         };
 
         /*
         Removes the appended request. Will return a empty request if not found.
         */
         ModbusRequest* remove(ModbusRequest *request){
-            int16_t idx = _requests.index(request);
-            return _requests.remove(idx);
+            return _requests.remove(request);
         };
 
         /*
@@ -93,28 +87,143 @@ class ModbusClient{
 
         Supported Functioncodes are:
         01, 02, 03, 04, 05, 06, 15, 16
+
+        With a fixed capacity client the request is taken from the pool.
+        Polling more than MaxRequests or frames larger than MODERNBUS_POOL_FRAME_SIZE
+        is a programming error. Use tryPoll if the client may be full.
         */ 
         ModbusRequest& poll(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler){
-            // base method
-            auto *mbRequest{new ModbusRequest{request, requestSize, swap, registerSize, handler}};
-            append(mbRequest);
+            ModbusRequest *mbRequest{tryPoll(request, requestSize, swap, registerSize, handler)};
+            assert(mbRequest);
             return *mbRequest;
         }
         
         ModbusRequest& poll(uint8_t* request, uint16_t requestSize, ResponseHandler handler){
             return poll(request, requestSize, false, 0, handler);
         }
-        
 
-        
-        
+        /*
+        Same as poll, but returns nullptr if the pool or the client is full,
+        or the frame is larger than MODERNBUS_POOL_FRAME_SIZE.
+        */
+        ModbusRequest* tryPoll(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler){
+            // base method
+            ModbusRequest *mbRequest{_requestPool.create(request, requestSize, swap, registerSize, handler)};
+            if (!mbRequest){
+                return nullptr;
+            }
+            if (!append(mbRequest)){
+                _requestPool.destroy(mbRequest);
+                return nullptr;
+            }
+            return mbRequest;
+        }
+
+        ModbusRequest* tryPoll(uint8_t* request, uint16_t requestSize, ResponseHandler handler){
+            return tryPoll(request, requestSize, false, 0, handler);
+        }
+
+        /*
+        Queues a copy of the provided request, which is sent once as soon as possible.
+        The copy is taken from the pool of a fixed capacity client, else the heap,
+        and freed once done or cancelled. Until then it may be modified through
+        the returned pointer, e.g. to set an error handler.
+        Returns nullptr if the pool or the queue is full, or the frame is larger
+        than MODERNBUS_POOL_FRAME_SIZE.
+        */
+        ModbusRequest* send(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler){
+            ModbusRequest *mbRequest{_requestPool.create(request, requestSize, swap, registerSize, handler)};
+            if (!mbRequest){
+                return nullptr;
+            }
+            mbRequest->_oneShot = true;
+            if (!send(mbRequest)){
+                _requestPool.destroy(mbRequest);
+                return nullptr;
+            }
+            return mbRequest;
+        }
+
+        ModbusRequest* send(uint8_t* request, uint16_t requestSize, ResponseHandler handler){
+            return send(request, requestSize, false, 0, handler);
+        }
+
         /*
         Queues a single request and sends the request as soon as possible
+        Returns false if the queue runs with fixed capacity and is full.
         */
-        void send(ModbusRequest *request){
-            _singleRequestQueue.append(request);
+        bool send(ModbusRequest *request){
+            if (!_singleRequestQueue.append(request)){
+                return false;
+            }
+            if (_isIdle){
+                // do not wait for the idle period to end
+                _isIdle = false;
+                _mainTask.delay(0);
+            }
+            return true;
         }
         
+        /*
+        Attaches a write behind buffer. Single writes queued by queueWrite
+        are merged into multi writes per slave and address range.
+        Merged writes are sent after single requests but before polled requests.
+        */
+        void setWriteBuffer(WriteBufferBase *buffer){
+            _writeBuffer = buffer;
+        }
+
+        /*
+        Queues a single write (fc 05 or 06) into the write buffer.
+        handler is called once the (merged) write was echoed or failed.
+        Returns false if there is no write buffer or it is full.
+        */
+        bool queueWrite(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value, WriteHandler handler = nullptr){
+            return _writeBuffer && _writeBuffer->add(slaveAddress, functionCode, address, value, handler, millis());
+        }
+
+        #ifdef MODERNBUS_FUTURES
+            /*
+            Queues a copy of frame as single request and returns a future of its response.
+            timeout is the response timeout of the request in ms.
+            If the frame is invalid or the queue is full, the returned future is ready and failed.
+            A request still queued when the client is stopped, reset or destroyed fails
+            with slaveDeviceFailure.
+            See modernbus_future.h
+            */
+            ModbusFuture submit(const uint8_t* frame, uint16_t frameSize, uint32_t timeout = 500){
+                FutureState *state{FutureState::create(frame, frameSize, timeout)};
+                if (state && !send(state->request())){
+                    state->complete(FutureState::failed, ErrorCode::slaveDeviceFailure);
+                }
+                return ModbusFuture{state};
+            }
+        #endif
+
+        #ifdef MODERNBUS_COROUTINES
+            /*
+            Awaitable read (fc 01 - 04). See modernbus_coroutine.h
+                auto result = co_await client.read(slave, 0x04, address, quantity);
+            */
+            Transaction<ModbusClient> read(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity){
+                return Transaction<ModbusClient>{*this, slaveAddress, functionCode, address, quantity};
+            }
+
+            /*
+            Awaitable single write (fc 05, 06).
+            */
+            Transaction<ModbusClient> write(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value){
+                return Transaction<ModbusClient>{*this, slaveAddress, functionCode, address, value};
+            }
+
+            /*
+            Awaitable multi write (fc 15, 16). data holds byteCount bytes as sent on the wire.
+            */
+            Transaction<ModbusClient> write(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t* data, uint8_t byteCount){
+                return Transaction<ModbusClient>{*this, slaveAddress, functionCode, address, quantity, data, byteCount};
+            }
+        #endif
+
         /*
         Starts the client.
         Must be called at least once
@@ -138,7 +247,9 @@ class ModbusClient{
         /*
         Stops the client.
         
-        Keeps state
+        Keeps polled requests.
+        Single requests not done yet fail with slaveDeviceFailure, so their owners,
+        e.g. awaiting coroutines, are resumed.
         Can be restarted with call of start
         */
         void stop()
@@ -147,6 +258,7 @@ class ModbusClient{
                 _isRunning = false;
                 _mainTask.disable();
             }
+            _abortSingleRequests();
         };
 
         /*
@@ -161,11 +273,18 @@ class ModbusClient{
         // setter
         
         /*
-        Sets maximum data to receive. Avoids heap corruption etc.
-        Default 96 bytes.
+        Sets maximum data to receive. Larger responses fail with illegalDataValue.
+        0 accepts all the frame buffer holds. Default 96 bytes.
         */
         void setDataLimit(size_t limit){_parser.setByteCountLimit(limit);};
 
+        /*
+        Receives responses into buffer of MODBUS_MAX_FRAME_SIZE bytes, owned by the caller.
+        Payloads handed to handlers point into it. Set before start.
+        Required with MODERNBUS_EXTERNAL_FRAME_BUFFER.
+        */
+        void setFrameBuffer(uint8_t *buffer){_parser.setFrameBuffer(buffer);};
+
         /*
         Default is no error handler.
         If set each error will be handled with this handler.
@@ -190,7 +309,7 @@ class ModbusClient{
 
         // properties
 
-        ResponseParser& getParser(){return _parser;};
+        FrameParser& getParser(){return _parser;};
         bool isRunning(){return _isRunning;};
         uint32_t errorCount(){return _errorCount;};
         uint32_t requestCount(){return _requestCount;};
@@ -198,23 +317,33 @@ class ModbusClient{
         uint32_t  timeoutCount(){return _timeoutCount;};
         uint32_t dataSent()const{return _dataSent;};
         uint32_t dataReceived()const{return _dataReceived;};
+        uint16_t requestsAvailable() const {return _requestPool.available();};
         size_t dataLimit(){return _parser.byteCountLimit();};
         ModbusRequest& lastErrorRequest(){return *_lastErrorRequest;};
+
+#ifdef MODERNBUS_METRICS
+        /*
+        Round trip, poll jitter and bus occupancy metrics. Snapshot and reset from any thread.
+        */
+        ClientMetrics& metrics(){return _metrics;};
+#endif
  
     private:
         T *_provider;
-        Scheduler *_scheduler;
-        Task _mainTask;
-        ResponseParser _parser;
+        ExecutorLoop *_scheduler;
+        ExecutorTimer _mainTask;
+        FrameParser _parser{false};
 
         ModbusRequest *_currentRequest = nullptr;
         ModbusRequest *_lastErrorRequest = nullptr;
         
-        TinyLinkedList<ModbusRequest*> _requests;
+        RequestPool<MaxRequests> _requestPool;
+        RequestList<MaxRequests> _requests;
         ModbusRequest *_singleRequest = nullptr;
-        TinyLinkedList<ModbusRequest*> _singleRequestQueue;
+        RequestQueue<QueueDepth> _singleRequestQueue;
 
         ErrorHandler _onError = nullptr;
+        WriteBufferBase *_writeBuffer = nullptr;
         
         uint32_t _requestCount{0};
         uint32_t _completeCount{0};
@@ -225,15 +354,27 @@ class ModbusClient{
 
         ErrorCode _lastError{ErrorCode::noError};
         bool _isRunning = false;
-
-        bool _needsValidation;
+        bool _isIdle = false;
+        // current request was taken from the single request queue
+        bool _currentIsSingle = false;
+        // handlers of the current request are running
+        bool _reporting = false;
+
+        bool _needsValidation{false};
+
+#ifdef MODERNBUS_METRICS
+        ClientMetrics _metrics{};
+        uint32_t _txStart{0};
+        // response bytes of the current request received so far
+        uint16_t _rxBytes{0};
+#endif
 
         //mem
         void _free()
         {   
             while(_requests.size()){
                 ModbusRequest *r = _requests.popLeft();
-                delete r;
+                _requestPool.destroy(r);
             }
         };
 
@@ -242,6 +383,12 @@ class ModbusClient{
         void _beginTransmission()
         {   
             while(_provider->available()) _provider->read(); // clean buffer
+#ifdef MODERNBUS_METRICS
+            _txStart = micros();
+            _rxBytes = 0;
+            _recordPollPeriod();
+#endif
+            MODERNBUS_TRACE_POINT(clientBegin, _currentRequest, _currentRequest->_frameSize);
             _provider->_beginTransmission();
 
             _mainTask.setCallback(
@@ -253,34 +400,40 @@ class ModbusClient{
 
         void _transmitRequest()
         {   
-            while(_currentRequest->_requestFrame.iter()){
-                uint8_t token = _currentRequest->_requestFrame.iter.next();
-                _provider->write(token);
+            for (uint16_t idx = 0; idx < _currentRequest->_frameSize; idx++){
+                _provider->write(_currentRequest->_frame[idx]);
                 _dataSent++;
             }
             _requestCount++;
+            MODERNBUS_TRACE_POINT(clientTransmit, _currentRequest, _currentRequest->_frameSize);
             _mainTask.setCallback(
                 [this](){ _endTransmission(); }
                 );
 
             // delay until all bytes send
             // this could be already to fast. So we add 1 ms additional delay so that uart can finish with ease.
-            uint16_t timeUntilEnd = _provider->_calculateTXTime(_currentRequest->_requestFrame.size()) + 1;
+            uint16_t timeUntilEnd = _provider->_calculateTXTime(_currentRequest->_frameSize) + 1;
             _mainTask.delay(timeUntilEnd);
 
         };
 
         void _endTransmission(){
             _provider->_endTransmission();
+            MODERNBUS_TRACE_POINT(clientEnd, _currentRequest, 0);
+#ifdef MODERNBUS_METRICS
+            // wire time only, without the delays around the transmission
+            _metrics.bus().busy(micros(), _currentRequest->_frameSize * _provider->_charTime());
+#endif
             // calc delay
-            uint16_t framesize = _calcFrameSize(_currentRequest->_registerQuantity, 2);
-            uint16_t delayBy = _provider->_calculateTXTime(framesize);
+            uint16_t delayBy = _provider->_calculateTXTime(_currentRequest->_expectedResponseSize());
             delayBy += _currentRequest->deviceDelay();
             _currentRequest->_requestSent = millis();
 
             _mainTask.setCallback(
                 [this](){ _retrieveResponse(); }
                 );
+            // executor may retrieve earlier once data arrives
+            _mainTask.wakeOnData(true);
             _mainTask.delay(delayBy);
         };
 
@@ -289,22 +442,80 @@ class ModbusClient{
         {   
             _parser.setSlaveAddress(_currentRequest->slaveAddress());
             while (!_parser.isComplete() && !_parser.isError() && _provider->available()){
-                uint8_t token = _provider->read();
-                _parser.parse(token);
-                _dataReceived++;
+                // never more than the frame lacks, it is known once the header is in
+                uint8_t chunk[MODERNBUS_READ_CHUNK];
+                size_t len{_provider->available()};
+                if (len > _parser.dataToReceive()){
+                    len = _parser.dataToReceive();
+                }
+                if (len > sizeof(chunk)){
+                    len = sizeof(chunk);
+                }
+                len = _provider->readBytes(chunk, len);
+                MODERNBUS_TRACE_POINT(clientReceive, _currentRequest, len);
+#ifdef MODERNBUS_METRICS
+                _rxBytes += len;
+#endif
+                _parser.parse(chunk, len);
+                _dataReceived += len;
+            }
+#ifdef MODERNBUS_METRICS
+            if (_parser.isComplete() || _parser.isError()){
+                _recordResponse();
+            }
+#endif
+            // handlers may stop the client, the current request is finished below anyway
+            _reporting = true;
+            if (_parser.isComplete()){
+                MODERNBUS_TRACE_POINT(clientComplete, _currentRequest, _parser.frameLength());
+                _parserComplete();
+            } else if (_parser.isError()){
+                MODERNBUS_TRACE_POINT(clientError, _currentRequest, static_cast<uint16_t>(_parser.errorCode()));
+                _handleError();
             }
 
             if (!_parser.isComplete() && !_parser.isError()){
                 _provider->_informNotComplete(_parser.dataToReceive());
                 // See if timeout
                 if (_waitUntilTimeOut()){
+                    _reporting = false;
                     return;
                 } else { // timeout
                     _handleTimeOut();
                 }
             }
+            _mainTask.wakeOnData(false);
             _mainTask.setCallback([this](){ _dispatchRequest();});
+            _finishRequest();
+            _reporting = false;
+        };
 
+        /*
+        Hands the current request back to its owner. Call last, the request may be destroyed from within.
+        */
+        void _finishRequest(){
+            ModbusRequest *done{_currentRequest};
+            // done, stop must not fail it anymore
+            _currentIsSingle = false;
+            if (done->_onDone != nullptr){
+                done->_onDone(done);
+            }
+            _releaseOneShot(done);
+        };
+
+        /*
+        Frees a request queued by send(frame, ...). Others are left to their owner.
+        */
+        void _releaseOneShot(ModbusRequest *request){
+            if (request->_oneShot){
+                if (_currentRequest == request){
+                    _currentRequest = nullptr;
+                }
+                if (_lastErrorRequest == request){
+                    _lastErrorRequest = nullptr;
+                }
+                _requestPool.destroy(request);
+            }
         };
 
         bool _waitUntilTimeOut(){
@@ -312,7 +523,10 @@ class ModbusClient{
             uint32_t sinceSent = millis() - _currentRequest->_requestSent;
             if (sinceSent < _currentRequest->_timeOut){
                 uint32_t wait_until = _currentRequest->_timeOut - sinceSent;
-                _repeatRetrieve(wait_until);
+                // look again once the rest of the frame is due, not only at the timeout
+                uint16_t missing{_parser.dataToReceive()};
+                uint32_t due = _provider->_calculateTXTime(missing > 255 ? 255 : missing) + 1;
+                _repeatRetrieve(due < wait_until ? due : wait_until);
                 return true;
             } else {
                 return false;
@@ -321,6 +535,13 @@ class ModbusClient{
         }
 
         void _handleTimeOut(){
+#ifdef MODERNBUS_METRICS
+            if (_rxBytes){
+                // a partial response held the bus as well
+                _metrics.bus().busy(micros(), _rxBytes * _provider->_charTime());
+            }
+#endif
+            MODERNBUS_TRACE_POINT(clientTimeout, _currentRequest, _parser.dataToReceive());
             _timeoutCount++;
             _errorCount++;
             _lastErrorRequest = _currentRequest;
@@ -336,12 +557,24 @@ class ModbusClient{
 
         void _dispatchRequest()
         {
+            _isIdle = false;
+            ModbusRequest *mergedWrite{nullptr};
             // phase in a single request. Once request is done delete the request
             if (_singleRequestQueue.size()){
                 _currentRequest = _singleRequestQueue.pop();
+                _currentIsSingle = true;
+                if (_currentRequest->isCancelled()){
+                    _skipRequest();
+                    return;
+                }
+                _doRequest();
+            } else if (_writeBuffer && (mergedWrite = _writeBuffer->next(millis()))){
+                _currentRequest = mergedWrite;
+                _currentIsSingle = false;
                 _doRequest();
             } else if (_requests.size()){
-                _currentRequest = _requests.iter.loopNext();
+                _currentRequest = _requests.loopNext();
+                _currentIsSingle = false;
                 _doRequest();
                 return;
             } else {
@@ -364,10 +597,48 @@ class ModbusClient{
         };
         
         
+        void _skipRequest()
+        {
+            // owner of a cancelled request frees it in its error handler
+            ModbusRequest *skipped{_currentRequest};
+            _currentRequest = nullptr;
+            _failSingle(skipped);
+        };
+
+        /*
+        Fails the single requests not done yet, queued or in flight. Called once stopped.
+        A request whose response is being handled right now is finished as usual.
+        */
+        void _abortSingleRequests(){
+            if (_currentRequest && _currentIsSingle && !_reporting){
+                ModbusRequest *current{_currentRequest};
+                _currentRequest = nullptr;
+                _failSingle(current);
+            }
+            while (_singleRequestQueue.size()){
+                _failSingle(_singleRequestQueue.pop());
+            }
+        };
+
+        /*
+        Reports a single request as failed and hands it back to its owner.
+        */
+        void _failSingle(ModbusRequest *request){
+            if (request->_onError != nullptr){
+                request->_onError(&request->response(), ErrorCode::slaveDeviceFailure);
+            }
+            if (request->_onDone != nullptr){
+                request->_onDone(request);
+            }
+            _releaseOneShot(request);
+        };
+
         void _waitUntilRequest()
         {
             _mainTask.setCallback([this](){_dispatchRequest();});
-            _mainTask.delay(100);
+            // pending writes wait for their window only
+            _mainTask.delay(_writeBuffer && _writeBuffer->pending() ? 1 : 100);
+            _isIdle = true;
         };
 
         // parser
@@ -380,38 +651,71 @@ class ModbusClient{
             _parser.reset();
         };
 
-        #ifdef STD_FUNCTIONAL
-            // parser callback function
-            void _parserComplete()
-            {   
-                if (!_isFCOkay()){
+        /*
+        Hands a complete response to the request handler.
+        */
+        void _parserComplete()
+        {   
+            if (!_isFCOkay()){
 
-                    _handleError(ErrorCode::illegalFunction);
-                    return;
-                }
-                _completeCount++;
-                // this makes sure that user will only receive valid data
-                ServerResponse &response = _currentRequest->response();
-                response._slaveAddress = _parser.slaveAddress();
-                response._functionCode = _parser.functionCode();
-                response._byteCount = _parser.byteCount();
-                response._address = _parser.address();
-                response._payload = _parser.data();
-                _currentRequest->_handler(&response);
-                _parser.free();
-            };
+                _handleError(ErrorCode::illegalFunction);
+                return;
+            }
+            _completeCount++;
+            // this makes sure that user will only receive valid data
+            ServerResponse &response = _currentRequest->response();
+            response._slaveAddress = _parser.slaveAddress();
+            response._functionCode = _parser.functionCode();
+            response._byteCount = _parser.byteCount();
+            // read responses do not repeat the address
+            response._address = _isRead() ? _currentRequest->address() : _parser.address();
+            response._payload = _parser.data();
+            if (_currentRequest->_sink){
+                _currentRequest->_sink->publish(response._payload, response._byteCount, micros());
+            }
+            if (!_currentRequest->_filter.accept(response._payload, response._byteCount)){
+                return;
+            }
+            _currentRequest->_handler(&response);
+        };
 
-            void _handleError(ErrorCode error=ErrorCode::noError)
-            {
-                _errorCount++;
-                _lastError = error != ErrorCode::noError ? error : _parser.errorCode();
-                _lastErrorRequest = _currentRequest;
-                if ( _onError != nullptr){
-                    _onError(&_currentRequest->response(), _lastError);
-                }
-                _parser.free();   
-            };
-        #endif
+        void _handleError(ErrorCode error=ErrorCode::noError)
+        {
+            _errorCount++;
+            _lastError = error != ErrorCode::noError ? error : _parser.errorCode();
+            _lastErrorRequest = _currentRequest;
+            if ( _onError != nullptr){
+                _onError(&_currentRequest->response(), _lastError);
+            }
+            if (_currentRequest->_onError != nullptr){
+                _currentRequest->_onError(&_currentRequest->response(), _lastError);
+            }
+        };
+
+#ifdef MODERNBUS_METRICS
+        /*
+        Deviation of the time since the last transmission of a polled request from its every() target.
+        */
+        void _recordPollPeriod(){
+            if (_currentRequest->throttle() && _currentRequest->_lastTransmission){
+                uint32_t period{_txStart - _currentRequest->_lastTransmission};
+                uint32_t target = _currentRequest->throttle() * 1000UL;
+                _metrics.pollJitter().record(period > target ? period - target : target - period);
+            }
+            _currentRequest->_lastTransmission = _txStart;
+        }
+
+        void _recordResponse(){
+            uint32_t now = micros();
+            _metrics.roundTrip(_currentRequest->slaveAddress(), now - _txStart);
+            _metrics.bus().busy(now, _rxBytes * _provider->_charTime());
+        }
+#endif
+
+        bool _isRead() const {
+            uint8_t functionCode{_parser.functionCode()};
+            return functionCode <= 4 || functionCode == FC_READ_WRITE_REGISTERS;
+        }
 
         bool _isFCOkay(){
             if (_needsValidation){
@@ -420,45 +724,6 @@ class ModbusClient{
             return true;
         }
 
-        uint16_t _calcFrameSize(uint16_t noOfRegister, uint16_t registerSize)
-        {
-            return noOfRegister * registerSize + 7;
-        };
-
 };
 
-// Callback without functional. Avoiding lambda captures by passing a glue function.
-// Makes use of void* pointer through parser extension interface.
-// At the moment not explicit tested. May not work. June 2023
-#ifndef STD_FUNCTIONAL
-    template <typename U>
-    void _parserComplete(ResponseParser *parser)
-    {
-        ModbusClient<U>* client {static_cast<ModbusClient<U>*>(parser->getExtension())};
-        if (not client){
-            return;
-        }
-        client->_completeCount++;
-        client->_currentRequest->_sizePayload = parser->byteCount();
-        // this makes sure that user will only receive valid data
-        client->_currentRequest->_payload = parser->payload();
-        client->_currentRequest->payload();
-        client->_currentRequest->_handler(client->_currentRequest);
-        parser->free();
-    };
-
-    template <typename U>
-    void _handleError(ResponseParser *parser)
-    {   
-        ModbusClient<U>* client {static_cast<ModbusClient<U>*>(parser->getExtension())};
-        client->_errorCount++;
-        client->_lastError = parser->errorCode();
-        client->_lastErrorRequest = client->_currentRequest;
-        if ( client->_onError != nullptr){
-            client->_onError(client->_currentRequest, client->_lastError);
-        }
-        parser->free();   
-    };
 #endif
-
-#endif
\ No newline at end of file
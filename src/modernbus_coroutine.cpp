@@ -0,0 +1,25 @@
+#include <Arduino.h>
+
+#include "modernbus_coroutine.h"
+
+#ifdef MODERNBUS_COROUTINES
+
+// out of line, GCC otherwise takes the release of an arena slot for delete of a static object
+static StaticPool<CoroutineFrame, MODERNBUS_COROUTINE_SLOTS> coroutineArena{};
+
+void* coroutineAllocate(size_t size){
+    if (size > sizeof(CoroutineFrame)){
+        return nullptr;
+    }
+    return coroutineArena.allocate();
+}
+
+void coroutineRelease(void* ptr){
+    coroutineArena.release(ptr);
+}
+
+uint16_t coroutineSlotsAvailable(){
+    return coroutineArena.available();
+}
+
+#endif
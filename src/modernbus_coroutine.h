@@ -0,0 +1,204 @@
+#if !defined(MODERNBUS_COROUTINE_H)
+#define MODERNBUS_COROUTINE_H
+
+/*
+C++20 coroutine API of the client.
+
+    ModbusTask controlValve(Client &client){
+        auto status = co_await client.read(0x01, 0x04, 0x0010, 2);
+        if (!status.ok()) co_return;
+        if (status.as<uint16_t>()[0] > 100){
+            co_await client.write(0x01, 0x06, 0x0020, 0);
+        }
+    }
+
+Transactions are queued as single requests and driven by the main task of the client.
+The coroutine is resumed once the client is done with the request, or failed
+once the client is stopped or reset. The result
+is a copy, its payload points into the frame buffer of the client and is valid
+until the client receives its next response.
+Coroutine frames are taken from a static arena, see MODERNBUS_COROUTINE_SLOTS.
+*/
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+    #define MODERNBUS_COROUTINES 1
+#endif
+#endif
+
+#ifdef MODERNBUS_COROUTINES
+
+#include <Arduino.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+
+#include "modernbus_request.h"
+#include "modernbus_frame.h"
+#include "modernbus_payload.h"
+#include "modernbus_pool.h"
+
+// number of coroutines running at the same time
+#ifndef MODERNBUS_COROUTINE_SLOTS
+#define MODERNBUS_COROUTINE_SLOTS 4
+#endif
+
+// max size of one coroutine frame. Each transaction in scope takes about 550 bytes.
+#ifndef MODERNBUS_COROUTINE_FRAME_SIZE
+#define MODERNBUS_COROUTINE_FRAME_SIZE 2048
+#endif
+
+struct CoroutineFrame{
+    alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) uint8_t bytes[MODERNBUS_COROUTINE_FRAME_SIZE];
+};
+
+// coroutine frame arena, nullptr if size exceeds a frame or all slots are taken
+void* coroutineAllocate(size_t size);
+void coroutineRelease(void* ptr);
+uint16_t coroutineSlotsAvailable();
+
+
+/*
+Fire and forget coroutine type. Starts right away and frees its frame when done.
+If the arena is exhausted, the coroutine does not run and valid() is false.
+*/
+class ModbusTask{
+    public:
+        struct promise_type{
+            ModbusTask get_return_object(){return ModbusTask{true};};
+            std::suspend_never initial_suspend() noexcept {return {};};
+            std::suspend_never final_suspend() noexcept {return {};};
+            void return_void(){};
+            void unhandled_exception(){std::terminate();};
+
+            static ModbusTask get_return_object_on_allocation_failure(){return ModbusTask{false};};
+
+            static void* operator new(size_t size) noexcept {
+                return coroutineAllocate(size);
+            };
+
+            static void operator delete(void* ptr){
+                coroutineRelease(ptr);
+            };
+        };
+
+        bool valid() const {return _valid;};
+
+    private:
+        explicit ModbusTask(bool valid) : _valid{valid} {};
+        bool _valid;
+};
+
+
+/*
+Result of an awaited transaction, copied from the response.
+payload points into the frame buffer of the client. It is valid until the
+client receives its next response, e.g. the one of the next co_await.
+*/
+struct TransactionResult{
+    ErrorCode error{ErrorCode::noError};
+    uint8_t slaveAddress{0};
+    uint8_t functionCode{0};
+    uint16_t address{0};
+    uint16_t byteCount{0};
+    const uint8_t *payload{nullptr};
+
+    bool ok() const {return error == ErrorCode::noError;};
+
+    /*
+    Typed view on the payload. See ServerResponse::as.
+    */
+    template <typename V, WordOrder O = WordOrder::ABCD>
+    PayloadView<V, O> as() const {return PayloadView<V, O>{payload, byteCount};};
+
+    BitView bits() const {return BitView{payload, byteCount};};
+};
+
+
+/*
+Awaitable of one request. Holds request and frame itself, so awaiting does not allocate.
+Created by ModbusClient::read and ModbusClient::write.
+*/
+template <typename TClient>
+class Transaction{
+    public:
+        Transaction(TClient &client, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t* data = nullptr, uint8_t byteCount = 0)
+        :   _client{client}
+        {
+            if (functionCode == 15 || functionCode == 16){
+                _frameSize = buildWriteMultipleFrame(_frame, slaveAddress, functionCode, address, quantity, data, byteCount);
+            } else if (functionCode == 5 || functionCode == 6){
+                _frameSize = buildWriteSingleFrame(_frame, slaveAddress, functionCode, address, quantity);
+            } else {
+                _frameSize = buildReadFrame(_frame, slaveAddress, functionCode, address, quantity);
+            }
+        };
+
+        Transaction(const Transaction&) = delete;
+
+        /*
+        The request lives in the coroutine frame. The coroutine is only resumed,
+        and may end, once the client is done with the request.
+        */
+        ~Transaction(){
+            if (_request){
+                _request->~ModbusRequest();
+            }
+        };
+
+        bool await_ready() const noexcept {return false;};
+
+        bool await_suspend(std::coroutine_handle<> handle){
+            _handle = handle;
+            _request = new (_requestStorage) ModbusRequest{_frame, _frameSize, false, 0, _onResponse, _frame};
+            _request->setExtension(this);
+            _request->setOnError(_onError);
+            _request->setOnDone(_onDone);
+            if (!_client.send(_request)){
+                // queue is full. do not suspend
+                _result.error = ErrorCode::slaveDeviceFailure;
+                return false;
+            }
+            return true;
+        };
+
+        TransactionResult await_resume() const {
+            return _result;
+        };
+
+    private:
+        TClient &_client;
+        std::coroutine_handle<> _handle{};
+        TransactionResult _result{};
+        ModbusRequest *_request{nullptr};
+        alignas(ModbusRequest) uint8_t _requestStorage[sizeof(ModbusRequest)];
+        uint16_t _frameSize{0};
+        uint8_t _frame[MODBUS_MAX_FRAME_SIZE];
+
+        static void _onResponse(ServerResponse *response){
+            _copy(response, ErrorCode::noError);
+        };
+
+        static void _onError(ServerResponse *response, ErrorCode errorCode){
+            _copy(response, errorCode);
+        };
+
+        static void _copy(ServerResponse *response, ErrorCode errorCode){
+            Transaction *self{static_cast<Transaction*>(response->request()->getExtension())};
+            TransactionResult &result{self->_result};
+            result.error = errorCode;
+            result.slaveAddress = response->slaveAddress();
+            result.functionCode = response->functionCode();
+            result.address = response->address();
+            result.byteCount = response->byteCount();
+            result.payload = response->payload();
+        };
+
+        static void _onDone(ModbusRequest *request){
+            static_cast<Transaction*>(request->getExtension())->_handle.resume();
+        };
+};
+
+#endif // MODERNBUS_COROUTINES
+
+#endif // MODERNBUS_COROUTINE_H
@@ -56,3 +56,116 @@ void CrossLinkManager::_informWrite(CrossLinkStream &stream)
         }
     }
 }
+
+
+SimulatedLinkStream::SimulatedLinkStream(SimulatedLink &link)
+:   _link{link}
+{}
+
+size_t SimulatedLinkStream::write(uint8_t value){
+    const LineSettings &settings{_link._settings};
+    uint32_t start = micros();
+    // one byte after the other
+    if (_stats.sent && static_cast<int32_t>(_txFree - start) > 0){
+        start = _txFree;
+    }
+    if (_received && static_cast<int32_t>(_lastReceived + settings.turnaround - start) > 0){
+        start = _lastReceived + settings.turnaround;
+    }
+    if (_link._happens(_faults.splitRate)){
+        start += _faults.splitGap;
+        _stats.split++;
+    }
+    _txFree = start + _link.charTime();
+    uint32_t arrival{_txFree + settings.propagationDelay};
+    if (_faults.jitter){
+        arrival += _link._next() % (_faults.jitter + 1);
+    }
+    // jitter does not reorder bytes
+    if (_stats.sent && static_cast<int32_t>(_lastSent - arrival) > 0){
+        arrival = _lastSent;
+    }
+    _lastSent = arrival;
+    _stats.sent++;
+
+    if (_link._happens(_faults.dropRate)){
+        _stats.dropped++;
+        return 1;
+    }
+    if (_link._happens(_faults.bitErrorRate)){
+        value ^= 1 << (_link._next() % settings.dataBits);
+        _stats.corrupted++;
+    }
+    if (_peer->_count == MODERNBUS_LINK_BUFFER){
+        _stats.overruns++;
+        return 1;
+    }
+    _peer->_receive(value, arrival);
+    return 1;
+}
+
+int SimulatedLinkStream::read(){
+    if (!_count || !_arrived(micros())){
+        return -1;
+    }
+    uint8_t value{_inbound[_head].value};
+    _head = (_head + 1) % MODERNBUS_LINK_BUFFER;
+    _count--;
+    return value;
+}
+
+size_t SimulatedLinkStream::available(){
+    uint32_t now = micros();
+    // bytes arrive in order. Count until the first still on its way.
+    size_t count{0};
+    while (count < _count){
+        const Byte &byte{_inbound[(_head + count) % MODERNBUS_LINK_BUFFER]};
+        if (static_cast<int32_t>(now - byte.arrival) < 0){
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+int SimulatedLinkStream::baudRate(){
+    return _link._settings.baudRate;
+}
+
+void SimulatedLinkStream::_receive(uint8_t value, uint32_t arrival){
+    Byte &byte{_inbound[(_head + _count) % MODERNBUS_LINK_BUFFER]};
+    byte.value = value;
+    byte.arrival = arrival;
+    _count++;
+    _lastReceived = arrival;
+    _received = true;
+}
+
+bool SimulatedLinkStream::_arrived(uint32_t now) const {
+    return static_cast<int32_t>(now - _inbound[_head].arrival) >= 0;
+}
+
+SimulatedLink::SimulatedLink()
+:   first{*this},
+    second{*this}
+{
+    first._peer = &second;
+    second._peer = &first;
+}
+
+uint32_t SimulatedLink::charTime() const {
+    uint32_t bits{1u + _settings.dataBits + (_settings.parity == LineParity::none ? 0u : 1u) + _settings.stopBits};
+    return (bits * 1000000UL + _settings.baudRate - 1) / _settings.baudRate;
+}
+
+uint32_t SimulatedLink::_next(){
+    // xorshift32
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+bool SimulatedLink::_happens(uint32_t rate){
+    return rate && _next() % 1000000UL < rate;
+}
@@ -37,4 +37,150 @@ class CrossLinkManager{
 };
 
 
+// bytes in flight per direction of a SimulatedLink
+#ifndef MODERNBUS_LINK_BUFFER
+#define MODERNBUS_LINK_BUFFER 512
+#endif
+
+enum class LineParity : uint8_t {
+    none,
+    even,
+    odd
+};
+
+/*
+Serial line settings of a SimulatedLink. Times in us.
+*/
+struct LineSettings{
+    uint32_t baudRate{19200};
+    uint8_t dataBits{8};
+    LineParity parity{LineParity::even};
+    uint8_t stopBits{1};
+    // from the end of a byte on the sender until it is available at the receiver
+    uint32_t propagationDelay{0};
+    // a side starts sending no earlier than this after the last byte it received
+    uint32_t turnaround{0};
+};
+
+/*
+Faults injected into the bytes one side sends. Rates in bytes per million.
+*/
+struct LineFaults{
+    // one random bit of the byte flips
+    uint32_t bitErrorRate{0};
+    // the byte is lost
+    uint32_t dropRate{0};
+    // the line stays silent for splitGap before the byte
+    uint32_t splitRate{0};
+    uint32_t splitGap{0};
+    // bytes arrive up to jitter us late, in order
+    uint32_t jitter{0};
+};
+
+/*
+Counters of one direction of a SimulatedLink.
+*/
+struct LineStats{
+    uint32_t sent{0};
+    uint32_t corrupted{0};
+    uint32_t dropped{0};
+    uint32_t split{0};
+    // bytes lost as MODERNBUS_LINK_BUFFER was full
+    uint32_t overruns{0};
+};
+
+class SimulatedLink;
+
+/*
+One end of a SimulatedLink. Bytes written are sent one after the other
+at the line speed. Bytes received become available once they arrived.
+*/
+class SimulatedLinkStream{
+    friend class SimulatedLink;
+    public:
+        SimulatedLinkStream(const SimulatedLinkStream&) = delete;
+
+        size_t write(uint8_t value);
+        int read();
+        size_t available();
+        int baudRate();
+
+        /*
+        Faults injected into the bytes this end sends.
+        */
+        void setFaults(const LineFaults &faults){_faults = faults;};
+
+        /*
+        Counters of the bytes this end sent.
+        */
+        const LineStats& stats() const {return _stats;};
+
+    private:
+        SimulatedLinkStream(SimulatedLink &link);
+
+        struct Byte{
+            uint8_t value;
+            uint32_t arrival;
+        };
+
+        SimulatedLink &_link;
+        SimulatedLinkStream *_peer{nullptr};
+        LineFaults _faults{};
+        LineStats _stats{};
+        // bytes on their way to this end
+        Byte _inbound[MODERNBUS_LINK_BUFFER];
+        uint16_t _head{0};
+        uint16_t _count{0};
+        // the line of this end is free from then on
+        uint32_t _txFree{0};
+        // arrival of the last byte sent and received
+        uint32_t _lastSent{0};
+        uint32_t _lastReceived{0};
+        bool _received{false};
+
+        void _receive(uint8_t value, uint32_t arrival);
+        bool _arrived(uint32_t now) const;
+};
+
+using SimulatedLinkProvider = SerialProvider<SimulatedLinkStream>;
+
+/*
+Two ends of a serial line with the timing of real hardware.
+
+    SimulatedLink link{};
+    link.configure(LineSettings{9600, 8, LineParity::even, 1, 200, 500});
+    link.second.setFaults(faults);     // responses of the server
+    SimulatedLinkProvider clientProvider{link.first};
+    SimulatedLinkProvider serverProvider{link.second};
+
+A byte takes start, data, parity and stop bits at the baud rate on the line.
+Faults are drawn from a pseudo random generator. seed makes a run repeatable.
+*/
+class SimulatedLink{
+    friend class SimulatedLinkStream;
+    public:
+        SimulatedLink();
+        SimulatedLink(const SimulatedLink&) = delete;
+
+        SimulatedLinkStream first;
+        SimulatedLinkStream second;
+
+        void configure(const LineSettings &settings){_settings = settings;};
+        const LineSettings& settings() const {return _settings;};
+
+        void seed(uint32_t seed){_random = seed ? seed : 1;};
+
+        /*
+        Time in us one byte takes on the line.
+        */
+        uint32_t charTime() const;
+
+    private:
+        LineSettings _settings{};
+        uint32_t _random{0x2545F491};
+
+        uint32_t _next();
+        bool _happens(uint32_t rate);
+};
+
 #endif // MODERNBUS_CROSSLINK_H
@@ -0,0 +1,247 @@
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modernbus_epoll.h"
+
+#define EPOLL_MAX_EVENTS 8
+
+// Timer
+
+EpollLoop::Timer::~Timer(){
+    if (_loop){
+        _loop->deleteTask(*this);
+    }
+}
+
+void EpollLoop::Timer::set(uint32_t interval, int32_t iterations, std::function<void()> callback){
+    _interval = static_cast<uint64_t>(interval) * 1000;
+    _iterations = iterations;
+    _callback = callback;
+}
+
+void EpollLoop::Timer::setCallback(std::function<void()> callback){
+    _callback = callback;
+}
+
+void EpollLoop::Timer::setInterval(uint32_t interval){
+    _interval = static_cast<uint64_t>(interval) * 1000;
+    _due = EpollLoop::now() + _interval;
+}
+
+void EpollLoop::Timer::delay(uint32_t ms){
+    delayMicros(ms * 1000);
+}
+
+void EpollLoop::Timer::delayMicros(uint32_t us){
+    _due = EpollLoop::now() + us;
+}
+
+bool EpollLoop::Timer::enable(){
+    _runs = 0;
+    _enabled = _iterations != 0;
+    _due = EpollLoop::now();
+    return _enabled;
+}
+
+bool EpollLoop::Timer::disable(){
+    bool wasEnabled{_enabled};
+    _enabled = false;
+    return wasEnabled;
+}
+
+void EpollLoop::Timer::abort(){
+    disable();
+}
+
+bool EpollLoop::Timer::isEnabled() const{
+    return _enabled;
+}
+
+void EpollLoop::Timer::watch(int fd){
+    if (_loop && _fd >= 0){
+        _loop->_unwatch(*this);
+    }
+    _fd = fd;
+    if (_loop && _fd >= 0){
+        _loop->_watch(*this);
+    }
+}
+
+void EpollLoop::Timer::wakeOnData(bool wake){
+    _wakeOnData = wake;
+}
+
+// Loop
+
+EpollLoop::EpollLoop()
+:   _epoll{epoll_create1(EPOLL_CLOEXEC)},
+    _timerFd{timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)},
+    _eventFd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+{
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &_timerFd;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _timerFd, &event);
+    event.data.ptr = &_eventFd;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _eventFd, &event);
+}
+
+EpollLoop::~EpollLoop(){
+    while (_timers){
+        deleteTask(*_timers);
+    }
+    close(_eventFd);
+    close(_timerFd);
+    close(_epoll);
+}
+
+uint64_t EpollLoop::now(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void EpollLoop::addTask(Timer &timer){
+    if (timer._loop){
+        timer._loop->deleteTask(timer);
+    }
+    timer._loop = this;
+    timer._next = _timers;
+    _timers = &timer;
+    if (timer._fd >= 0){
+        _watch(timer);
+    }
+}
+
+void EpollLoop::deleteTask(Timer &timer){
+    if (timer._loop != this){
+        return;
+    }
+    Timer **link{&_timers};
+    while (*link && *link != &timer){
+        link = &(*link)->_next;
+    }
+    if (*link){
+        *link = timer._next;
+    }
+    if (timer._fd >= 0){
+        _unwatch(timer);
+    }
+    timer._loop = nullptr;
+    timer._next = nullptr;
+}
+
+bool EpollLoop::execute(){
+    uint64_t start{now()};
+    bool ran{false};
+    Timer *timer{_timers};
+    while (timer){
+        Timer *next{timer->_next};
+        if (timer->_enabled && timer->_due <= start){
+            timer->_due = start + timer->_interval;
+            timer->_runs++;
+            // callback may replace itself
+            std::function<void()> callback{timer->_callback};
+            if (callback){
+                callback();
+            }
+            // enable() within the callback starts over
+            if (timer->_iterations != TASK_FOREVER && timer->_runs >= timer->_iterations){
+                timer->_enabled = false;
+            }
+            ran = true;
+        }
+        timer = next;
+    }
+
+    int timeout{-1};
+    uint64_t due{_nextDue()};
+    if (due <= now()){
+        timeout = 0;
+    } else {
+        _arm(due);
+    }
+
+    epoll_event events[EPOLL_MAX_EVENTS];
+    int count{epoll_wait(_epoll, events, EPOLL_MAX_EVENTS, timeout)};
+    if (count > 0){
+        _wakeups++;
+    }
+    uint64_t counter;
+    for (int idx = 0; idx < count; idx++){
+        void *source{events[idx].data.ptr};
+        if (source == &_timerFd){
+            // one shot expired
+            _armed = 0;
+            while (read(_timerFd, &counter, sizeof(counter)) > 0);
+        } else if (source == &_eventFd){
+            while (read(_eventFd, &counter, sizeof(counter)) > 0);
+        } else {
+            Timer *watched{static_cast<Timer*>(source)};
+            if (watched->_enabled && watched->_wakeOnData){
+                watched->_due = 0;
+            }
+        }
+    }
+    return !ran;
+}
+
+void EpollLoop::run(){
+    _stopped.store(false);
+    while (!_stopped.load()){
+        execute();
+    }
+}
+
+void EpollLoop::stop(){
+    _stopped.store(true);
+    wakeup();
+}
+
+void EpollLoop::wakeup(){
+    uint64_t one{1};
+    ssize_t written{write(_eventFd, &one, sizeof(one))};
+    (void)written;
+}
+
+void EpollLoop::_watch(Timer &timer){
+    epoll_event event{};
+    // edge triggered. Unread data does not wake the loop over and over
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &timer;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, timer._fd, &event);
+}
+
+void EpollLoop::_unwatch(Timer &timer){
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, timer._fd, nullptr);
+}
+
+void EpollLoop::_arm(uint64_t due){
+    if (due == _armed){
+        return;
+    }
+    itimerspec spec{};
+    if (due != UINT64_MAX){
+        spec.it_value.tv_sec = due / 1000000;
+        spec.it_value.tv_nsec = (due % 1000000) * 1000;
+    }
+    timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    _armed = due;
+}
+
+uint64_t EpollLoop::_nextDue() const{
+    uint64_t due{UINT64_MAX};
+    for (Timer *timer = _timers; timer; timer = timer->_next){
+        if (timer->_enabled && timer->_due < due){
+            due = timer->_due;
+        }
+    }
+    return due;
+}
+
+#endif // __linux__
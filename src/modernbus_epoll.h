@@ -0,0 +1,120 @@
+#if !defined(MODERNBUS_EPOLL_H)
+#define MODERNBUS_EPOLL_H
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+
+#ifndef TASK_IMMEDIATE
+#define TASK_IMMEDIATE 0
+#endif
+
+#ifndef TASK_FOREVER
+#define TASK_FOREVER (-1)
+#endif
+
+/*
+Native Linux event loop based on epoll and timerfd.
+
+Drop in replacement for TaskScheduler on Linux hosts:
+    EpollLoop loop{};
+    ModbusClient<Provider> client{&loop, &provider};
+    loop.run();
+
+The loop sleeps until the next timer is due, a watched descriptor
+becomes readable or wakeup() is called from any thread.
+Timers have microsecond resolution.
+*/
+class EpollLoop{
+    public:
+        /*
+        One shot timer with the interface of a TaskScheduler Task.
+        After the callback the timer is due again after interval
+        unless the callback delayed it. Once it ran iterations times
+        it disables itself, TASK_FOREVER runs until disabled.
+        */
+        class Timer{
+            friend class EpollLoop;
+            public:
+                Timer() = default;
+                Timer(const Timer&) = delete;
+                ~Timer();
+
+                void set(uint32_t interval, int32_t iterations, std::function<void()> callback);
+                void setCallback(std::function<void()> callback);
+                void setInterval(uint32_t interval);
+                void delay(uint32_t ms);
+                void delayMicros(uint32_t us);
+                bool enable();
+                bool disable();
+                void abort();
+                bool isEnabled() const;
+
+                /*
+                Watches fd for data. Use wakeOnData to decide
+                whether new data runs the timer right away.
+                */
+                void watch(int fd);
+                void wakeOnData(bool wake);
+
+            private:
+                EpollLoop *_loop{nullptr};
+                Timer *_next{nullptr};
+                std::function<void()> _callback{nullptr};
+                int32_t _iterations{TASK_FOREVER};
+                int32_t _runs{0};
+                uint64_t _interval{0};
+                uint64_t _due{0};
+                int _fd{-1};
+                bool _enabled{false};
+                bool _wakeOnData{false};
+        };
+
+        EpollLoop();
+        EpollLoop(const EpollLoop&) = delete;
+        ~EpollLoop();
+
+        void addTask(Timer &timer);
+        void deleteTask(Timer &timer);
+
+        /*
+        Runs all due timers. Then sleeps until the next timer is due,
+        a watched descriptor has data or wakeup() is called.
+        Returns true if no timer ran, as Scheduler::execute.
+        */
+        bool execute();
+
+        /*
+        Runs until stop() is called.
+        */
+        void run();
+
+        // thread safe
+        void stop();
+        void wakeup();
+
+        uint32_t wakeups() const {return _wakeups;};
+
+        // monotonic time in us
+        static uint64_t now();
+
+    private:
+        int _epoll{-1};
+        int _timerFd{-1};
+        int _eventFd{-1};
+        Timer *_timers{nullptr};
+        uint64_t _armed{0};
+        uint32_t _wakeups{0};
+        std::atomic<bool> _stopped{false};
+
+        void _watch(Timer &timer);
+        void _unwatch(Timer &timer);
+        void _arm(uint64_t due);
+        uint64_t _nextDue() const;
+};
+
+#endif // __linux__
+
+#endif // MODERNBUS_EPOLL_H
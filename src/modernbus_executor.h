@@ -0,0 +1,49 @@
+#if !defined(MODERNBUS_EXECUTOR_H)
+#define MODERNBUS_EXECUTOR_H
+
+/*
+Executor of client and server.
+
+Client and server are driven by one timer each. A timer runs its callback
+once it is due, then again every interval unless the callback delays it.
+By default TaskScheduler is used:
+    ExecutorLoop  = Scheduler
+    ExecutorTimer = SchedulerTimer (a Task)
+
+With the flag MODERNBUS_EPOLL (Linux only) the native EpollLoop is used instead.
+It sleeps until the next timer is due or the provider has data and
+supports microsecond delays. See modernbus_epoll.h
+*/
+
+#ifdef MODERNBUS_EPOLL
+
+#include "modernbus_epoll.h"
+
+using ExecutorLoop = EpollLoop;
+using ExecutorTimer = EpollLoop::Timer;
+
+#else
+
+#include <TaskSchedulerDeclarations.h>
+
+/*
+TaskScheduler adapter. A Task which ignores descriptors,
+as TaskScheduler polls the provider anyway.
+*/
+class SchedulerTimer: public Task{
+    public:
+        // Round up to full ms
+        void delayMicros(uint32_t us){
+            delay((us + 999) / 1000);
+        };
+
+        void watch(int fd){};
+        void wakeOnData(bool wake){};
+};
+
+using ExecutorLoop = Scheduler;
+using ExecutorTimer = SchedulerTimer;
+
+#endif // MODERNBUS_EPOLL
+
+#endif // MODERNBUS_EXECUTOR_H
@@ -0,0 +1,56 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "modernbus_frame.h"
+#include "modernbus_util.h"
+
+static uint16_t _writeHeader(uint8_t* dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value){
+    dst[0] = slaveAddress;
+    dst[1] = functionCode;
+    dst[2] = highByte(address);
+    dst[3] = lowByte(address);
+    dst[4] = highByte(value);
+    dst[5] = lowByte(value);
+    return 6;
+}
+
+uint16_t buildReadFrame(uint8_t *dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity){
+    return appendCRC(dst, _writeHeader(dst, slaveAddress, functionCode, address, quantity));
+}
+
+uint16_t buildWriteSingleFrame(uint8_t *dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value){
+    return appendCRC(dst, _writeHeader(dst, slaveAddress, functionCode, address, value));
+}
+
+uint16_t buildWriteMultipleFrame(uint8_t *dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t *data, uint8_t byteCount){
+    uint16_t len{_writeHeader(dst, slaveAddress, functionCode, address, quantity)};
+    dst[len++] = byteCount;
+    memmove(dst + len, data, byteCount);
+    return appendCRC(dst, len + byteCount);
+}
+
+uint16_t buildMaskWriteFrame(uint8_t *dst, uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask){
+    uint16_t len{_writeHeader(dst, slaveAddress, 22, address, andMask)};
+    dst[len++] = highByte(orMask);
+    dst[len++] = lowByte(orMask);
+    return appendCRC(dst, len);
+}
+
+uint16_t buildReadWriteFrame(uint8_t *dst, uint8_t slaveAddress, uint16_t readAddress, uint16_t readQuantity,
+                             uint16_t writeAddress, uint16_t writeQuantity, const uint8_t *data, uint8_t byteCount){
+    uint16_t len{_writeHeader(dst, slaveAddress, 23, readAddress, readQuantity)};
+    dst[len++] = highByte(writeAddress);
+    dst[len++] = lowByte(writeAddress);
+    dst[len++] = highByte(writeQuantity);
+    dst[len++] = lowByte(writeQuantity);
+    dst[len++] = byteCount;
+    memmove(dst + len, data, byteCount);
+    return appendCRC(dst, len + byteCount);
+}
+
+uint16_t appendCRC(uint8_t *frame, uint16_t len){
+    uint16_t crc{crc16(frame, len)};
+    frame[len] = lowByte(crc);
+    frame[len + 1] = highByte(crc);
+    return len + 2;
+}
@@ -0,0 +1,38 @@
+#if !defined(MODERNBUS_FRAME_H)
+#define MODERNBUS_FRAME_H
+
+#include <Arduino.h>
+
+/*
+Maximum size of a modbus RTU frame (ADU).
+*/
+#define MODBUS_MAX_FRAME_SIZE 256
+
+/*
+Helpers to build RTU request frames including crc.
+All of them return the size of the frame written to dst.
+dst must be large enough to hold the frame.
+*/
+
+// fc 01 - 04
+uint16_t buildReadFrame(uint8_t* dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity);
+
+// fc 05, 06
+uint16_t buildWriteSingleFrame(uint8_t* dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value);
+
+// fc 15, 16. data holds byteCount bytes of bit packed coils or big endian registers.
+// data may already be placed at dst + 7.
+uint16_t buildWriteMultipleFrame(uint8_t* dst, uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t* data, uint8_t byteCount);
+
+// fc 22. Register becomes (register & andMask) | (orMask & ~andMask).
+uint16_t buildMaskWriteFrame(uint8_t* dst, uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask);
+
+// fc 23. Writes writeQuantity registers from data, then reads readQuantity registers.
+// data holds byteCount bytes of big endian registers and may already be placed at dst + 11.
+uint16_t buildReadWriteFrame(uint8_t* dst, uint8_t slaveAddress, uint16_t readAddress, uint16_t readQuantity,
+                             uint16_t writeAddress, uint16_t writeQuantity, const uint8_t* data, uint8_t byteCount);
+
+// Appends crc to frame of size len. Returns len + 2.
+uint16_t appendCRC(uint8_t* frame, uint16_t len);
+
+#endif // MODERNBUS_FRAME_H
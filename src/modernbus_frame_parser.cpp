@@ -0,0 +1,203 @@
+#include <Arduino.h>
+#include <assert.h>
+#include <string.h>
+
+#include "modernbus_frame_parser.h"
+#include "modernbus_util.h"
+
+// expected length while it depends on a byte count not received yet
+#define LENGTH_UNKNOWN 0
+
+size_t FrameParser::parse(const uint8_t *data, size_t len){
+    // MODERNBUS_EXTERNAL_FRAME_BUFFER requires setFrameBuffer
+    assert(_frame);
+    size_t consumed{0};
+    if (len && (isComplete() || isError())){
+        reset();
+    }
+    if (!_len && _slaveFilter){
+        // skip to the slave address
+        const void *start{memchr(data, _slaveFilter, len)};
+        if (!start){
+            return len;
+        }
+        consumed = static_cast<const uint8_t*>(start) - data;
+    }
+    while (consumed < len && !isComplete() && !isError()){
+        if (_len < 2 || !_expected){
+            // header: one byte at a time until the length is known
+            _frame[_len++] = data[consumed++];
+            if (_len == 1){
+                _state = ParserState::functionCode;
+            } else if (_len == 2){
+                _expectFrame();
+            } else if (_len == _byteCountAt() + 1){
+                uint8_t byteCount{_frame[_len - 1]};
+                if ((_byteCountLimit && byteCount > _byteCountLimit) || _len + byteCount + 2 > MODBUS_MAX_FRAME_SIZE){
+                    _fail(ErrorCode::illegalDataValue);
+                    break;
+                }
+                _expected = _len + byteCount + 2;
+            }
+        } else {
+            // fixed fields, payload and crc in bulk
+            size_t count = _expected - _len;
+            if (count > len - consumed){
+                count = len - consumed;
+            }
+            memcpy(_frame + _len, data + consumed, count);
+            _len += count;
+            consumed += count;
+        }
+        if (_expected && _len == _expected){
+            _finish();
+        }
+    }
+    return consumed;
+}
+
+void FrameParser::reset(){
+    _len = 0;
+    _expected = 0;
+    _state = ParserState::slaveAddress;
+    _error = ErrorCode::noError;
+}
+
+void FrameParser::_expectFrame(){
+    uint8_t functionCode{_frame[1]};
+    _state = ParserState::data;
+    if (functionCode & 0x80){
+        // exception code and crc
+        _expected = _isRequest ? 0 : 5;
+        if (_isRequest){
+            _fail(ErrorCode::illegalFunction);
+        }
+        return;
+    }
+    switch (functionCode){
+        case 1: case 2: case 3: case 4:
+            _expected = _isRequest ? 8 : LENGTH_UNKNOWN;
+            break;
+        case 5: case 6:
+            _expected = 8;
+            break;
+        case 15: case 16:
+            _expected = _isRequest ? LENGTH_UNKNOWN : 8;
+            break;
+        case FC_MASK_WRITE_REGISTER:
+            _expected = 10;
+            break;
+        case FC_READ_WRITE_REGISTERS:
+            _expected = LENGTH_UNKNOWN;
+            break;
+        default:
+            _fail(ErrorCode::illegalFunction);
+    }
+}
+
+uint16_t FrameParser::_byteCountAt() const{
+    if (!_isRequest){
+        return 2;
+    }
+    return functionCode() == FC_READ_WRITE_REGISTERS ? 10 : 6;
+}
+
+void FrameParser::_fail(ErrorCode error){
+    _error = error;
+    _state = ParserState::error;
+}
+
+void FrameParser::_finish(){
+    if (crc16(_frame, _len)){
+        // crc over a frame including its crc is 0
+        _fail(ErrorCode::CRCError);
+    } else if (_frame[1] & 0x80){
+        _fail(static_cast<ErrorCode>(_frame[2]));
+    } else {
+        if (_swap && _registerSize > 1 && _isRead()){
+            uint8_t *payload{data()};
+            for (uint16_t reg = 0; reg + _registerSize <= byteCount(); reg += _registerSize){
+                for (uint16_t lo = reg, hi = reg + _registerSize - 1; lo < hi; lo++, hi--){
+                    uint8_t byte{payload[lo]};
+                    payload[lo] = payload[hi];
+                    payload[hi] = byte;
+                }
+            }
+        }
+        _state = ParserState::complete;
+    }
+}
+
+bool FrameParser::_isRead() const{
+    return !_isRequest && (functionCode() == 3 || functionCode() == 4 || functionCode() == FC_READ_WRITE_REGISTERS);
+}
+
+uint16_t FrameParser::address() const{
+    if (!_isRequest && (functionCode() <= 4 || functionCode() == FC_READ_WRITE_REGISTERS)){
+        // read responses do not repeat the address
+        return 0;
+    }
+    return _word(2);
+}
+
+uint16_t FrameParser::quantity() const{
+    switch (functionCode()){
+        case 5: case 6: case FC_MASK_WRITE_REGISTER:
+            return 1;
+        case 15: case 16:
+            return _word(4);
+        default:
+            return _isRequest ? _word(4) : byteCount() / 2;
+    }
+}
+
+uint16_t FrameParser::writeAddress() const{
+    return functionCode() == FC_READ_WRITE_REGISTERS && _isRequest ? _word(6) : address();
+}
+
+uint16_t FrameParser::writeQuantity() const{
+    return functionCode() == FC_READ_WRITE_REGISTERS && _isRequest ? _word(8) : quantity();
+}
+
+uint8_t FrameParser::byteCount() const{
+    switch (functionCode()){
+        case 5: case 6:
+            return 2;
+        case FC_MASK_WRITE_REGISTER:
+            return 4;
+        case 15: case 16:
+            return _isRequest ? _frame[6] : 2;
+        case FC_READ_WRITE_REGISTERS:
+            return _isRequest ? _frame[10] : _frame[2];
+        default:
+            return _isRequest ? 0 : _frame[2];
+    }
+}
+
+uint8_t* FrameParser::data(){
+    switch (functionCode()){
+        case 15: case 16:
+            return _frame + (_isRequest ? 7 : 4);
+        case FC_READ_WRITE_REGISTERS:
+            return _frame + (_isRequest ? 11 : 3);
+        case 1: case 2: case 3: case 4:
+            return _frame + (_isRequest ? 4 : 3);
+        default:
+            return _frame + 4;
+    }
+}
+
+uint16_t FrameParser::dataToReceive() const{
+    if (isComplete() || isError()){
+        return 0;
+    }
+    if (_expected){
+        return _expected - _len;
+    }
+    if (_len < 2){
+        // shortest frame: fc 01 - 06 request, exception response
+        return (_isRequest ? 8 : 5) - _len;
+    }
+    // up to the byte count
+    return _byteCountAt() + 1 - _len;
+}
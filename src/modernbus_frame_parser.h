@@ -0,0 +1,167 @@
+#if !defined(MODERNBUS_FRAME_PARSER_H)
+#define MODERNBUS_FRAME_PARSER_H
+
+#include <Arduino.h>
+#include <mbparser.h>
+
+#include "modernbus_frame.h"
+
+#define FC_MASK_WRITE_REGISTER 22
+#define FC_READ_WRITE_REGISTERS 23
+
+// bytes client and server take from the provider at once
+#ifndef MODERNBUS_READ_CHUNK
+#define MODERNBUS_READ_CHUNK 64
+#endif
+
+
+/*
+Parses RTU request or response frames of fc 01 - 06, 15, 16, 22, 23
+and exception responses. Used by client and server.
+
+Takes spans of bytes: header fields and payload are copied into the frame
+buffer in bulk and the crc is checked in one pass once the frame is complete.
+Nothing is allocated, payload pointers point into the frame buffer
+and stay valid until the next frame starts. The frame buffer is
+the parser's own or one handed in by setFrameBuffer.
+
+With MODERNBUS_EXTERNAL_FRAME_BUFFER the parser has no buffer of its own
+and is MODBUS_MAX_FRAME_SIZE bytes smaller. setFrameBuffer is then required
+before the first parse. Worth it if several parsers share one buffer or
+the buffer has to sit in a specific memory region anyway.
+
+Request fields:
+    fc 01 - 04: address, quantity
+    fc 05, 06: address, data (value)
+    fc 15, 16: address, quantity, byteCount, data
+    fc 22: address, data (and mask, or mask)
+    fc 23: address and quantity to read, writeAddress, writeQuantity, byteCount, data
+Response fields:
+    fc 01 - 04, 23: byteCount, data
+    fc 05, 06: address, data (value)
+    fc 15, 16: address, quantity
+    fc 22: address, data (and mask, or mask)
+*/
+class FrameParser{
+    public:
+        FrameParser(bool isRequest)
+        :   _isRequest{isRequest}
+        {};
+
+        FrameParser(const FrameParser&) = delete;
+
+        /*
+        Consumes bytes of the current frame. Bytes before the slave address
+        are skipped. Returns the number of bytes consumed, which is less
+        than len only if the frame completed or failed before its end.
+        A complete or failed frame is dropped with the first byte of the next.
+        */
+        size_t parse(const uint8_t *data, size_t len);
+
+        /*
+        Feeds one byte. Returns true once the frame is complete or failed.
+        */
+        bool parse(uint8_t token){
+            parse(&token, 1);
+            return isComplete() || isError();
+        };
+
+        void reset();
+
+        /*
+        Parses into buffer of MODBUS_MAX_FRAME_SIZE bytes, owned by the caller.
+        nullptr returns to the parser's own buffer, if it has one. Drops the current frame.
+        */
+        void setFrameBuffer(uint8_t *buffer){
+#ifdef MODERNBUS_EXTERNAL_FRAME_BUFFER
+            _frame = buffer;
+#else
+            _frame = buffer ? buffer : _buffer;
+#endif
+            reset();
+        };
+
+        /*
+        Only frames to slaveAddress are parsed. 0 parses all.
+        */
+        void setSlaveAddress(uint8_t slaveAddress){_slaveFilter = slaveAddress;};
+
+        /*
+        Reverses the bytes of each register of a read response,
+        e.g. for little endian floats with registerSize 4.
+        */
+        void setSwap(bool swap){_swap = swap;};
+        void setRegisterSize(uint16_t registerSize){_registerSize = registerSize;};
+
+        /*
+        Frames with a larger byte count fail with illegalDataValue. 0 accepts all.
+        */
+        void setByteCountLimit(size_t limit){_byteCountLimit = limit;};
+        size_t byteCountLimit() const {return _byteCountLimit;};
+
+        ParserState state() const {return _state;};
+        bool isComplete() const {return _state == ParserState::complete;};
+        bool isError() const {return _state == ParserState::error;};
+
+        /*
+        True if no frame is in progress.
+        */
+        bool isIdle() const {return !_len || isComplete() || isError();};
+
+        /*
+        CRCError, the exception code of an exception response,
+        illegalFunction on an unknown function code
+        or illegalDataValue if the frame does not fit.
+        */
+        ErrorCode errorCode() const {return _error;};
+
+        uint8_t slaveAddress() const {return _frame[0];};
+        uint8_t functionCode() const {return _frame[1];};
+        uint16_t address() const;
+        uint16_t quantity() const;
+        uint16_t writeAddress() const;
+        uint16_t writeQuantity() const;
+        uint8_t byteCount() const;
+        uint8_t* data();
+
+        /*
+        Raw frame including crc.
+        */
+        const uint8_t* frame() const {return _frame;};
+        uint16_t frameLength() const {return _len;};
+
+        /*
+        Bytes missing to complete the frame, as far as known.
+        Reading no more than that never takes bytes of the next frame.
+        */
+        uint16_t dataToReceive() const;
+
+    private:
+#ifdef MODERNBUS_EXTERNAL_FRAME_BUFFER
+        uint8_t *_frame{nullptr};
+#else
+        uint8_t _buffer[MODBUS_MAX_FRAME_SIZE];
+        uint8_t *_frame{_buffer};
+#endif
+        uint16_t _len{0};
+        uint16_t _expected{0};
+        bool _isRequest;
+        uint8_t _slaveFilter{0};
+        bool _swap{false};
+        uint16_t _registerSize{2};
+        size_t _byteCountLimit{0};
+        ParserState _state{ParserState::slaveAddress};
+        ErrorCode _error{ErrorCode::noError};
+
+        uint16_t _word(uint16_t idx) const {
+            return (_frame[idx] << 8) | _frame[idx + 1];
+        };
+
+        bool _isRead() const;
+        uint16_t _byteCountAt() const;
+        void _expectFrame();
+        void _fail(ErrorCode error);
+        void _finish();
+};
+
+#endif // MODERNBUS_FRAME_PARSER_H
@@ -0,0 +1,298 @@
+#if !defined(MODERNBUS_FUTURE_H)
+#define MODERNBUS_FUTURE_H
+
+/*
+Future based single requests of the client. Meant for host side tools
+which fire many one shot requests and collect the results:
+
+    ModbusFuture futures[100];
+    for (uint8_t slave = 1; slave <= 100; slave++){
+        len = buildWriteSingleFrame(frame, slave, 0x06, 0x0010, setpoint);
+        futures[slave - 1] = client.submit(frame, len);
+    }
+    whenAll(scheduler, futures, 100, 5000);
+
+Each future shares one state with the client. Completion, cancellation
+and the reference count are packed into a single atomic word, so results
+are handed over without any lock.
+*/
+
+#if defined(__has_include)
+#if __has_include(<atomic>)
+    #define MODERNBUS_FUTURES 1
+#endif
+#endif
+
+#ifdef MODERNBUS_FUTURES
+
+#include <Arduino.h>
+#include <atomic>
+#include <new>
+#include <string.h>
+#if __has_include(<thread>)
+    #include <chrono>
+    #include <thread>
+#endif
+
+#include "modernbus_request.h"
+#include "modernbus_frame.h"
+#include "modernbus_payload.h"
+
+
+/*
+Shared state of one submitted request.
+Owns request, frame and a copy of the response payload.
+
+State word:
+    bits 0 - 7   status (pending, done, failed, cancelled)
+    bits 8 - 15  error code
+    bits 16 - 31 references
+*/
+class FutureState{
+    public:
+        enum Status : uint8_t {pending = 0, done = 1, failed = 2, cancelled = 3};
+
+        FutureState(const FutureState&) = delete;
+
+        /*
+        Creates a state referenced by the client and by the future.
+        Returns nullptr if the frame is too large or out of memory.
+        */
+        static FutureState* create(const uint8_t* frame, uint16_t frameSize, uint32_t timeout){
+            if (frameSize < 4 || frameSize > MODBUS_MAX_FRAME_SIZE){
+                return nullptr;
+            }
+            FutureState *state{new (std::nothrow) FutureState{}};
+            if (state){
+                memcpy(state->_frame, frame, frameSize);
+                state->_request = new (state->_requestStorage) ModbusRequest{state->_frame, frameSize, false, 0, _onResponse, state->_frame};
+                state->_request->setExtension(state);
+                state->_request->setOnError(_onFailure);
+                state->_request->setTimeout(timeout);
+            }
+            return state;
+        };
+
+        ModbusRequest* request(){return _request;};
+
+        uint8_t status() const {return _word.load(std::memory_order_acquire) & 0xFF;};
+        ErrorCode error() const {return static_cast<ErrorCode>((_word.load(std::memory_order_acquire) >> 8) & 0xFF);};
+
+        void retain(){
+            _word.fetch_add(_oneRef, std::memory_order_relaxed);
+        };
+
+        void release(){
+            if ((_word.fetch_sub(_oneRef, std::memory_order_acq_rel) >> 16) == 1){
+                delete this;
+            }
+        };
+
+        /*
+        Moves a pending state into its final status and drops the reference of the client.
+        Only the first transition wins.
+        */
+        bool complete(Status status, ErrorCode error){
+            bool won{_transition(status, error)};
+            release();
+            return won;
+        };
+
+        /*
+        Cancels the request if not completed yet.
+        A queued request is skipped by the client.
+        */
+        bool cancel(){
+            if (!_transition(cancelled, ErrorCode::noError)){
+                return false;
+            }
+            _request->cancel();
+            return true;
+        };
+
+        uint8_t slaveAddress() const {return _slaveAddress;};
+        uint8_t functionCode() const {return _functionCode;};
+        uint16_t address() const {return _address;};
+        uint16_t byteCount() const {return _byteCount;};
+        const uint8_t* payload() const {return _payload;};
+
+    private:
+        static constexpr uint32_t _oneRef{1UL << 16};
+
+        // client and future
+        std::atomic<uint32_t> _word{2 * _oneRef};
+        ModbusRequest *_request{nullptr};
+        alignas(ModbusRequest) uint8_t _requestStorage[sizeof(ModbusRequest)];
+        uint8_t _frame[MODBUS_MAX_FRAME_SIZE];
+
+        uint8_t _slaveAddress{0};
+        uint8_t _functionCode{0};
+        uint16_t _address{0};
+        uint16_t _byteCount{0};
+        uint8_t _payload[MODBUS_MAX_FRAME_SIZE];
+
+        FutureState() = default;
+
+        ~FutureState(){
+            if (_request){
+                _request->~ModbusRequest();
+            }
+        };
+
+        bool _transition(Status status, ErrorCode error){
+            uint32_t word{_word.load(std::memory_order_relaxed)};
+            uint32_t next;
+            do {
+                if ((word & 0xFF) != pending){
+                    return false;
+                }
+                next = (word & 0xFFFF0000UL) | (static_cast<uint32_t>(error) << 8) | status;
+            } while (!_word.compare_exchange_weak(word, next, std::memory_order_release, std::memory_order_relaxed));
+            return true;
+        };
+
+        static void _onResponse(ServerResponse *response){
+            FutureState *state{static_cast<FutureState*>(response->request()->getExtension())};
+            // payload is written before the status is released
+            if (state->status() == pending){
+                state->_slaveAddress = response->slaveAddress();
+                state->_functionCode = response->functionCode();
+                state->_address = response->address();
+                state->_byteCount = response->byteCount() < MODBUS_MAX_FRAME_SIZE ? response->byteCount() : MODBUS_MAX_FRAME_SIZE;
+                memcpy(state->_payload, response->payload(), state->_byteCount);
+            }
+            state->complete(done, ErrorCode::noError);
+        };
+
+        static void _onFailure(ServerResponse *response, ErrorCode errorCode){
+            FutureState *state{static_cast<FutureState*>(response->request()->getExtension())};
+            state->complete(failed, errorCode);
+        };
+};
+
+
+/*
+Result of ModbusClient::submit. Copyable handle to the shared state.
+Payload accessors are only valid once isReady() and ok() are true.
+*/
+class ModbusFuture{
+    public:
+        ModbusFuture() = default;
+
+        explicit ModbusFuture(FutureState *state)
+        :   _state{state}
+        {};
+
+        ModbusFuture(const ModbusFuture &other)
+        :   _state{other._state}
+        {
+            if (_state){
+                _state->retain();
+            }
+        };
+
+        ModbusFuture& operator=(const ModbusFuture &other){
+            if (other._state){
+                other._state->retain();
+            }
+            if (_state){
+                _state->release();
+            }
+            _state = other._state;
+            return *this;
+        };
+
+        ~ModbusFuture(){
+            if (_state){
+                _state->release();
+            }
+        };
+
+        /*
+        True once the request completed, failed or was cancelled.
+        An empty future (submit failed) is always ready and not ok.
+        */
+        bool isReady() const {return !_state || _state->status() != FutureState::pending;};
+        bool ok() const {return _state && _state->status() == FutureState::done;};
+        bool isCancelled() const {return _state && _state->status() == FutureState::cancelled;};
+
+        /*
+        Error of a failed request. Timeouts are reported as slaveDeviceFailure.
+        */
+        ErrorCode error() const {return _state ? _state->error() : ErrorCode::slaveDeviceFailure;};
+
+        /*
+        Runs the scheduler until the future is ready or timeout ms passed.
+        Returns isReady().
+        */
+        template <typename TScheduler>
+        bool wait(TScheduler &scheduler, uint32_t timeout){
+            uint32_t start = millis();
+            while (!isReady() && millis() - start < timeout){
+                scheduler.execute();
+            }
+            return isReady();
+        };
+
+        #if defined(__has_include)
+        #if __has_include(<thread>)
+            /*
+            Blocks until the future is ready or timeout ms passed.
+            For threads other than the one running the client, see modernbus_threaded_client.h
+            */
+            bool wait(uint32_t timeout){
+                uint32_t start = millis();
+                while (!isReady() && millis() - start < timeout){
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                return isReady();
+            };
+        #endif
+        #endif
+
+        /*
+        Cancels the request. A request still queued is not sent.
+        Returns false if the request already completed.
+        */
+        bool cancel(){
+            return _state && _state->cancel();
+        };
+
+        uint8_t slaveAddress() const {return _state->slaveAddress();};
+        uint8_t functionCode() const {return _state->functionCode();};
+        uint16_t address() const {return _state->address();};
+        uint16_t byteCount() const {return _state->byteCount();};
+        const uint8_t* payload() const {return _state->payload();};
+
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        PayloadView<V, O> as() const {return PayloadView<V, O>{_state->payload(), _state->byteCount()};};
+
+    private:
+        FutureState *_state{nullptr};
+};
+
+
+/*
+Runs the scheduler until all count futures are ready or timeout ms passed.
+Single requests complete in order of submission, so each future is checked
+about once. Returns true if all futures are ready.
+*/
+template <typename TScheduler>
+bool whenAll(TScheduler &scheduler, const ModbusFuture* futures, uint16_t count, uint32_t timeout){
+    uint32_t start = millis();
+    uint16_t ready{0};
+    while (true){
+        while (ready < count && futures[ready].isReady()){
+            ready++;
+        }
+        if (ready == count || millis() - start >= timeout){
+            break;
+        }
+        scheduler.execute();
+    }
+    return ready == count;
+}
+
+#endif // MODERNBUS_FUTURES
+
+#endif // MODERNBUS_FUTURE_H
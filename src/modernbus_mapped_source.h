@@ -0,0 +1,103 @@
+#if !defined(MODERNBUS_MAPPED_SOURCE_H)
+#define MODERNBUS_MAPPED_SOURCE_H
+
+#include <Arduino.h>
+#include <string.h>
+#include <atomic>
+
+#include "modernbus_server.h"
+#include "modernbus_seqlock.h"
+
+/*
+Server side mapping updated by the application while the server is serving it.
+
+The application publishes into the live buffer under a sequence lock.
+On each request the server copies a consistent snapshot and streams the
+snapshot, so a float spanning two registers is never sent half updated.
+The writer never waits for the server and the server never takes a mutex.
+
+    MappedSource<80> measurements{};
+    server.responseTo(04, 0x0000).with(measurements);
+
+    // application thread or interrupt
+    measurements.set<float>(2, temperature);
+
+One writer only. Several values updated together:
+
+    uint8_t *live = measurements.beginUpdate();
+    ...
+    measurements.endUpdate();
+*/
+template <uint8_t Size>
+class MappedSource: public MappingSource{
+    public:
+        MappedSource() = default;
+        MappedSource(const MappedSource&) = delete;
+
+        /*
+        Copies len bytes of data to offset. Returns false if it does not fit.
+        */
+        bool publish(const uint8_t* data, uint8_t len, uint8_t offset = 0){
+            if (static_cast<uint16_t>(offset) + len > Size){
+                return false;
+            }
+            _lock.writeBegin();
+            memcpy(_live + offset, data, len);
+            _lock.writeEnd();
+            return true;
+        };
+
+        /*
+        Encodes value into the registers starting at address (2 bytes per register).
+        */
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        bool set(uint8_t address, V value){
+            if (2 * static_cast<uint16_t>(address) + sizeof(V) > Size){
+                return false;
+            }
+            _lock.writeBegin();
+            PayloadCodec<V, O>::encode(value, _live + 2 * address);
+            _lock.writeEnd();
+            return true;
+        };
+
+        /*
+        Returns the live buffer to update several values at once.
+        The server waits for endUpdate() before taking its next snapshot,
+        so keep the update short.
+        */
+        uint8_t* beginUpdate(){
+            _lock.writeBegin();
+            return _live;
+        };
+
+        void endUpdate(){
+            _lock.writeEnd();
+        };
+
+        /*
+        Number of completed updates.
+        */
+        uint32_t updates() const {return _lock.writes();};
+
+        /*
+        Server side. Copies the live buffer and returns the copy.
+        */
+        const uint8_t* snapshot() override {
+            uint32_t sequence;
+            do {
+                sequence = _lock.readBegin();
+                memcpy(_snapshot, _live, Size);
+            } while (_lock.readRetry(sequence));
+            return _snapshot;
+        };
+
+        uint8_t size() const override {return Size;};
+
+    private:
+        uint8_t _live[Size]{};
+        uint8_t _snapshot[Size]{};
+        SeqLock _lock{};
+};
+
+#endif // MODERNBUS_MAPPED_SOURCE_H
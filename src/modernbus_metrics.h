@@ -0,0 +1,344 @@
+#if !defined(MODERNBUS_METRICS_H)
+#define MODERNBUS_METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// log2 buckets of a latency histogram: 0 us, < 2 us, < 4 us ... and one overflow bucket
+#define LATENCY_BUCKETS 24
+
+// slaves a client keeps round trip histograms of. Further slaves count in the total only.
+#ifndef MODERNBUS_METRICS_SLAVES
+#define MODERNBUS_METRICS_SLAVES 8
+#endif
+
+// bus occupancy is summed in BUS_WINDOW_SLOTS slots of MODERNBUS_METRICS_SLOT_MS each
+#ifndef MODERNBUS_METRICS_SLOT_MS
+#define MODERNBUS_METRICS_SLOT_MS 250
+#endif
+#define BUS_WINDOW_SLOTS 8
+
+
+/*
+Copy of a latency histogram. Bucket 0 counts 0 us,
+bucket i counts [2^(i-1), 2^i) us, the last bucket everything above.
+*/
+struct LatencySnapshot{
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+
+    uint32_t mean() const {
+        return count ? sum / count : 0;
+    }
+
+    /*
+    Upper bound in us of the bucket holding the p-th percentile (0 - 100).
+    */
+    uint32_t percentile(uint8_t p) const {
+        uint64_t rank = (static_cast<uint64_t>(count) * p + 99) / 100;
+        uint64_t seen{0};
+        for (uint8_t idx = 0; idx < LATENCY_BUCKETS; idx++){
+            seen += buckets[idx];
+            if (seen >= rank && seen > 0){
+                return idx == LATENCY_BUCKETS - 1 ? max : (1UL << idx) - 1;
+            }
+        }
+        return 0;
+    }
+};
+
+
+/*
+Fixed bucket log scale histogram. record() is wait free.
+*/
+class LatencyHistogram{
+    public:
+        void record(uint32_t us){
+            uint8_t idx{0};
+            while (us >> idx && idx < LATENCY_BUCKETS - 1){
+                idx++;
+            }
+            _buckets[idx].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(us, std::memory_order_relaxed);
+            uint32_t max{_max.load(std::memory_order_relaxed)};
+            while (us > max && !_max.compare_exchange_weak(max, us, std::memory_order_relaxed));
+        };
+
+        void snapshot(LatencySnapshot &snapshot) const {
+            for (uint8_t idx = 0; idx < LATENCY_BUCKETS; idx++){
+                snapshot.buckets[idx] = _buckets[idx].load(std::memory_order_relaxed);
+            }
+            snapshot.count = _count.load(std::memory_order_relaxed);
+            snapshot.max = _max.load(std::memory_order_relaxed);
+            snapshot.sum = _sum.load(std::memory_order_relaxed);
+        };
+
+        void reset(){
+            for (std::atomic<uint32_t> &bucket: _buckets){
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            _count.store(0, std::memory_order_relaxed);
+            _max.store(0, std::memory_order_relaxed);
+            _sum.store(0, std::memory_order_relaxed);
+        };
+
+    private:
+        std::atomic<uint32_t> _buckets[LATENCY_BUCKETS]{};
+        std::atomic<uint32_t> _count{0};
+        std::atomic<uint32_t> _max{0};
+        std::atomic<uint64_t> _sum{0};
+};
+
+
+struct ServerMetricsSnapshot{
+    // requests by function code 0 - 127
+    uint32_t requests[128];
+    // exceptions sent by exception code. Codes above 31 are counted in 31.
+    uint32_t exceptions[32];
+    uint32_t parserErrors;
+    // first request byte taken from the provider until the frame is complete
+    LatencySnapshot parse;
+    // handler, mapping or bank serving the request
+    LatencySnapshot handler;
+    // last request byte until the first response byte
+    LatencySnapshot turnaround;
+};
+
+
+/*
+Metrics of a server. Kept in preallocated storage, updated with relaxed atomics
+by the server task and read by any thread through snapshot().
+*/
+class ServerMetrics{
+    public:
+        void request(uint8_t functionCode){
+            _requests[functionCode & 0x7F].fetch_add(1, std::memory_order_relaxed);
+        };
+
+        void exception(uint8_t exceptionCode){
+            _exceptions[exceptionCode > 31 ? 31 : exceptionCode].fetch_add(1, std::memory_order_relaxed);
+        };
+
+        void parserError(){
+            _parserErrors.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        LatencyHistogram& parse(){return _parse;};
+        LatencyHistogram& handler(){return _handler;};
+        LatencyHistogram& turnaround(){return _turnaround;};
+
+        /*
+        Copies all counters. Counters are read one by one,
+        so a snapshot taken while serving may be off by the requests in flight.
+        */
+        void snapshot(ServerMetricsSnapshot &snapshot) const {
+            for (uint8_t idx = 0; idx < 128; idx++){
+                snapshot.requests[idx] = _requests[idx].load(std::memory_order_relaxed);
+            }
+            for (uint8_t idx = 0; idx < 32; idx++){
+                snapshot.exceptions[idx] = _exceptions[idx].load(std::memory_order_relaxed);
+            }
+            snapshot.parserErrors = _parserErrors.load(std::memory_order_relaxed);
+            _parse.snapshot(snapshot.parse);
+            _handler.snapshot(snapshot.handler);
+            _turnaround.snapshot(snapshot.turnaround);
+        };
+
+        void reset(){
+            for (std::atomic<uint32_t> &count: _requests){
+                count.store(0, std::memory_order_relaxed);
+            }
+            for (std::atomic<uint32_t> &count: _exceptions){
+                count.store(0, std::memory_order_relaxed);
+            }
+            _parserErrors.store(0, std::memory_order_relaxed);
+            _parse.reset();
+            _handler.reset();
+            _turnaround.reset();
+        };
+
+    private:
+        std::atomic<uint32_t> _requests[128]{};
+        std::atomic<uint32_t> _exceptions[32]{};
+        std::atomic<uint32_t> _parserErrors{0};
+        LatencyHistogram _parse{};
+        LatencyHistogram _handler{};
+        LatencyHistogram _turnaround{};
+};
+
+
+/*
+Round trip histogram of one slave.
+*/
+struct SlaveLatencySnapshot{
+    uint8_t slaveAddress;
+    LatencySnapshot roundTrip;
+};
+
+struct ClientMetricsSnapshot{
+    // transmission start until the response is complete, all slaves
+    LatencySnapshot roundTrip;
+    // per slave in order of first response. Valid up to slaveCount.
+    SlaveLatencySnapshot slaves[MODERNBUS_METRICS_SLAVES];
+    uint8_t slaveCount;
+    // round trips of slaves beyond MODERNBUS_METRICS_SLAVES
+    uint32_t untrackedRoundTrips;
+    // deviation of the poll period of a request from its every() target
+    LatencySnapshot pollJitter;
+    // bus held by transmission or reception within the last window
+    uint32_t busyTime;
+    uint32_t windowTime;
+
+    /*
+    Share of the window the bus was busy in permille.
+    */
+    uint16_t occupancy() const {
+        return windowTime ? static_cast<uint64_t>(busyTime) * 1000 / windowTime : 0;
+    }
+};
+
+
+/*
+Bus occupancy over a rolling window of BUS_WINDOW_SLOTS slots.
+Written by one task, read by any thread.
+*/
+class BusOccupancy{
+    public:
+        /*
+        Adds us of busy bus to the slot of now.
+        */
+        void busy(uint32_t now, uint32_t us){
+            if (!_started){
+                _started = true;
+                _start.store(now - us, std::memory_order_relaxed);
+            }
+            uint32_t epoch{now / _slotLength};
+            uint32_t current{_epoch.load(std::memory_order_relaxed)};
+            if (epoch != current){
+                // clear slots passed since the last call
+                uint32_t passed{epoch - current};
+                for (uint32_t idx = 1; idx <= passed && idx <= BUS_WINDOW_SLOTS; idx++){
+                    _slots[(current + idx) % BUS_WINDOW_SLOTS].store(0, std::memory_order_relaxed);
+                }
+                _epoch.store(epoch, std::memory_order_relaxed);
+            }
+            _slots[epoch % BUS_WINDOW_SLOTS].fetch_add(us, std::memory_order_relaxed);
+        };
+
+        void snapshot(uint32_t now, uint32_t &busyTime, uint32_t &windowTime) const {
+            busyTime = 0;
+            windowTime = 0;
+            if (!_started){
+                return;
+            }
+            uint32_t epoch{now / _slotLength};
+            uint32_t last{_epoch.load(std::memory_order_relaxed)};
+            for (uint32_t age = epoch - last; age < BUS_WINDOW_SLOTS; age++){
+                busyTime += _slots[(epoch - age) % BUS_WINDOW_SLOTS].load(std::memory_order_relaxed);
+            }
+            windowTime = (BUS_WINDOW_SLOTS - 1) * _slotLength + now % _slotLength;
+            uint32_t sinceStart{now - _start.load(std::memory_order_relaxed)};
+            if (sinceStart < windowTime){
+                windowTime = sinceStart;
+            }
+        };
+
+        void reset(){
+            for (std::atomic<uint32_t> &slot: _slots){
+                slot.store(0, std::memory_order_relaxed);
+            }
+            _started = false;
+        };
+
+    private:
+        const uint32_t _slotLength{MODERNBUS_METRICS_SLOT_MS * 1000UL};
+        std::atomic<uint32_t> _slots[BUS_WINDOW_SLOTS]{};
+        std::atomic<uint32_t> _epoch{0};
+        std::atomic<uint32_t> _start{0};
+        std::atomic<bool> _started{false};
+};
+
+
+/*
+Timing of a client: round trips in total and per slave, poll jitter and bus occupancy.
+Kept in preallocated storage, updated with relaxed atomics by the client task
+and read by any thread through snapshot(). Snapshot costs are fixed.
+*/
+class ClientMetrics{
+    public:
+        void roundTrip(uint8_t slaveAddress, uint32_t us){
+            _roundTrip.record(us);
+            LatencyHistogram *slave{_slave(slaveAddress)};
+            if (slave){
+                slave->record(us);
+            } else {
+                _untracked.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        LatencyHistogram& pollJitter(){return _pollJitter;};
+        BusOccupancy& bus(){return _bus;};
+
+        /*
+        Copies all metrics. Counters are read one by one,
+        so a snapshot taken during a transaction may be off by that transaction.
+        */
+        void snapshot(ClientMetricsSnapshot &snapshot) const {
+            _roundTrip.snapshot(snapshot.roundTrip);
+            snapshot.slaveCount = _slaveCount.load(std::memory_order_acquire);
+            for (uint8_t idx = 0; idx < snapshot.slaveCount; idx++){
+                snapshot.slaves[idx].slaveAddress = _slaveAddresses[idx];
+                _slaves[idx].snapshot(snapshot.slaves[idx].roundTrip);
+            }
+            snapshot.untrackedRoundTrips = _untracked.load(std::memory_order_relaxed);
+            _pollJitter.snapshot(snapshot.pollJitter);
+            _bus.snapshot(micros(), snapshot.busyTime, snapshot.windowTime);
+        };
+
+        /*
+        Clears all histograms. Slaves keep their slots.
+        */
+        void reset(){
+            _roundTrip.reset();
+            for (LatencyHistogram &slave: _slaves){
+                slave.reset();
+            }
+            _untracked.store(0, std::memory_order_relaxed);
+            _pollJitter.reset();
+            _bus.reset();
+        };
+
+    private:
+        LatencyHistogram _roundTrip{};
+        LatencyHistogram _slaves[MODERNBUS_METRICS_SLAVES]{};
+        uint8_t _slaveAddresses[MODERNBUS_METRICS_SLAVES]{};
+        std::atomic<uint8_t> _slaveCount{0};
+        std::atomic<uint32_t> _untracked{0};
+        LatencyHistogram _pollJitter{};
+        BusOccupancy _bus{};
+
+        /*
+        Histogram of slaveAddress. Takes a free slot for a new slave.
+        nullptr if all slots are taken.
+        */
+        LatencyHistogram* _slave(uint8_t slaveAddress){
+            uint8_t count{_slaveCount.load(std::memory_order_relaxed)};
+            for (uint8_t idx = 0; idx < count; idx++){
+                if (_slaveAddresses[idx] == slaveAddress){
+                    return &_slaves[idx];
+                }
+            }
+            if (count == MODERNBUS_METRICS_SLAVES){
+                return nullptr;
+            }
+            _slaveAddresses[count] = slaveAddress;
+            // publishes the address to snapshot()
+            _slaveCount.store(count + 1, std::memory_order_release);
+            return &_slaves[count];
+        };
+};
+
+#endif // MODERNBUS_METRICS_H
@@ -0,0 +1,82 @@
+#if !defined(MODERNBUS_MPSC_H)
+#define MODERNBUS_MPSC_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+Bounded lock free queue for many producers and one consumer.
+Each cell carries a sequence number, so producers only race for the
+tail index and never wait for each other (Vyukov).
+N must be a power of two.
+*/
+template <typename TItem, uint16_t N>
+class MpscQueue{
+    static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of two");
+
+    public:
+        MpscQueue(){
+            for (uint32_t idx = 0; idx < N; idx++){
+                _cells[idx].sequence.store(idx, std::memory_order_relaxed);
+            }
+        };
+
+        MpscQueue(const MpscQueue&) = delete;
+
+        /*
+        Any thread. Returns false if the queue is full.
+        */
+        bool push(const TItem &item){
+            uint32_t position{_tail.load(std::memory_order_relaxed)};
+            Cell *cell;
+            while (true){
+                cell = &_cells[position & _mask];
+                uint32_t sequence{cell->sequence.load(std::memory_order_acquire)};
+                int32_t diff = static_cast<int32_t>(sequence - position);
+                if (diff == 0){
+                    if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if (diff < 0){
+                    return false;
+                } else {
+                    position = _tail.load(std::memory_order_relaxed);
+                }
+            }
+            cell->item = item;
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        };
+
+        /*
+        Consumer thread only. Returns false if the queue is empty.
+        */
+        bool pop(TItem &item){
+            Cell &cell{_cells[_head & _mask]};
+            uint32_t sequence{cell.sequence.load(std::memory_order_acquire)};
+            if (static_cast<int32_t>(sequence - (_head + 1)) < 0){
+                return false;
+            }
+            item = cell.item;
+            cell.sequence.store(_head + N, std::memory_order_release);
+            _head++;
+            return true;
+        };
+
+        uint16_t capacity() const {return N;};
+
+    private:
+        static constexpr uint32_t _mask{N - 1};
+
+        struct Cell{
+            std::atomic<uint32_t> sequence;
+            TItem item;
+        };
+
+        Cell _cells[N];
+        // producers and consumer on their own cache lines
+        alignas(64) std::atomic<uint32_t> _tail{0};
+        alignas(64) uint32_t _head{0};
+};
+
+#endif // MODERNBUS_MPSC_H
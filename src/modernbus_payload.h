@@ -0,0 +1,178 @@
+#if !defined(MODERNBUS_PAYLOAD_H)
+#define MODERNBUS_PAYLOAD_H
+
+#include <Arduino.h>
+#include <string.h>
+
+/*
+Order of the bytes of a multi register value on the wire.
+Letters name the bytes of the value from most to least significant.
+*/
+enum class WordOrder : uint8_t {
+    ABCD,   // big endian, modbus default
+    CDAB,   // registers swapped
+    BADC,   // bytes within the registers swapped
+    DCBA    // little endian
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define MODERNBUS_HOST_BIG_ENDIAN 1
+#else
+    #define MODERNBUS_HOST_BIG_ENDIAN 0
+#endif
+
+/*
+Index of the value byte logical (big endian) position j on the wire.
+*/
+constexpr uint8_t _logicalToWire(WordOrder order, uint8_t j, uint8_t n){
+    return  order == WordOrder::ABCD ? j :
+            order == WordOrder::DCBA ? n - 1 - j :
+            n < 2 ? j :
+            order == WordOrder::BADC ? j ^ 1 :
+            (n / 2 - 1 - j / 2) * 2 + j % 2;
+}
+
+/*
+Index of the wire byte which lands on host memory position k.
+*/
+constexpr uint8_t _hostToWire(WordOrder order, uint8_t k, uint8_t n){
+    return _logicalToWire(order, MODERNBUS_HOST_BIG_ENDIAN ? k : n - 1 - k, n);
+}
+
+/*
+Compile time unrolled byte permutation between host position K and wire position.
+*/
+template <WordOrder O, uint8_t N, uint8_t K = 0>
+struct _BytePermutation{
+    static void gather(const uint8_t* wire, uint8_t* host){
+        host[K] = wire[_hostToWire(O, K, N)];
+        _BytePermutation<O, N, K + 1>::gather(wire, host);
+    }
+
+    static void scatter(const uint8_t* host, uint8_t* wire){
+        wire[_hostToWire(O, K, N)] = host[K];
+        _BytePermutation<O, N, K + 1>::scatter(host, wire);
+    }
+};
+
+template <WordOrder O, uint8_t N>
+struct _BytePermutation<O, N, N>{
+    static void gather(const uint8_t*, uint8_t*){}
+    static void scatter(const uint8_t*, uint8_t*){}
+};
+
+/*
+Converts between wire and host representation of V.
+The byte permutation is fixed at compile time. So conversion is branch free
+and the compiler is free to unroll or vectorize bulk loops.
+*/
+template <typename V, WordOrder O = WordOrder::ABCD>
+struct PayloadCodec{
+    static V decode(const uint8_t* wire){
+        uint8_t host[sizeof(V)];
+        _BytePermutation<O, sizeof(V)>::gather(wire, host);
+        V value;
+        memcpy(&value, host, sizeof(V));
+        return value;
+    }
+
+    static void encode(V value, uint8_t* wire){
+        uint8_t host[sizeof(V)];
+        memcpy(host, &value, sizeof(V));
+        _BytePermutation<O, sizeof(V)>::scatter(host, wire);
+    }
+
+    static void decode(const uint8_t* wire, V* dst, uint16_t count){
+        for (uint16_t idx = 0; idx < count; idx++){
+            dst[idx] = decode(wire + idx * sizeof(V));
+        }
+    }
+
+    static void encode(const V* src, uint8_t* wire, uint16_t count){
+        for (uint16_t idx = 0; idx < count; idx++){
+            encode(src[idx], wire + idx * sizeof(V));
+        }
+    }
+};
+
+
+/*
+Read only typed view on a payload. Does not copy the payload.
+The view is valid as long as the payload is, i.e. within the response handler.
+*/
+template <typename V, WordOrder O = WordOrder::ABCD>
+class PayloadView{
+    public:
+        class Iterator{
+            public:
+                Iterator(const uint8_t* pos) : _pos{pos} {};
+                V operator*() const {return PayloadCodec<V, O>::decode(_pos);};
+                Iterator& operator++(){_pos += sizeof(V); return *this;};
+                bool operator!=(const Iterator& other) const {return _pos != other._pos;};
+            private:
+                const uint8_t* _pos;
+        };
+
+        PayloadView(const uint8_t* payload, uint16_t byteCount)
+        :   _payload{payload},
+            _size{static_cast<uint16_t>(payload ? byteCount / sizeof(V) : 0)}
+        {};
+
+        /*
+        Number of complete values in the payload.
+        */
+        uint16_t size() const {return _size;};
+
+        V operator[](uint16_t idx) const {
+            return PayloadCodec<V, O>::decode(_payload + idx * sizeof(V));
+        };
+
+        /*
+        Decodes up to max values into dst. Returns the number of values written.
+        */
+        uint16_t copyTo(V* dst, uint16_t max) const {
+            uint16_t count{_size < max ? _size : max};
+            PayloadCodec<V, O>::decode(_payload, dst, count);
+            return count;
+        };
+
+        Iterator begin() const {return Iterator{_payload};};
+        Iterator end() const {return Iterator{_payload + _size * sizeof(V)};};
+
+    private:
+        const uint8_t* _payload;
+        uint16_t _size;
+};
+
+
+/*
+Read only view on bit packed coils or discrete inputs.
+First coil is the least significant bit of the first byte.
+*/
+class BitView{
+    public:
+        BitView(const uint8_t* payload, uint16_t byteCount)
+        :   _payload{payload},
+            _size{static_cast<uint16_t>(payload ? byteCount * 8 : 0)}
+        {};
+
+        uint16_t size() const {return _size;};
+
+        bool operator[](uint16_t idx) const {
+            return (_payload[idx >> 3] >> (idx & 0x07)) & 0x01;
+        };
+
+        uint16_t copyTo(bool* dst, uint16_t max) const {
+            uint16_t count{_size < max ? _size : max};
+            for (uint16_t idx = 0; idx < count; idx++){
+                dst[idx] = (*this)[idx];
+            }
+            return count;
+        };
+
+    private:
+        const uint8_t* _payload;
+        uint16_t _size;
+};
+
+#endif // MODERNBUS_PAYLOAD_H
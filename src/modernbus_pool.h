@@ -0,0 +1,256 @@
+#if !defined(MODERNBUS_POOL_H)
+#define MODERNBUS_POOL_H
+
+#include <Arduino.h>
+#include <new>
+#include <string.h>
+#include <linkedlist.h>
+
+#include "modernbus_request.h"
+
+/*
+Size of the frame buffer reserved per pooled request.
+Frames larger than this can not be taken from the pool.
+Reads take 8 bytes, fc 15 and 16 take 9 plus the data bytes. The default
+fits multi writes of up to 11 registers or 184 coils.
+*/
+#ifndef MODERNBUS_POOL_FRAME_SIZE
+#define MODERNBUS_POOL_FRAME_SIZE 32
+#endif
+
+
+/*
+Fixed capacity storage pool.
+Hands out raw storage for up to N items of type TItem without touching the heap.
+Caller is responsible to construct and destruct the item in place.
+*/
+template <typename TItem, uint16_t N>
+class StaticPool{
+    public:
+        StaticPool(){
+            for (uint16_t idx = 0; idx < N; idx++){
+                _freeSlots[idx] = N - 1 - idx;
+            }
+        };
+
+        StaticPool(const StaticPool&) = delete;
+
+        /*
+        Returns storage for one item or nullptr if the pool is exhausted.
+        */
+        void* allocate(){
+            if (!_freeCount){
+                return nullptr;
+            }
+            return &_storage[_freeSlots[--_freeCount]];
+        };
+
+        /*
+        Returns storage to the pool.
+        Returns false if ptr was not taken from this pool.
+        */
+        bool release(void* ptr){
+            if (!owns(ptr)){
+                return false;
+            }
+            _freeSlots[_freeCount++] = static_cast<Slot*>(ptr) - _storage;
+            return true;
+        };
+
+        bool owns(const void* ptr) const {
+            const Slot* slot{static_cast<const Slot*>(ptr)};
+            return slot >= _storage && slot < _storage + N;
+        };
+
+        uint16_t available() const {return _freeCount;};
+        uint16_t capacity() const {return N;};
+
+    private:
+        struct alignas(TItem) Slot{
+            uint8_t bytes[sizeof(TItem)];
+        };
+        Slot _storage[N];
+        uint16_t _freeSlots[N];
+        uint16_t _freeCount{N};
+};
+
+
+/*
+Storage of one pooled request. The frame buffer lives next to the request,
+so neither request nor frame needs the heap.
+*/
+struct PooledRequestSlot{
+    alignas(ModbusRequest) uint8_t request[sizeof(ModbusRequest)];
+    uint8_t frame[MODERNBUS_POOL_FRAME_SIZE];
+};
+
+
+/*
+Creates the requests of ModbusClient::poll and ModbusClient::send(frame, ...).
+N == 0 uses the heap, else a static pool of N requests.
+*/
+template <uint16_t N>
+class RequestPool{
+    public:
+        ModbusRequest* create(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler){
+            if (requestSize > MODERNBUS_POOL_FRAME_SIZE){
+                return nullptr;
+            }
+            PooledRequestSlot* slot{static_cast<PooledRequestSlot*>(_pool.allocate())};
+            if (!slot){
+                return nullptr;
+            }
+            return new (slot->request) ModbusRequest{request, requestSize, swap, registerSize, handler, slot->frame};
+        };
+
+        /*
+        Destroys the request if owned by the pool.
+        Requests appended by the user are left untouched.
+        */
+        void destroy(ModbusRequest* request){
+            if (_pool.owns(request)){
+                request->~ModbusRequest();
+                _pool.release(request);
+            }
+        };
+
+        uint16_t available() const {return _pool.available();};
+
+    private:
+        StaticPool<PooledRequestSlot, N> _pool{};
+};
+
+template <>
+class RequestPool<0>{
+    public:
+        ModbusRequest* create(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler){
+            return new ModbusRequest{request, requestSize, swap, registerSize, handler};
+        };
+
+        void destroy(ModbusRequest* request){
+            delete request;
+        };
+
+        uint16_t available() const {return 0xFFFF;};
+};
+
+
+/*
+List of polled requests. Requests are visited round robin.
+N == 0 uses a linked list, else a fixed array of N entries.
+*/
+template <uint16_t N>
+class RequestList{
+    public:
+        bool append(ModbusRequest* request){
+            if (_size == N){
+                return false;
+            }
+            _items[_size++] = request;
+            return true;
+        };
+
+        ModbusRequest* remove(ModbusRequest* request){
+            for (uint16_t idx = 0; idx < _size; idx++){
+                if (_items[idx] == request){
+                    _size--;
+                    memmove(&_items[idx], &_items[idx + 1], (_size - idx) * sizeof(ModbusRequest*));
+                    // keep pointing at the same next request
+                    if (idx < _cursor){
+                        _cursor--;
+                    }
+                    if (_cursor >= _size){
+                        _cursor = 0;
+                    }
+                    return request;
+                }
+            }
+            return nullptr;
+        };
+
+        ModbusRequest* loopNext(){
+            ModbusRequest* request{_items[_cursor]};
+            _cursor = _cursor + 1 < _size ? _cursor + 1 : 0;
+            return request;
+        };
+
+        ModbusRequest* popLeft(){
+            return remove(_items[0]);
+        };
+
+        uint16_t size() const {return _size;};
+
+    private:
+        ModbusRequest* _items[N]{};
+        uint16_t _size{0};
+        uint16_t _cursor{0};
+};
+
+template <>
+class RequestList<0>{
+    public:
+        bool append(ModbusRequest* request){
+            _list.append(request);
+            return true;
+        };
+
+        ModbusRequest* remove(ModbusRequest* request){
+            int16_t idx = _list.index(request);
+            return _list.remove(idx);
+        };
+
+        ModbusRequest* loopNext(){return _list.iter.loopNext();};
+        ModbusRequest* popLeft(){return _list.popLeft();};
+        uint16_t size(){return _list.size();};
+
+    private:
+        TinyLinkedList<ModbusRequest*> _list{};
+};
+
+
+/*
+Queue of single requests.
+N == 0 uses a linked list, else a ring buffer of N entries.
+*/
+template <uint16_t N>
+class RequestQueue{
+    public:
+        bool append(ModbusRequest* request){
+            if (_size == N){
+                return false;
+            }
+            _items[(_head + _size++) % N] = request;
+            return true;
+        };
+
+        ModbusRequest* pop(){
+            ModbusRequest* request{_items[_head]};
+            _head = (_head + 1) % N;
+            _size--;
+            return request;
+        };
+
+        uint16_t size() const {return _size;};
+
+    private:
+        ModbusRequest* _items[N]{};
+        uint16_t _head{0};
+        uint16_t _size{0};
+};
+
+template <>
+class RequestQueue<0>{
+    public:
+        bool append(ModbusRequest* request){
+            _list.append(request);
+            return true;
+        };
+
+        ModbusRequest* pop(){return _list.pop();};
+        uint16_t size(){return _list.size();};
+
+    private:
+        TinyLinkedList<ModbusRequest*> _list{};
+};
+
+#endif // MODERNBUS_POOL_H
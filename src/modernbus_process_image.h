@@ -0,0 +1,114 @@
+#if !defined(MODERNBUS_PROCESS_IMAGE_H)
+#define MODERNBUS_PROCESS_IMAGE_H
+
+#include <Arduino.h>
+#include <string.h>
+#include <atomic>
+
+#include "modernbus_server_response.h"
+#include "modernbus_seqlock.h"
+
+/*
+One block of a process image. Holds the payload of one polled request.
+The client thread publishes each response into the block.
+Any other thread can read a consistent copy without locks or callbacks.
+*/
+class ImageBlock: public ResponseSink{
+    template <uint16_t, uint8_t> friend class ProcessImage;
+    public:
+        ImageBlock() = default;
+        ImageBlock(const ImageBlock&) = delete;
+
+        /*
+        Copies the block into dst. Returns the number of valid bytes copied.
+        If timestamp is given it receives the micros() of the acquisition.
+        Returns 0 as long as the block was never written.
+        */
+        uint16_t read(uint8_t* dst, uint16_t len, uint32_t* timestamp = nullptr) const {
+            uint16_t count;
+            uint32_t acquired;
+            uint32_t sequence;
+            do {
+                sequence = _lock.readBegin();
+                count = _byteCount.load(std::memory_order_relaxed);
+                acquired = _timestamp.load(std::memory_order_relaxed);
+                if (count > len){
+                    count = len;
+                }
+                memcpy(dst, _data, count);
+            } while (_lock.readRetry(sequence));
+            if (timestamp){
+                *timestamp = acquired;
+            }
+            return count;
+        };
+
+        /*
+        Number of updates since start. Changes whenever new data was published.
+        */
+        uint32_t updates() const {return _lock.writes();};
+
+        uint32_t timestamp() const {return _timestamp.load(std::memory_order_relaxed);};
+        uint16_t size() const {return _size;};
+
+        void publish(const uint8_t* payload, uint16_t len, uint32_t timestamp) override {
+            if (len > _size){
+                len = _size;
+            }
+            _lock.writeBegin();
+            memcpy(_data, payload, len);
+            _byteCount.store(len, std::memory_order_relaxed);
+            _timestamp.store(timestamp, std::memory_order_relaxed);
+            _lock.writeEnd();
+        };
+
+    private:
+        uint8_t* _data{nullptr};
+        uint16_t _size{0};
+        std::atomic<uint16_t> _byteCount{0};
+        std::atomic<uint32_t> _timestamp{0};
+        SeqLock _lock{};
+};
+
+
+/*
+Client side process image.
+A contiguous shadow memory of SizeBytes split into up to MaxBlocks blocks.
+Bind a block to a polled request and the client keeps it up to date:
+
+    ImageBlock *temperatures = image.block(40);
+    client.poll(request, sizeof(request), handler).publishTo(temperatures);
+*/
+template <uint16_t SizeBytes, uint8_t MaxBlocks>
+class ProcessImage{
+    public:
+        /*
+        Reserves the next size bytes of the image.
+        Returns nullptr if the image is exhausted.
+        */
+        ImageBlock* block(uint16_t size){
+            if (_blockCount == MaxBlocks || size > SizeBytes - _used){
+                return nullptr;
+            }
+            ImageBlock &block{_blocks[_blockCount++]};
+            block._data = _memory + _used;
+            block._size = size;
+            _used += size;
+            return &block;
+        };
+
+        ImageBlock* operator[](uint8_t idx){
+            return idx < _blockCount ? &_blocks[idx] : nullptr;
+        };
+
+        uint8_t blockCount() const {return _blockCount;};
+        uint16_t bytesUsed() const {return _used;};
+
+    private:
+        uint8_t _memory[SizeBytes]{};
+        ImageBlock _blocks[MaxBlocks]{};
+        uint16_t _used{0};
+        uint8_t _blockCount{0};
+};
+
+#endif // MODERNBUS_PROCESS_IMAGE_H
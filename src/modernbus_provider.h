@@ -5,32 +5,48 @@
 #define MIN_TX_TIME 1
 #endif
 
-template <typename> class ModbusClient;
+template <typename, uint16_t, uint16_t> class ModbusClient;
 
 /*
 Abstract Base class of a provide used by modbus client and server.
 */
 template <typename TStream>
 class ProviderBase{
-    template <typename> friend class ModbusClient;
+    template <typename, uint16_t, uint16_t> friend class ModbusClient;
     public:
         ProviderBase(TStream &stream_)
         : _stream{stream_}
         {};
         // read one byte from stream
         virtual int read() = 0;
+        // read up to len bytes into buffer. Call with len <= available() only.
+        virtual size_t readBytes(uint8_t *buffer, size_t len){
+            size_t count{0};
+            while (count < len){
+                int value{read()};
+                if (value < 0){
+                    break;
+                }
+                buffer[count++] = static_cast<uint8_t>(value);
+            }
+            return count;
+        };
         // write one byte to stream
         virtual size_t write(uint8_t v) = 0;
         // check if there is something in the buffer
         virtual size_t available() = 0;
         // Estimate the total time for transmitting the given bytes.
         virtual uint8_t _calculateTXTime(uint8_t noOfBytes){return 0;};
+        // time of one character on the wire in us. 0 if unknown.
+        virtual uint32_t _charTime(){return 0;};
         // inform provider transmission is about to start
         virtual void _beginTransmission(){};
         // inform provider about transmission has been done
         virtual void _endTransmission(){};
         // inform provider that we have not reached the end of the frame but rx is done
         virtual void _informNotComplete(uint16_t bytes){};
+        // file descriptor the executor may wait on for data. -1 if there is none.
+        virtual int _descriptor(){return -1;};
 
     protected:
         TStream &_stream;
@@ -52,7 +68,7 @@ The stream most provide following interface:
 */
 template <typename TSerialStream>
 class SerialProvider: public ProviderBase<TSerialStream>{
-    template <typename> friend class ModbusClient;
+    template <typename, uint16_t, uint16_t> friend class ModbusClient;
     public:
         SerialProvider(TSerialStream &stream_)
         : ProviderBase<TSerialStream>(stream_)
@@ -74,6 +90,10 @@ class SerialProvider: public ProviderBase<TSerialStream>{
             uint16_t bitsTx = 10 * noOfBytes; // 10 bits per byte to send 0,5 + 8 + 1 + 0,5
             return (bitsTx * 1000) / this->_stream.baudRate();
         }
+
+        uint32_t _charTime() override {
+            return 10000000UL / this->_stream.baudRate();
+        }
 };
 
 /*
@@ -81,7 +101,7 @@ A RS485 Serial provider using a tx pin.
 */
 template <typename TSerialStream>
 class ProviderRS485: public SerialProvider<TSerialStream>{
-    template <typename> friend class ModbusClient;
+    template <typename, uint16_t, uint16_t> friend class ModbusClient;
      public:
         uint8_t txPin;
 
@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "modernbus_register_bank.h"
+
+// quantity limits of the modbus application protocol
+#define MAX_READ_BITS 2000
+#define MAX_READ_REGISTERS 125
+#define MAX_WRITE_BITS 1968
+#define MAX_WRITE_REGISTERS 123
+#define MAX_READ_WRITE_REGISTERS 121
+
+RegisterBankBase::RegisterBankBase(uint8_t *coils, uint16_t coilCount, uint8_t *discreteInputs, uint16_t discreteCount,
+                                   uint8_t *holding, uint16_t holdingCount, uint8_t *input, uint16_t inputCount)
+:   _coils{coils},
+    _coilCount{coilCount},
+    _discrete{discreteInputs},
+    _discreteCount{discreteCount},
+    _holding{holding},
+    _holdingCount{holdingCount},
+    _input{input},
+    _inputCount{inputCount}
+{}
+
+bool RegisterBankBase::coil(uint16_t address) const{
+    return address < _coilCount && _bit(_coils, address);
+}
+
+bool RegisterBankBase::discreteInput(uint16_t address) const{
+    return address < _discreteCount && _bit(_discrete, address);
+}
+
+uint16_t RegisterBankBase::holdingRegister(uint16_t address) const{
+    if (address >= _holdingCount){
+        return 0;
+    }
+    return (_holding[2 * address] << 8) | _holding[2 * address + 1];
+}
+
+uint16_t RegisterBankBase::inputRegister(uint16_t address) const{
+    if (address >= _inputCount){
+        return 0;
+    }
+    return (_input[2 * address] << 8) | _input[2 * address + 1];
+}
+
+bool RegisterBankBase::setCoil(uint16_t address, bool value){
+    if (address >= _coilCount){
+        return false;
+    }
+    _setBit(_coils, address, value);
+    return true;
+}
+
+bool RegisterBankBase::setDiscreteInput(uint16_t address, bool value){
+    if (address >= _discreteCount){
+        return false;
+    }
+    _setBit(_discrete, address, value);
+    return true;
+}
+
+bool RegisterBankBase::setHoldingRegister(uint16_t address, uint16_t value){
+    if (address >= _holdingCount){
+        return false;
+    }
+    _holding[2 * address] = highByte(value);
+    _holding[2 * address + 1] = lowByte(value);
+    return true;
+}
+
+bool RegisterBankBase::setInputRegister(uint16_t address, uint16_t value){
+    if (address >= _inputCount){
+        return false;
+    }
+    _input[2 * address] = highByte(value);
+    _input[2 * address + 1] = lowByte(value);
+    return true;
+}
+
+void RegisterBankBase::onWrite(BankWriteHandler handler){
+    _onWrite = handler;
+}
+
+bool RegisterBankBase::serves(uint8_t functionCode) const{
+    switch (functionCode){
+        case 1: case 5: case 15:
+            return _coilCount > 0;
+        case 2:
+            return _discreteCount > 0;
+        case 3: case 6: case 16: case 22: case 23:
+            return _holdingCount > 0;
+        case 4:
+            return _inputCount > 0;
+        default:
+            return false;
+    }
+}
+
+ErrorCode RegisterBankBase::validate(uint8_t functionCode, uint16_t address, uint16_t quantity, uint8_t byteCount) const{
+    uint16_t count{0};
+    uint16_t maxQuantity{1};
+    switch (functionCode){
+        case 1: count = _coilCount; maxQuantity = MAX_READ_BITS; break;
+        case 2: count = _discreteCount; maxQuantity = MAX_READ_BITS; break;
+        case 3: count = _holdingCount; maxQuantity = MAX_READ_REGISTERS; break;
+        case 4: count = _inputCount; maxQuantity = MAX_READ_REGISTERS; break;
+        case 5: count = _coilCount; quantity = 1; break;
+        case 6: count = _holdingCount; quantity = 1; break;
+        case 22: count = _holdingCount; quantity = 1; break;
+        case 23: count = _holdingCount; maxQuantity = MAX_READ_REGISTERS; break;
+        case 15: count = _coilCount; maxQuantity = MAX_WRITE_BITS; break;
+        case 16: count = _holdingCount; maxQuantity = MAX_WRITE_REGISTERS; break;
+        default: return ErrorCode::illegalFunction;
+    }
+    if (quantity == 0 || quantity > maxQuantity){
+        return ErrorCode::illegalDataValue;
+    }
+    if (functionCode == 15 && byteCount != (quantity + 7) / 8){
+        return ErrorCode::illegalDataValue;
+    }
+    if (functionCode == 16 && byteCount != 2 * quantity){
+        return ErrorCode::illegalDataValue;
+    }
+    if (static_cast<uint32_t>(address) + quantity > count){
+        return ErrorCode::illegalDataAddress;
+    }
+    return ErrorCode::noError;
+}
+
+ErrorCode RegisterBankBase::validateReadWrite(uint16_t readAddress, uint16_t readQuantity,
+                                             uint16_t writeAddress, uint16_t writeQuantity, uint8_t byteCount) const{
+    if (writeQuantity == 0 || writeQuantity > MAX_READ_WRITE_REGISTERS || byteCount != 2 * writeQuantity){
+        return ErrorCode::illegalDataValue;
+    }
+    if (static_cast<uint32_t>(writeAddress) + writeQuantity > _holdingCount){
+        return ErrorCode::illegalDataAddress;
+    }
+    return validate(23, readAddress, readQuantity, 0);
+}
+
+uint8_t RegisterBankBase::packedBits(uint8_t functionCode, uint16_t address, uint16_t quantity, uint16_t idx) const{
+    const uint8_t *bits{functionCode == 1 ? _coils : _discrete};
+    uint16_t first = address + 8 * idx;
+    uint16_t remaining = quantity - 8 * idx;
+    uint8_t packed{0};
+    if ((first & 0x07) == 0){
+        packed = bits[first >> 3];
+    } else {
+        // shift the byte across the boundary of two bank bytes
+        uint8_t shift = first & 0x07;
+        packed = bits[first >> 3] >> shift;
+        if ((first >> 3) + 1 < ((functionCode == 1 ? _coilCount : _discreteCount) + 7) / 8){
+            packed |= bits[(first >> 3) + 1] << (8 - shift);
+        }
+    }
+    if (remaining < 8){
+        // unused bits are zero
+        packed &= (1 << remaining) - 1;
+    }
+    return packed;
+}
+
+const uint8_t* RegisterBankBase::registerBytes(uint8_t functionCode, uint16_t address) const{
+    return (functionCode == 4 ? _input : _holding) + 2 * address;
+}
+
+uint8_t RegisterBankBase::read(uint8_t functionCode, uint16_t address, uint16_t quantity, uint8_t *dst) const{
+    uint8_t byteCount;
+    if (functionCode <= 2){
+        byteCount = (quantity + 7) / 8;
+        for (uint8_t idx = 0; idx < byteCount; idx++){
+            dst[idx] = packedBits(functionCode, address, quantity, idx);
+        }
+    } else {
+        byteCount = 2 * quantity;
+        memcpy(dst, registerBytes(functionCode, address), byteCount);
+    }
+    return byteCount;
+}
+
+void RegisterBankBase::write(uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t *data){
+    switch (functionCode){
+        case 5:
+            quantity = 1;
+            _setBit(_coils, address, data[0] == 0xFF);
+            break;
+        case 6:
+            quantity = 1;
+            memcpy(_holding + 2 * address, data, 2);
+            break;
+        case 15:
+            for (uint16_t idx = 0; idx < quantity; idx++){
+                _setBit(_coils, address + idx, _bit(data, idx));
+            }
+            break;
+        case 16:
+        case 23:
+            memcpy(_holding + 2 * address, data, 2 * quantity);
+            break;
+        case 22: {
+            // data holds and mask and or mask
+            quantity = 1;
+            uint16_t andMask = (data[0] << 8) | data[1];
+            uint16_t orMask = (data[2] << 8) | data[3];
+            uint16_t value{holdingRegister(address)};
+            setHoldingRegister(address, (value & andMask) | (orMask & ~andMask));
+            break;
+        }
+        default:
+            return;
+    }
+    _writes++;
+    if (_onWrite){
+        _onWrite(functionCode, address, quantity);
+    }
+}
+
+bool RegisterBankBase::_bit(const uint8_t *bits, uint16_t idx){
+    return bits[idx >> 3] & (1 << (idx & 0x07));
+}
+
+void RegisterBankBase::_setBit(uint8_t *bits, uint16_t idx, bool value){
+    if (value){
+        bits[idx >> 3] |= 1 << (idx & 0x07);
+    } else {
+        bits[idx >> 3] &= ~(1 << (idx & 0x07));
+    }
+}
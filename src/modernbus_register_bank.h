@@ -0,0 +1,166 @@
+#if !defined(MODERNBUS_REGISTER_BANK_H)
+#define MODERNBUS_REGISTER_BANK_H
+
+#include <Arduino.h>
+#include <mbparser.h>
+
+#include "modernbus_payload.h"
+
+#ifdef STD_FUNCTIONAL
+    #include <functional>
+    using BankWriteHandler = std::function<void(uint8_t functionCode, uint16_t address, uint16_t quantity)>;
+#else
+    using BankWriteHandler = void(*)(uint8_t functionCode, uint16_t address, uint16_t quantity);
+#endif
+
+
+/*
+Standard slave data model. Four areas starting at address 0:
+    coils              fc 01, 05, 15   bit packed
+    discrete inputs    fc 02           bit packed
+    holding registers  fc 03, 06, 16, 22, 23
+    input registers    fc 04
+Bits are packed LSB first and registers are kept big endian,
+both just as on the wire. A server serving the bank copies
+straight between bank and frame.
+
+Use RegisterBank<Coils, DiscreteInputs, HoldingRegisters, InputRegisters> to provide the storage.
+*/
+class RegisterBankBase{
+    public:
+        RegisterBankBase(const RegisterBankBase&) = delete;
+
+        bool coil(uint16_t address) const;
+        bool discreteInput(uint16_t address) const;
+        uint16_t holdingRegister(uint16_t address) const;
+        uint16_t inputRegister(uint16_t address) const;
+
+        /*
+        Application side setters. Return false if address is out of range.
+        They do not call the write handler.
+        */
+        bool setCoil(uint16_t address, bool value);
+        bool setDiscreteInput(uint16_t address, bool value);
+        bool setHoldingRegister(uint16_t address, uint16_t value);
+        bool setInputRegister(uint16_t address, uint16_t value);
+
+        /*
+        Typed views on the register areas, e.g. bank.inputRegisters<float>()[3]
+        */
+        template <typename V = uint16_t, WordOrder O = WordOrder::ABCD>
+        PayloadView<V, O> holdingRegisters() const {return PayloadView<V, O>{_holding, static_cast<uint16_t>(2 * _holdingCount)};};
+
+        template <typename V = uint16_t, WordOrder O = WordOrder::ABCD>
+        PayloadView<V, O> inputRegisters() const {return PayloadView<V, O>{_input, static_cast<uint16_t>(2 * _inputCount)};};
+
+        /*
+        Typed setters. value takes sizeof(V) / 2 registers starting at address.
+        */
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        bool setHoldingRegisters(uint16_t address, V value){
+            return _encode<V, O>(_holding, _holdingCount, address, value);
+        };
+
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        bool setInputRegisters(uint16_t address, V value){
+            return _encode<V, O>(_input, _inputCount, address, value);
+        };
+
+        /*
+        Called after a master wrote into the bank (fc 05, 06, 15, 16, 22 and the write part of 23).
+        */
+        void onWrite(BankWriteHandler handler);
+
+        uint16_t coilCount() const {return _coilCount;};
+        uint16_t discreteInputCount() const {return _discreteCount;};
+        uint16_t holdingRegisterCount() const {return _holdingCount;};
+        uint16_t inputRegisterCount() const {return _inputCount;};
+        uint32_t writeCount() const {return _writes;};
+
+        // Server side
+
+        /*
+        True if the bank has an area for functionCode.
+        */
+        bool serves(uint8_t functionCode) const;
+
+        /*
+        Validates a request. Returns noError, illegalDataAddress or illegalDataValue.
+        */
+        ErrorCode validate(uint8_t functionCode, uint16_t address, uint16_t quantity, uint8_t byteCount) const;
+
+        /*
+        Validates the write and the read part of fc 23.
+        */
+        ErrorCode validateReadWrite(uint16_t readAddress, uint16_t readQuantity,
+                                    uint16_t writeAddress, uint16_t writeQuantity, uint8_t byteCount) const;
+
+        /*
+        Byte idx of the bit packed read of fc 01, 02 starting at address.
+        */
+        uint8_t packedBits(uint8_t functionCode, uint16_t address, uint16_t quantity, uint16_t idx) const;
+
+        /*
+        Big endian bytes of fc 03, 04 starting at address.
+        */
+        const uint8_t* registerBytes(uint8_t functionCode, uint16_t address) const;
+
+        /*
+        Copies the payload of a validated read (fc 01 - 04, 23) to dst as on the wire.
+        Returns the byte count.
+        */
+        uint8_t read(uint8_t functionCode, uint16_t address, uint16_t quantity, uint8_t* dst) const;
+
+        /*
+        Applies a validated write. data is the payload of the request as on the wire.
+        fc 22 takes and mask and or mask, fc 23 the registers to write.
+        */
+        void write(uint8_t functionCode, uint16_t address, uint16_t quantity, const uint8_t* data);
+
+    protected:
+        RegisterBankBase(uint8_t* coils, uint16_t coilCount, uint8_t* discreteInputs, uint16_t discreteCount,
+                         uint8_t* holding, uint16_t holdingCount, uint8_t* input, uint16_t inputCount);
+
+    private:
+        uint8_t* _coils;
+        uint16_t _coilCount;
+        uint8_t* _discrete;
+        uint16_t _discreteCount;
+        uint8_t* _holding;
+        uint16_t _holdingCount;
+        uint8_t* _input;
+        uint16_t _inputCount;
+        BankWriteHandler _onWrite{nullptr};
+        uint32_t _writes{0};
+
+        template <typename V, WordOrder O>
+        static bool _encode(uint8_t* area, uint16_t count, uint16_t address, V value){
+            if (static_cast<uint32_t>(address) * 2 + sizeof(V) > static_cast<uint32_t>(count) * 2){
+                return false;
+            }
+            PayloadCodec<V, O>::encode(value, area + 2 * address);
+            return true;
+        };
+
+        static bool _bit(const uint8_t* bits, uint16_t idx);
+        static void _setBit(uint8_t* bits, uint16_t idx, bool value);
+};
+
+
+template <uint16_t Coils, uint16_t DiscreteInputs, uint16_t HoldingRegisters, uint16_t InputRegisters>
+class RegisterBank: public RegisterBankBase{
+    public:
+        RegisterBank()
+        :   RegisterBankBase{_coilStorage, Coils, _discreteStorage, DiscreteInputs,
+                             _holdingStorage, HoldingRegisters, _inputStorage, InputRegisters}
+        {};
+
+    private:
+        // at least one byte, so empty areas are valid arrays
+        uint8_t _coilStorage[(Coils + 7) / 8 + 1]{};
+        uint8_t _discreteStorage[(DiscreteInputs + 7) / 8 + 1]{};
+        uint8_t _holdingStorage[2 * HoldingRegisters + 1]{};
+        uint8_t _inputStorage[2 * InputRegisters + 1]{};
+};
+
+#endif // MODERNBUS_REGISTER_BANK_H
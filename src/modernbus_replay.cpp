@@ -0,0 +1,143 @@
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "modernbus_replay.h"
+
+CaptureLog::CaptureLog(const char *path){
+    int fd{open(path, O_RDONLY | O_CLOEXEC)};
+    if (fd < 0){
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0){
+        void *data{mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (data != MAP_FAILED){
+            // replay reads front to back
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            _data = static_cast<const uint8_t*>(data);
+            _size = info.st_size;
+        }
+    }
+    // the mapping stays valid
+    close(fd);
+}
+
+CaptureLog::~CaptureLog(){
+    if (_data){
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+}
+
+ReplayProvider::ReplayProvider(CaptureLog &log, ReplayMode mode, CaptureDirection feed)
+:   ProviderBase<CaptureLog>{log},
+    _reader{log.data(), log.size()},
+    _mode{mode},
+    _feed{feed}
+{}
+
+int ReplayProvider::read(){
+    if (_cursor >= _record.length){
+        return -1;
+    }
+    return _record.data[_cursor++];
+}
+
+size_t ReplayProvider::readBytes(uint8_t *buffer, size_t len){
+    if (len > static_cast<size_t>(_record.length - _cursor)){
+        len = _record.length - _cursor;
+    }
+    memcpy(buffer, _record.data + _cursor, len);
+    _cursor += len;
+    return len;
+}
+
+size_t ReplayProvider::write(uint8_t){
+    _written++;
+    return 1;
+}
+
+size_t ReplayProvider::available(){
+    if (_cursor >= _record.length && !_nextRecord()){
+        return 0;
+    }
+    if (!_isGateOpen()){
+        return 0;
+    }
+    if (_mode == ReplayMode::original && _clock.now() - _startedAt < _record.timestamp - _firstTimestamp){
+        return 0;
+    }
+    return _record.length - _cursor;
+}
+
+uint8_t ReplayProvider::_calculateTXTime(uint8_t noOfBytes){
+    if (_mode == ReplayMode::fastest || !_reader.baudRate()){
+        return 0;
+    }
+    uint16_t bitsTx = 10 * noOfBytes;
+    return (bitsTx * 1000UL) / _reader.baudRate();
+}
+
+uint32_t ReplayProvider::_charTime(){
+    if (_mode == ReplayMode::fastest || !_reader.baudRate()){
+        return 0;
+    }
+    return 10000000UL / _reader.baudRate();
+}
+
+void ReplayProvider::_endTransmission(){
+    _sent++;
+}
+
+void ReplayProvider::rewind(){
+    _reader.rewind();
+    _record = CaptureRecord{};
+    _cursor = 0;
+    _done = false;
+    _started = false;
+    _frames = 0;
+    _expected = 0;
+    _sent = 0;
+}
+
+bool ReplayProvider::_nextRecord(){
+    while (!_done){
+        if (!_reader.next(_record)){
+            _record = CaptureRecord{};
+            _done = true;
+            return false;
+        }
+        if (_record.direction != _feed){
+            _expected++;
+            continue;
+        }
+        _waitingSince = millis();
+        if (!_started){
+            _started = true;
+            _startedAt = _clock.now();
+            _firstTimestamp = _record.timestamp;
+        }
+        _cursor = 0;
+        _frames++;
+        return true;
+    }
+    return false;
+}
+
+bool ReplayProvider::_isGateOpen(){
+    if (_sent >= _expected){
+        return true;
+    }
+    if (_gateTimeout && millis() - _waitingSince >= _gateTimeout){
+        // the endpoint did not answer. Go on.
+        _sent = _expected;
+        return true;
+    }
+    return false;
+}
+
+#endif // __linux__
@@ -0,0 +1,117 @@
+#if !defined(MODERNBUS_REPLAY_H)
+#define MODERNBUS_REPLAY_H
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+
+#include "modernbus_provider.h"
+#include "modernbus_capture.h"
+
+enum class ReplayMode : uint8_t {
+    // frames become available at their captured time
+    original,
+    // frames are available right away
+    fastest
+};
+
+
+/*
+Capture log mapped into memory (Linux).
+*/
+class CaptureLog{
+    public:
+        CaptureLog(const char *path);
+        CaptureLog(const CaptureLog&) = delete;
+        ~CaptureLog();
+
+        bool isOpen() const {return _data != nullptr;};
+        const uint8_t* data() const {return _data;};
+        size_t size() const {return _size;};
+
+    private:
+        const uint8_t *_data{nullptr};
+        size_t _size{0};
+};
+
+
+/*
+Feeds the frames of a capture log to a client or server.
+
+    CaptureLog log{"/var/log/bus.mbcap"};
+    ReplayProvider provider{log, ReplayMode::fastest};
+    ModbusClient<ReplayProvider> client{&scheduler, &provider};
+
+feed selects the frames read by the endpoint. A log captured by a client
+replays its responses (rx) into a client and its requests (tx) into a server.
+Frames written by the endpoint are counted and dropped.
+
+Order is kept as captured: a frame becomes available once the endpoint
+sent as many frames as the log holds before it in the other direction,
+as a client drops whatever arrives before its request.
+If the endpoint does not answer within the gate timeout, replay goes on.
+The log is read in place, nothing is copied.
+*/
+class ReplayProvider: public ProviderBase<CaptureLog>{
+    public:
+        ReplayProvider(CaptureLog &log, ReplayMode mode = ReplayMode::original, CaptureDirection feed = CaptureDirection::rx);
+
+        int read() override;
+        size_t readBytes(uint8_t *buffer, size_t len) override;
+        size_t write(uint8_t v) override;
+        size_t available() override;
+        uint8_t _calculateTXTime(uint8_t noOfBytes) override;
+        uint32_t _charTime() override;
+        void _endTransmission() override;
+
+        /*
+        Time to wait for the endpoint to send before the next frame
+        is fed anyway. 0 waits forever. default: 1000 ms
+        */
+        void setGateTimeout(uint32_t ms){_gateTimeout = ms;};
+
+        /*
+        False if the log is missing or no capture log.
+        */
+        bool isValid() const {return _reader.isValid();};
+
+        /*
+        True once all frames were read.
+        */
+        bool isDone() const {return _done;};
+
+        /*
+        Starts over, timing included.
+        */
+        void rewind();
+
+        uint32_t frameCount() const {return _frames;};
+        uint32_t bytesWritten() const {return _written;};
+
+    private:
+        CaptureReader _reader;
+        ReplayMode _mode;
+        CaptureDirection _feed;
+        CaptureRecord _record{};
+        uint16_t _cursor{0};
+        bool _done{false};
+        bool _started{false};
+        WideMicros _clock{};
+        uint64_t _startedAt{0};
+        uint64_t _firstTimestamp{0};
+        uint32_t _frames{0};
+        uint32_t _written{0};
+        // frames of the other direction in the log and sent by the endpoint
+        uint32_t _expected{0};
+        uint32_t _sent{0};
+        uint32_t _waitingSince{0};
+        uint32_t _gateTimeout{1000};
+
+        bool _isGateOpen();
+
+        bool _nextRecord();
+};
+
+#endif // __linux__
+
+#endif // MODERNBUS_REPLAY_H
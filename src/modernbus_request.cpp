@@ -2,7 +2,14 @@
 #include "modernbus_server_response.h"
 
 ModbusRequest::ModbusRequest(uint8_t *request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler)
-:   _requestFrame{request, requestSize},
+:   ModbusRequest{request, requestSize, swap, registerSize, handler, new uint8_t[requestSize]}
+{
+    _ownsFrame = true;
+}
+
+ModbusRequest::ModbusRequest(uint8_t *request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler, uint8_t *frameStorage)
+:   _frame{frameStorage},
+    _frameSize{requestSize},
     _swap{swap},
     _registerSize{registerSize},
     _handler{handler},
@@ -11,13 +18,16 @@ ModbusRequest::ModbusRequest(uint8_t *request, uint16_t requestSize, bool swap,
     _functionCode{request[1]},
     _address{(uint16_t)((request[2] << 8) | request[3])}
 {
+    if (_frame != request){
+        memcpy(_frame, request, requestSize);
+    }
     _validateSwap();
     _determineQuantity();
 }
 
 ModbusRequest::~ModbusRequest(){
-    while(_requestFrame.size()){
-        _requestFrame.popLeft();
+    if (_ownsFrame){
+        delete [] _frame;
     }
 }
 
@@ -38,6 +48,10 @@ uint16_t ModbusRequest::address() const{
             return *this;
             }
 
+ModbusRequest& ModbusRequest::setThrottle(uint16_t time_){
+    return every(time_);
+}
+
 void ModbusRequest::setExtension(void * ptr){ 
     _extensionPtr = ptr; 
 }
@@ -54,6 +68,72 @@ ModbusRequest& ModbusRequest::setTimeout(uint32_t time)
     return *this;
 }
 
+/*
+Called on any error of this request, in addition to the error handler of the client.
+*/
+ModbusRequest& ModbusRequest::setOnError(ErrorHandler handler)
+{
+    _onError = handler;
+    return *this;
+}
+
+/*
+Called after the response, error or timeout of the request was handled
+and the handlers returned. The client does not touch the request afterwards
+until it is sent again. Not called for cancelled requests.
+*/
+ModbusRequest& ModbusRequest::setOnDone(DoneHandler handler)
+{
+    _onDone = handler;
+    return *this;
+}
+
+/*
+Each successful response is published to sink before the handler is called.
+*/
+ModbusRequest& ModbusRequest::publishTo(ResponseSink *sink)
+{
+    _sink = sink;
+    return *this;
+}
+
+/*
+Handler is only called if the payload changed since the last call.
+With heartbeat > 0 handler is called at least every heartbeat responses.
+*/
+ModbusRequest& ModbusRequest::onChange(uint16_t heartbeat)
+{
+    _filter.enable(_expectedPayloadSize(), heartbeat);
+    return *this;
+}
+
+/*
+Register changes smaller or equal deadband are not considered a change.
+Requires onChange to be called before.
+*/
+ModbusRequest& ModbusRequest::setDeadband(uint16_t deadband)
+{
+    for (uint16_t idx = 0; idx < _registerQuantity; idx++){
+        _filter.setDeadband(idx, deadband, _registerQuantity);
+    }
+    return *this;
+}
+
+ModbusRequest& ModbusRequest::setDeadband(uint16_t registerIdx, uint16_t deadband)
+{
+    _filter.setDeadband(registerIdx, deadband, _registerQuantity);
+    return *this;
+}
+
+/*
+Deadbands compare registers as signed 16 bit values. Default is unsigned.
+*/
+ModbusRequest& ModbusRequest::setSigned(bool isSigned)
+{
+    _filter.setSigned(isSigned);
+    return *this;
+}
+
 void ModbusRequest::_validateSwap(){
     if (_swap && _registerSize < 2){
         assert(false);
@@ -62,15 +142,50 @@ void ModbusRequest::_validateSwap(){
 
 void ModbusRequest::_determineQuantity()
 {
-    if (_functionCode < 5 || _functionCode > 6){
-        _registerQuantity = _requestFrame.get(4) << 8 | _requestFrame.get(5);
+    if ((_functionCode < 5 || _functionCode > 6) && _functionCode != 22){
+        _registerQuantity = _frame[4] << 8 | _frame[5];
     } else {
         _registerQuantity = 1;
     }
 }
 
+uint16_t ModbusRequest::_expectedPayloadSize() const
+{
+    if (_functionCode < 3){
+        return (_registerQuantity + 7) / 8;
+    } else if (_functionCode < 5 || _functionCode == 23){
+        return _registerQuantity * 2;
+    } else if (_functionCode == 22){
+        // and mask, or mask
+        return 4;
+    }
+    return 2;
+}
+
+/*
+Length of the response frame including crc, e.g. the echo of a write.
+*/
+uint16_t ModbusRequest::_expectedResponseSize() const
+{
+    switch (_functionCode){
+        case 5: case 6: case 15: case 16:
+            // address and quantity or value
+            return 8;
+        case 22:
+            // address, and mask, or mask
+            return 10;
+        default:
+            // slave address, function code, byte count, payload, crc
+            return 5 + (_functionCode < 3 ? (_registerQuantity + 7) / 8 : _registerQuantity * 2);
+    }
+}
+
 uint16_t ModbusRequest::requestSize(){
-    return _requestFrame.size();
+    return _frameSize;
+}
+
+const uint8_t *ModbusRequest::frame() const{
+    return _frame;
 }
 
 ServerResponse &ModbusRequest::response(){
@@ -97,7 +212,37 @@ ResponseHandler ModbusRequest::getHandler() const{
     return _handler;
 }
 
+ErrorHandler ModbusRequest::getErrorHandler() const{
+    return _onError;
+}
+
 uint16_t ModbusRequest::deviceDelay() const
 {
     return _deviceDelay;
 }
+
+ResponseSink *ModbusRequest::sink() const
+{
+    return _sink;
+}
+
+uint32_t ModbusRequest::suppressedCount() const
+{
+    return _filter.suppressed();
+}
+
+/*
+Marks a queued single request as cancelled.
+The client skips it and calls the error handler of the request,
+so that the owner can free it.
+May be called from any thread.
+*/
+void ModbusRequest::cancel()
+{
+    __atomic_store_n(&_cancelled, true, __ATOMIC_RELAXED);
+}
+
+bool ModbusRequest::isCancelled() const
+{
+    return __atomic_load_n(&_cancelled, __ATOMIC_RELAXED);
+}
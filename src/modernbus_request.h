@@ -7,30 +7,35 @@
 #include "mbparser.h"
 
 #include "modernbus_server_response.h"
+#include "modernbus_change_filter.h"
 
 #ifdef STD_FUNCTIONAL
     #include <functional>
 #endif
 
 
+class ModbusRequest;
+
+// called once the client is done with a request. The request may be destroyed from within.
+using DoneHandler = void(*)(ModbusRequest *request);
+
 /*
 ModbusRequest holds all essential data required for a typical request.
 Requests are send from a client class to a server class. 
 */
 class ModbusRequest{
-    template<typename> friend class ModbusClient;
-    
-    #ifndef STD_FUNCTIONAL
-        template <typename U>
-        friend void _parserComplete(ResponseParser *parser);
-        template <typename U>
-        friend void _handleError(ResponseParser *parser);
-    #endif
+    template<typename, uint16_t, uint16_t> friend class ModbusClient;
 
     public:
         ModbusRequest() = delete;
         ModbusRequest(const ModbusRequest& r) = delete;
         ModbusRequest(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler);
+        /*
+        Same as above, but the frame is copied into frameStorage instead of the heap.
+        frameStorage must hold at least requestSize bytes and outlive the request.
+        Passing the request array itself as storage uses the frame in place.
+        */
+        ModbusRequest(uint8_t* request, uint16_t requestSize, bool swap, uint16_t registerSize, ResponseHandler handler, uint8_t* frameStorage);
         ~ModbusRequest();
         // Getter
 
@@ -38,34 +43,70 @@ class ModbusRequest{
         uint16_t functionCode()const;
         uint16_t address()const;
         uint16_t requestSize();
+        const uint8_t* frame() const;
         ServerResponse& response();
         bool swap()const;
         uint16_t registerSize()const;
         uint16_t throttle() const;
         void* getExtension();
         ResponseHandler getHandler() const;
+        ErrorHandler getErrorHandler() const;
         uint16_t deviceDelay() const;
+        ResponseSink* sink() const;
+        uint32_t suppressedCount() const;
+        bool isCancelled() const;
 
         //Setter
 
         ModbusRequest& every(uint16_t time);
+        // same as every
+        ModbusRequest& setThrottle(uint16_t time);
         void setExtension(void *ptr);
         ModbusRequest& setTimeout(uint32_t time);
         ModbusRequest& setDeviceDelay(uint16_t millis_);
+        ModbusRequest& publishTo(ResponseSink *sink);
+        ModbusRequest& setOnError(ErrorHandler handler);
+        ModbusRequest& setOnDone(DoneHandler handler);
+        ModbusRequest& onChange(uint16_t heartbeat = 0);
+        // same as above, shadow copy and deadbands kept in storage instead of the heap
+        template <uint16_t SizeBytes>
+        ModbusRequest& onChange(ChangeFilterStorage<SizeBytes> &storage, uint16_t heartbeat = 0){
+            _filter.setStorage(storage.shadow, SizeBytes, storage.deadbands, (SizeBytes + 1) / 2);
+            return onChange(heartbeat);
+        };
+        ModbusRequest& setDeadband(uint16_t deadband);
+        ModbusRequest& setDeadband(uint16_t registerIdx, uint16_t deadband);
+        ModbusRequest& setSigned(bool isSigned = true);
+        void cancel();
 
     private:
-        TinyLinkedList<uint8_t> _requestFrame{};
+        uint8_t* _frame;
+        uint16_t _frameSize;
+        bool _ownsFrame{false};
         bool _swap = false;
         uint16_t _registerSize{0};
         ResponseHandler _handler;
+        ErrorHandler _onError{nullptr};
+        DoneHandler _onDone{nullptr};
         ServerResponse _response;
         uint16_t _throttle{0};
         uint32_t _timeOut{500};
         uint32_t _requestSent{};
         uint32_t _requestStarted{};
+#ifdef MODERNBUS_METRICS
+        // micros() at the last transmission, for the poll jitter
+        uint32_t _lastTransmission{0};
+#endif
         void* _extensionPtr {nullptr};
+        ResponseSink* _sink{nullptr};
+        ChangeFilter _filter{};
+        bool _cancelled{false};
+        // queued by ModbusClient::send(frame, ...), freed by the client once done
+        bool _oneShot{false};
         void _validateSwap();
         void _determineQuantity();
+        uint16_t _expectedPayloadSize() const;
+        uint16_t _expectedResponseSize() const;
 
         const uint8_t _slaveAddress;
         const uint8_t _functionCode;
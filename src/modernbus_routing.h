@@ -0,0 +1,148 @@
+#if !defined(MODERNBUS_ROUTING_H)
+#define MODERNBUS_ROUTING_H
+
+#include <Arduino.h>
+#include <mbparser.h>
+
+/*
+Routing index of a server.
+
+Routes are kept sorted by function code and start address,
+so a request is routed with a binary search.
+A route covers [start, end]. Routes without a known range
+(handler only) end right before the next route of the same function code.
+Overlapping routes are counted and dropped, the route with the lower
+start address wins.
+A request is routed if all its registers lie within a bounded route.
+*/
+template <typename TResponse>
+class RouteTable{
+    public:
+        struct Route{
+            uint8_t functionCode;
+            uint16_t start;
+            uint16_t end;
+            bool bounded;
+            TResponse *response;
+        };
+
+        RouteTable() = default;
+        RouteTable(const RouteTable&) = delete;
+
+        ~RouteTable(){
+            delete [] _routes;
+        };
+
+        /*
+        Drops all routes and reserves space for capacity routes.
+        */
+        void clear(uint16_t capacity){
+            if (capacity > _capacity){
+                // rebuilt on each registration. Grow in steps to not fragment the heap.
+                uint16_t grown = _capacity > 0x7FFF ? 0xFFFF : 2 * _capacity;
+                _capacity = capacity > grown ? capacity : grown;
+                delete [] _routes;
+                _routes = new Route[_capacity];
+            }
+            _size = 0;
+            _overlaps = 0;
+        };
+
+        /*
+        Inserts a route in order. Call build() once all routes are added.
+        count is the number of registers served. 0 means unknown.
+        */
+        void add(uint8_t functionCode, uint16_t start, uint16_t count, TResponse *response){
+            if (_size == _capacity){
+                return;
+            }
+            Route route{functionCode, start, 0xFFFF, count > 0, response};
+            if (count > 0){
+                uint32_t end = static_cast<uint32_t>(start) + count - 1;
+                route.end = end > 0xFFFF ? 0xFFFF : end;
+            }
+            // insertion sort. Routes are mostly registered in order.
+            uint16_t idx{_size++};
+            while (idx > 0 && _less(route, _routes[idx - 1])){
+                _routes[idx] = _routes[idx - 1];
+                idx--;
+            }
+            _routes[idx] = route;
+        };
+
+        /*
+        Removes overlapping routes and closes open ranges.
+        Returns the number of overlaps found.
+        */
+        uint16_t build(){
+            uint16_t kept{0};
+            for (uint16_t idx = 0; idx < _size; idx++){
+                Route &route{_routes[idx]};
+                if (kept > 0){
+                    Route &previous{_routes[kept - 1]};
+                    if (previous.functionCode == route.functionCode){
+                        if (route.start <= previous.end && (previous.bounded || route.start == previous.start)){
+                            _overlaps++;
+                            continue;
+                        }
+                        if (!previous.bounded){
+                            previous.end = route.start - 1;
+                        }
+                    }
+                }
+                _routes[kept++] = route;
+            }
+            _size = kept;
+            return _overlaps;
+        };
+
+        /*
+        Returns the response serving quantity registers from address on of functionCode.
+        Else nullptr and error is set to illegalFunction or illegalDataAddress.
+        */
+        TResponse* find(uint8_t functionCode, uint16_t address, uint16_t quantity, ErrorCode &error) const {
+            // last route not greater than (functionCode, address)
+            int32_t low{0};
+            int32_t high{static_cast<int32_t>(_size) - 1};
+            int32_t found{-1};
+            while (low <= high){
+                int32_t mid{(low + high) / 2};
+                const Route &route{_routes[mid]};
+                if (route.functionCode < functionCode || (route.functionCode == functionCode && route.start <= address)){
+                    found = mid;
+                    low = mid + 1;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            if (found >= 0 && _routes[found].functionCode == functionCode){
+                const Route &route{_routes[found]};
+                uint32_t last = static_cast<uint32_t>(address) + (quantity ? quantity : 1) - 1;
+                if (address <= route.end && (!route.bounded || last <= route.end)){
+                    return route.response;
+                }
+                error = ErrorCode::illegalDataAddress;
+                return nullptr;
+            }
+            // function code may still be known with routes starting above address
+            bool known{found + 1 < _size && _routes[found + 1].functionCode == functionCode};
+            error = known ? ErrorCode::illegalDataAddress : ErrorCode::illegalFunction;
+            return nullptr;
+        };
+
+        uint16_t size() const {return _size;};
+        uint16_t overlaps() const {return _overlaps;};
+        const Route& operator[](uint16_t idx) const {return _routes[idx];};
+
+    private:
+        Route *_routes{nullptr};
+        uint16_t _capacity{0};
+        uint16_t _size{0};
+        uint16_t _overlaps{0};
+
+        static bool _less(const Route &a, const Route &b){
+            return a.functionCode < b.functionCode || (a.functionCode == b.functionCode && a.start < b.start);
+        };
+};
+
+#endif // MODERNBUS_ROUTING_H
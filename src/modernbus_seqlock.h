@@ -0,0 +1,58 @@
+#if !defined(MODERNBUS_SEQLOCK_H)
+#define MODERNBUS_SEQLOCK_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+Sequence lock for one writer and any number of readers.
+Readers never block the writer. They copy the data and retry
+if the writer was active meanwhile.
+
+Writer:
+    lock.writeBegin(); update data; lock.writeEnd();
+Reader:
+    do { s = lock.readBegin(); copy data; } while (lock.readRetry(s));
+*/
+class SeqLock{
+    public:
+        void writeBegin(){
+            _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        };
+
+        void writeEnd(){
+            _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        };
+
+        /*
+        Waits until no write is in progress and returns the sequence to validate against.
+        */
+        uint32_t readBegin() const {
+            uint32_t sequence{_sequence.load(std::memory_order_acquire)};
+            while (sequence & 0x01){
+                sequence = _sequence.load(std::memory_order_acquire);
+            }
+            return sequence;
+        };
+
+        /*
+        Returns true if the data read since readBegin may be torn.
+        */
+        bool readRetry(uint32_t sequence) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return _sequence.load(std::memory_order_relaxed) != sequence;
+        };
+
+        /*
+        Number of completed writes.
+        */
+        uint32_t writes() const {
+            return _sequence.load(std::memory_order_acquire) >> 1;
+        };
+
+    private:
+        std::atomic<uint32_t> _sequence{0};
+};
+
+#endif // MODERNBUS_SEQLOCK_H
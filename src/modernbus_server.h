@@ -1,11 +1,19 @@
 #ifndef MODERNBUS_SERVER_H
 #define MODERNBUS_SERVER_H
 
-#include <TaskSchedulerDeclarations.h>
 #include <mbparser.h>
 #include <linkedlist.h>
+#include "modernbus_executor.h"
 #include "modernbus_provider.h"
 #include "modernbus_util.h"
+#include "modernbus_payload.h"
+#include "modernbus_routing.h"
+#include "modernbus_register_bank.h"
+#include "modernbus_frame_parser.h"
+#include "modernbus_trace.h"
+#ifdef MODERNBUS_METRICS
+    #include "modernbus_metrics.h"
+#endif
 
 template <typename>
 class ModbusResponse;
@@ -13,6 +21,18 @@ template <typename>
 class ModbusExceptionResponse;
 template <typename>
 class ModbusServer;
+template <typename>
+class ModbusUnit;
+template <typename>
+class DeferredResponse;
+
+// exception code of a deferred response not completed in time
+#define SLAVE_DEVICE_BUSY 0x06
+
+// payload bytes a deferred response can hold
+#ifndef MODERNBUS_DEFERRED_PAYLOAD
+#define MODERNBUS_DEFERRED_PAYLOAD 250
+#endif
 
 #ifndef STD_FUNCTIONAL
     template <typename T>
@@ -33,6 +53,44 @@ class ModbusServer;
 #endif
 
 
+/*
+Source of a mapping updated concurrently to serving.
+snapshot() returns a consistent copy of the mapped bytes.
+See MappedSource for a lock free implementation.
+*/
+class MappingSource{
+    public:
+        virtual const uint8_t* snapshot() = 0;
+        virtual uint8_t size() const = 0;
+        virtual ~MappingSource() = default;
+};
+
+
+/*
+Request being served, taken from the FrameParser.
+*/
+struct RequestContext{
+    uint8_t functionCode{0};
+    uint16_t address{0};
+    uint16_t quantity{0};
+    uint8_t byteCount{0};
+    uint8_t *data{nullptr};
+    // fc 23 only
+    uint16_t writeAddress{0};
+    uint16_t writeQuantity{0};
+
+    void update(FrameParser &parser){
+        functionCode = parser.functionCode();
+        address = parser.address();
+        quantity = parser.quantity();
+        byteCount = parser.byteCount();
+        data = parser.data();
+        writeAddress = parser.writeAddress();
+        writeQuantity = parser.writeQuantity();
+    }
+};
+
+
 template <typename T>
 class ResponseBase{
     public:
@@ -44,6 +102,13 @@ class ResponseBase{
             return _myAddress;
         }
 
+        /*
+        Unit id (slave address) the request was sent to.
+        */
+        uint8_t unitId() const {
+            return _slaveAddress;
+        }
+
         void sendException(uint8_t exceptionCode){
            _sendException(exceptionCode);
         }
@@ -82,6 +147,7 @@ class ResponseBase{
         
         void _sendHeader(){
             _reset();
+            _server->_onTransmit();
             _server->_provider->_beginTransmission();
             _write(_slaveAddress);
             _write(_functionCode);
@@ -104,6 +170,7 @@ class ResponseBase{
             _write(highByte(_crc), false);
             _sent = true;
             _server->_provider->_endTransmission();
+            MODERNBUS_TRACE_POINT(serverEnd, _server, _size);
         }
 
         void _write(uint8_t v, bool crc=true){
@@ -121,6 +188,8 @@ class ResponseBase{
 
         void _sendException(uint8_t exceptionCode){
             ResponseBase<T>::_reset();
+            _server->_onTransmit();
+            _server->_onException(exceptionCode);
             ResponseBase<T>::_write(this->_slaveAddress);
             ResponseBase<T>::_write(this->_functionCode + 128);
             ResponseBase<T>::_write(exceptionCode);
@@ -134,6 +203,9 @@ class ModbusResponse: public ResponseBase<T>{
 
     template <typename>
     friend class ModbusServer;
+    template <typename>
+    friend class ModbusUnit;
+    friend class DeferredResponse<T>;
     
     public:
 
@@ -143,10 +215,10 @@ class ModbusResponse: public ResponseBase<T>{
         Per Register 2 x 8 bit = 16 bit by modbus default.
         Others sizes are possible.
         
-        Returns true if function code allows payload (i.e. 01-04)
+        Returns true if function code allows payload (i.e. 01-04 and 23)
         */
         bool send(uint8_t* payload, uint8_t len){
-            if (this->_functionCode <= 0x04) {
+            if (this->_functionCode <= 0x04 || this->_functionCode == FC_READ_WRITE_REGISTERS) {
                 this->_sendHeader();
                 this->_write(len); // byteCount
                 ResponseBase<T>::_sendPayload(payload, len);
@@ -161,13 +233,16 @@ class ModbusResponse: public ResponseBase<T>{
 
         /*
         Echoes the request from client-
-        Typical this is the case for functionCodes 5,6 and 15,16.
+        Typical this is the case for functionCodes 5,6, 15,16 and 22.
         */
         void sendEcho(){
             this->_sendHeader();
             this->_sendTwoBytes(this->_myAddress);
             if (this->_functionCode == 5 || this->_functionCode == 6){
                 ResponseBase<T>::_sendPayload(_payload, 2);
+            } else if (this->_functionCode == FC_MASK_WRITE_REGISTER){
+                // and mask, or mask
+                ResponseBase<T>::_sendPayload(_payload, 4);
             } else {
                 this->_sendTwoBytes(_quantity);
             }
@@ -175,6 +250,21 @@ class ModbusResponse: public ResponseBase<T>{
             this->_sent = true;
         }
 
+        /*
+        Answers the request later. The handler may return right away,
+        the server keeps the request context and keeps receiving frames.
+        Complete the returned response from any task or thread.
+        If it is not completed within timeout ms the server answers
+        with exception 06 (slave device busy).
+        Requests arriving meanwhile are answered busy as well.
+        */
+        DeferredResponse<T>& defer(uint32_t timeout){
+            DeferredResponse<T> &deferred{this->_server->_deferredResponse()};
+            deferred._start(*this, timeout);
+            _deferred = true;
+            return deferred;
+        }
+
         /*
         with allows you to simply map an array to a function code and a starting address.
         without the need for a handler.
@@ -183,11 +273,49 @@ class ModbusResponse: public ResponseBase<T>{
         */
         ModbusResponse<T>& with(uint8_t* payload, uint8_t len, uint8_t registerLen = 2){
             _mapping = payload;
+            _source = nullptr;
             _sendLen = len;
             _registerLen = registerLen;
+            _routesChanged();
             return *this;
         };
 
+        /*
+        Maps a source the application updates while the server is running.
+        Each request is served from a consistent snapshot of source.
+        */
+        ModbusResponse<T>& with(MappingSource &source, uint8_t registerLen = 2){
+            _source = &source;
+            _mapping = nullptr;
+            _sendLen = source.size();
+            _registerLen = registerLen;
+            _routesChanged();
+            return *this;
+        };
+
+        /*
+        Limits the response to quantity registers starting at its address.
+        Requests to addresses behind are answered with illegal data address.
+        A response mapped by with() is limited to the mapped registers anyway.
+        Without range or with, a response ends right before the next response
+        of the same function code.
+        */
+        ModbusResponse<T>& range(uint16_t quantity){
+            _registerCount = quantity;
+            _routesChanged();
+            return *this;
+        };
+
+        /*
+        Number of registers served. 0 if open ended.
+        */
+        uint16_t registerCount() const {
+            if (_registerCount){
+                return _registerCount;
+            }
+            return (_mapping || _source) ? _sendLen / _registerLen : 0;
+        }
+
         uint8_t byteCount() const {
             return this->_byteCount;
         }
@@ -199,6 +327,37 @@ class ModbusResponse: public ResponseBase<T>{
         uint8_t* payload() const {
             return this->_payload;
         }
+
+        /*
+        Registers to write of a fc 23 request. Its payload holds the values.
+        */
+        uint16_t writeAddress() const {
+            return _writeAddress;
+        }
+
+        uint16_t writeQuantity() const {
+            return _writeQuantity;
+        }
+
+        /*
+        Masks of a fc 22 request. The register becomes
+        (value & andMask) | (orMask & ~andMask).
+        */
+        uint16_t andMask() const {
+            return _functionCode22() ? (_payload[0] << 8) | _payload[1] : 0xFFFF;
+        }
+
+        uint16_t orMask() const {
+            return _functionCode22() ? (_payload[2] << 8) | _payload[3] : 0x0000;
+        }
+
+        /*
+        Typed view on the request payload, e.g. of a fc 16 write.
+        */
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        PayloadView<V, O> as() const {
+            return PayloadView<V, O>{_payload, this->_byteCount};
+        }
         
         RequestHandler<T> handler() const {
             return _handler;
@@ -220,36 +379,61 @@ class ModbusResponse: public ResponseBase<T>{
         uint16_t _quantity{0};
         uint8_t* _payload{nullptr};
         uint8_t* _mapping{nullptr};
+        MappingSource* _source{nullptr};
         uint8_t _sendLen{0};
         uint8_t _registerLen{2};
+        uint16_t _registerCount{0};
         uint16_t _requestAddress{};
+        uint16_t _writeAddress{0};
+        uint16_t _writeQuantity{0};
+        bool _deferred{false};
+        // table routing to the response, nullptr once removed
+        ModbusUnit<T>* _owner{nullptr};
+
+        void _routesChanged(){
+            if (_owner){
+                _owner->_routesStale = true;
+            }
+        }
+
 
+        void _update(const RequestContext &request){
+            this->_byteCount = request.byteCount;
+            this->_quantity = request.quantity;
+            this->_payload = request.data;
+            _requestAddress = request.address;
+            _writeAddress = request.writeAddress;
+            _writeQuantity = request.writeQuantity;
+        }
 
-        void _update(RequestParser *parser){
-            this->_byteCount = parser->byteCount();
-            this->_quantity = parser->quantity();
-            this->_payload = parser->data();
-            _requestAddress = parser->address();
+        bool _functionCode22() const {
+            return this->_functionCode == FC_MASK_WRITE_REGISTER && _payload;
         }
 
         void _callHandler(){
             if (_handler) {
                 _handler(this);
             } 
-            if (!this->_sent && _mapping){
+            if (!this->_sent && !_deferred && (_mapping || _source)){
                 _handleMapping();
             }
+            _deferred = false;
             this->_reset();
         }
 
         void _handleMapping(){
+            if (this->_functionCode == FC_MASK_WRITE_REGISTER || this->_functionCode == FC_READ_WRITE_REGISTERS){
+                _handleMappedWrite();
+                return;
+            }
             uint16_t offset = _requestAddress - this->_myAddress;
             uint8_t byteCount = _registerLen * _quantity - offset;
             if (byteCount <= _sendLen){
+                const uint8_t *mapping{_source ? _source->snapshot() : _mapping};
                 this->_sendHeader();
                 this->_write(byteCount);
                 for (; offset <byteCount; offset++){
-                    this->_write(_mapping[offset]);
+                    this->_write(mapping[offset]);
                 }
                 this->_sendCRC();
 
@@ -258,6 +442,211 @@ class ModbusResponse: public ResponseBase<T>{
             }
         }
 
+        /*
+        fc 22 and 23 on a with() mapping of 16 bit registers.
+        A MappingSource is read only.
+        */
+        void _handleMappedWrite(){
+            if (!_mapping || _registerLen != 2){
+                this->sendException(ErrorCode::illegalFunction);
+                return;
+            }
+            uint16_t registers{static_cast<uint16_t>(_sendLen / 2)};
+            uint16_t readOffset = _requestAddress - this->_myAddress;
+            uint16_t writeOffset = _writeAddress - this->_myAddress;
+            if (_requestAddress < this->_myAddress || _writeAddress < this->_myAddress
+                || readOffset + _quantity > registers || writeOffset + _writeQuantity > registers){
+                this->sendException(ErrorCode::illegalDataAddress);
+                return;
+            }
+            if (this->_functionCode == FC_MASK_WRITE_REGISTER){
+                uint8_t *reg{_mapping + 2 * writeOffset};
+                uint16_t value = (reg[0] << 8) | reg[1];
+                value = (value & andMask()) | (orMask() & ~andMask());
+                reg[0] = highByte(value);
+                reg[1] = lowByte(value);
+                sendEcho();
+                return;
+            }
+            // fc 23 writes before it reads
+            memcpy(_mapping + 2 * writeOffset, _payload, 2 * _writeQuantity);
+            send(_mapping + 2 * readOffset, 2 * _quantity);
+        }
+
+};
+
+/*
+A response completed after its handler returned. See ModbusResponse::defer.
+Completion is thread safe. The reply itself is sent by the server task.
+Exactly one of send, sendEcho or sendException completes the response.
+They return false if the response was already completed or timed out.
+*/
+template <typename T>
+class DeferredResponse: private ResponseBase<T>{
+    template <typename>
+    friend class ModbusServer;
+    friend class ModbusResponse<T>;
+
+    public:
+        using ResponseBase<T>::functionCode;
+        using ResponseBase<T>::unitId;
+
+        /*
+        Start address of the request.
+        */
+        uint16_t address() const {
+            return this->_myAddress;
+        }
+
+        uint16_t quantity() const {
+            return _quantity;
+        }
+
+        uint8_t byteCount() const {
+            return this->_byteCount;
+        }
+
+        /*
+        Payload of the request. Valid until the response is completed.
+        */
+        const uint8_t* payload() const {
+            return _payload;
+        }
+
+        /*
+        Sends payload (fc 01 - 04, 23).
+        */
+        bool send(const uint8_t* payload, uint8_t len){
+            if ((this->_functionCode > 0x04 && this->_functionCode != FC_READ_WRITE_REGISTERS) || len > MODERNBUS_DEFERRED_PAYLOAD || !_acquire()){
+                return false;
+            }
+            memmove(_payload, payload, len);
+            _length = len;
+            _kind = _payloadReply;
+            _release();
+            return true;
+        }
+
+        /*
+        Echoes the request (fc 05, 06, 15, 16, 22).
+        */
+        bool sendEcho(){
+            if (!_acquire()){
+                return false;
+            }
+            _kind = _echoReply;
+            _release();
+            return true;
+        }
+
+        bool sendException(uint8_t exceptionCode){
+            if (!_acquire()){
+                return false;
+            }
+            _exceptionCode = exceptionCode;
+            _kind = _exceptionReply;
+            _release();
+            return true;
+        }
+
+        bool sendException(ErrorCode errorCode){
+            return sendException(static_cast<uint8_t>(errorCode));
+        }
+
+        /*
+        True while waiting for completion.
+        */
+        bool isPending() const {
+            return __atomic_load_n(&_state, __ATOMIC_ACQUIRE) == _pending;
+        }
+
+        /*
+        Number of deferred responses answered busy after their timeout.
+        */
+        uint16_t expiredCount() const {
+            return _expired;
+        }
+
+    private:
+        enum : uint8_t {_idle, _pending, _completing, _ready};
+        enum : uint8_t {_payloadReply, _echoReply, _exceptionReply};
+
+        uint8_t _state{_idle};
+        uint8_t _kind{_exceptionReply};
+        uint8_t _exceptionCode{SLAVE_DEVICE_BUSY};
+        uint16_t _quantity{0};
+        uint8_t _length{0};
+        uint32_t _deferredAt{0};
+        uint32_t _timeout{0};
+        uint16_t _expired{0};
+        uint8_t _payload[MODERNBUS_DEFERRED_PAYLOAD];
+
+        DeferredResponse(ModbusServer<T>* server)
+        :   ResponseBase<T>::ResponseBase{0, 0, 0, server}
+        {}
+
+        // server task. Takes the context of the request.
+        void _start(const ModbusResponse<T> &response, uint32_t timeout){
+            this->_slaveAddress = response._slaveAddress;
+            this->_functionCode = response._functionCode;
+            this->_myAddress = response._requestAddress;
+            this->_byteCount = response._byteCount;
+            _quantity = response._quantity;
+            _length = response._byteCount > MODERNBUS_DEFERRED_PAYLOAD ? MODERNBUS_DEFERRED_PAYLOAD : response._byteCount;
+            if (response._payload){
+                memcpy(_payload, response._payload, _length);
+            }
+            _deferredAt = millis();
+            _timeout = timeout;
+            __atomic_store_n(&_state, _pending, __ATOMIC_RELEASE);
+        }
+
+        bool _acquire(){
+            uint8_t expected{_pending};
+            return __atomic_compare_exchange_n(&_state, &expected, _completing, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+        }
+
+        void _release(){
+            __atomic_store_n(&_state, _ready, __ATOMIC_RELEASE);
+        }
+
+        /*
+        Server task. Sends the completed reply or busy once timed out.
+        Returns true if a reply was sent.
+        */
+        bool _flush(){
+            if (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) != _ready){
+                if (!isPending() || millis() - _deferredAt < _timeout || !sendException(SLAVE_DEVICE_BUSY)){
+                    return false;
+                }
+                _expired++;
+            }
+            switch (_kind){
+                case _payloadReply:
+                    this->_sendHeader();
+                    this->_write(_length);
+                    this->_sendPayload(_payload, _length);
+                    this->_sendCRC();
+                    break;
+                case _echoReply:
+                    this->_sendHeader();
+                    this->_sendTwoBytes(this->_myAddress);
+                    if (this->_functionCode == 5 || this->_functionCode == 6){
+                        this->_sendPayload(_payload, 2);
+                    } else if (this->_functionCode == FC_MASK_WRITE_REGISTER){
+                        this->_sendPayload(_payload, 4);
+                    } else {
+                        this->_sendTwoBytes(_quantity);
+                    }
+                    this->_sendCRC();
+                    break;
+                default:
+                    this->_sendException(_exceptionCode);
+                    break;
+            }
+            __atomic_store_n(&_state, _idle, __ATOMIC_RELEASE);
+            return true;
+        }
 };
 
 template <typename T>
@@ -294,39 +683,240 @@ class ModbusExceptionResponse: public ResponseBase<T>{
 };
 
 
+/*
+Answers requests straight from a RegisterBank. Used by the server only.
+*/
+template <typename T>
+class BankResponse: public ResponseBase<T>{
+    template <typename>
+    friend class ModbusServer;
+
+    private:
+        BankResponse(uint8_t slaveAddress, ModbusServer<T>* server)
+        :   ResponseBase<T>::ResponseBase{slaveAddress, 0, 0, server}
+        {}
+
+        void _serve(RegisterBankBase &bank, const RequestContext &request){
+            uint8_t functionCode{request.functionCode};
+            uint16_t address{request.address};
+            uint16_t quantity{request.quantity};
+            const uint8_t *data{request.data};
+            this->_functionCode = functionCode;
+            this->_myAddress = address;
+
+            ErrorCode error{functionCode == FC_READ_WRITE_REGISTERS
+                ? bank.validateReadWrite(address, quantity, request.writeAddress, request.writeQuantity, request.byteCount)
+                : bank.validate(functionCode, address, quantity, request.byteCount)};
+            if (error == ErrorCode::noError && functionCode == 5 && !((data[0] == 0xFF || data[0] == 0x00) && data[1] == 0x00)){
+                error = ErrorCode::illegalDataValue;
+            }
+            if (error != ErrorCode::noError){
+                this->sendException(error);
+                this->_size = 5;
+                return;
+            }
+
+            this->_sendHeader();
+            switch (functionCode){
+                case 1:
+                case 2: {
+                    uint8_t byteCount = (quantity + 7) / 8;
+                    this->_write(byteCount);
+                    for (uint8_t idx = 0; idx < byteCount; idx++){
+                        this->_write(bank.packedBits(functionCode, address, quantity, idx));
+                    }
+                    this->_size = 5 + byteCount;
+                    break;
+                }
+                case 3:
+                case 4:
+                case FC_READ_WRITE_REGISTERS: {
+                    if (functionCode == FC_READ_WRITE_REGISTERS){
+                        bank.write(functionCode, request.writeAddress, request.writeQuantity, data);
+                    }
+                    uint8_t byteCount = 2 * quantity;
+                    const uint8_t *registers{bank.registerBytes(functionCode, address)};
+                    this->_write(byteCount);
+                    for (uint8_t idx = 0; idx < byteCount; idx++){
+                        this->_write(registers[idx]);
+                    }
+                    this->_size = 5 + byteCount;
+                    break;
+                }
+                case 5:
+                case 6:
+                    bank.write(functionCode, address, 1, data);
+                    this->_sendTwoBytes(address);
+                    this->_write(data[0]);
+                    this->_write(data[1]);
+                    this->_size = 8;
+                    break;
+                case FC_MASK_WRITE_REGISTER:
+                    bank.write(functionCode, address, 1, data);
+                    this->_sendTwoBytes(address);
+                    for (uint8_t idx = 0; idx < 4; idx++){
+                        this->_write(data[idx]);
+                    }
+                    this->_size = 10;
+                    break;
+                default:
+                    // 15, 16
+                    bank.write(functionCode, address, quantity, data);
+                    this->_sendTwoBytes(address);
+                    this->_sendTwoBytes(quantity);
+                    this->_size = 8;
+                    break;
+            }
+            this->_sendCRC();
+        }
+};
+
+
+/*
+Handler table of one or more unit ids (slave addresses) of a server.
+Holds the responses, their routing index and an optional register bank.
+*/
+template <typename T>
+class ModbusUnit{
+    template <typename>
+    friend class ModbusServer;
+    friend class ModbusResponse<T>;
+
+    public:
+        ModbusUnit(const ModbusUnit&) = delete;
+
+        ~ModbusUnit(){
+            _responses.iter.reset();
+            while(_responses.iter()){
+                delete _responses.iter.next();
+            }
+        };
+
+        /*
+        Adds a response. handler is called when a request of functionCode to address arrives.
+        */
+        ModbusResponse<T>& responseTo(uint8_t functionCode, uint16_t address, RequestHandler<T> handler = nullptr){
+            ModbusResponse<T>* response = new ModbusResponse<T>{
+                _unitId,
+                functionCode,
+                address,
+                handler,
+                _server
+            };
+            response->_owner = this;
+            _responses.append(response);
+            _routesStale = true;
+            return *response;
+        };
+
+        /*
+        Removes the response if found. Else returns nullptr.
+        Transfers ownership/memory management to caller
+        */
+        ModbusResponse<T>* remove(ModbusResponse<T> *response){
+            int16_t idx = _responses.index(response);
+            ModbusResponse<T>* removed{_responses.remove(idx)};
+            if (removed){
+                removed->_owner = nullptr;
+            }
+            _routesStale = true;
+            return removed;
+        };
+
+        /*
+        Serves fc 01 - 06, 15, 16, 22 and 23 straight from bank.
+        Responses registered by responseTo take precedence.
+        */
+        void serve(RegisterBankBase &bank){
+            _bank = &bank;
+        };
+
+        /*
+        Number of responses dropped from routing. See ModbusServer::overlapCount.
+        */
+        uint16_t overlapCount(){
+            return _routing().overlaps();
+        };
+
+        /*
+        First unit id served by this table.
+        */
+        uint8_t unitId() const {
+            return _unitId;
+        };
+
+    private:
+        ModbusUnit(uint8_t unitId, ModbusServer<T>* server)
+        :   _unitId{unitId},
+            _server{server}
+        {};
+
+        uint8_t _unitId;
+        ModbusServer<T>* _server;
+        TinyLinkedList<ModbusResponse<T>*> _responses{};
+        RouteTable<ModbusResponse<T>> _routes{};
+        // responses were added, removed or changed since the last build
+        bool _routesStale{false};
+        RegisterBankBase *_bank{nullptr};
+
+        /*
+        The routing index, rebuilt if responses changed. Registering many
+        responses thus sorts once, at start or on the first request.
+        */
+        RouteTable<ModbusResponse<T>>& _routing(){
+            if (_routesStale){
+                _routesStale = false;
+                _routes.clear(_responses.size());
+                _responses.iter.reset();
+                while (_responses.iter()){
+                    ModbusResponse<T>* response{_responses.iter.next()};
+                    _routes.add(response->functionCode(), response->address(), response->registerCount(), response);
+                }
+                _routes.build();
+            }
+            return _routes;
+        };
+};
+
+
 template <typename T>
 class ModbusServer{
     friend class ResponseBase<T>;
     friend class ModbusResponse<T>;
     friend class ModbusExceptionResponse<T>;
+    friend class BankResponse<T>;
+    friend class ModbusUnit<T>;
+    friend class DeferredResponse<T>;
     public:
-        ModbusServer(Scheduler *scheduler, T *provider, uint8_t myAddress)
+        ModbusServer(ExecutorLoop *scheduler, T *provider, uint8_t myAddress)
         :   _scheduler{scheduler},
             _provider{provider},
             _slaveAddress{myAddress},
-            _exceptionResponse{myAddress, this}
+            _exceptionResponse{myAddress, this},
+            _bankResponse{myAddress, this},
+            _primary{myAddress, this},
+            _unit{&_primary},
+            _unitId{myAddress}
         {
-            _parser.setOnCompleteCB([this](RequestParser *_){_onComplete();});
-            _parser.setOnErrorCB([this](RequestParser *_){_onParserError();});
             _parser.setSlaveAddress(myAddress);
             _scheduler->addTask(_mainTask);
+            // requests are retrieved as soon as data arrives
+            _mainTask.watch(_provider->_descriptor());
+            _mainTask.wakeOnData(true);
         };
 
-        ~ModbusServer(){_free();};
+        ~ModbusServer(){
+            _free();
+            _scheduler->deleteTask(_mainTask);
+            delete [] _unitTable;
+            delete _deferred;
+        };
 
         /*
         Adds a response to the server. The server will listen and call handler when found.
         */
         ModbusResponse<T>& responseTo(uint8_t functionCode, uint16_t address, RequestHandler<T> handler){
-            ModbusResponse<T>* response = new ModbusResponse<T>{
-                _slaveAddress,
-                functionCode,
-                address,
-                handler,
-                this
-            };
-            _responses.append(response);
-            return *response;
+            return _primary.responseTo(functionCode, address, handler);
         };
 
         /*
@@ -334,15 +924,52 @@ class ModbusServer{
         through with method of the ModbusResponse object.
         */
         ModbusResponse<T>& responseTo(uint8_t functionCode, uint16_t address){
-            ModbusResponse<T>* response = new ModbusResponse<T>{
-                _slaveAddress,
-                functionCode,
-                address,
-                nullptr,
-                this
-            };
-            _responses.append(response);
-            return *response;
+            return _primary.responseTo(functionCode, address);
+        };
+
+        /*
+        Returns the handler table of unitId and serves unitId from now on.
+        The server's own address is served by the table responseTo adds to.
+
+            server.unit(2).responseTo(03, 0x0000, handler);
+        */
+        ModbusUnit<T>& unit(uint8_t unitId){
+            _allocateUnitTable();
+            if (!_unitTable[unitId]){
+                _unitTable[unitId] = _addUnit(unitId);
+            }
+            return *_unitTable[unitId];
+        };
+
+        /*
+        Returns one handler table serving all unit ids from first to last.
+        Ids already served keep their own table. If all of them are served,
+        no table is added and the one of first is returned.
+        Use ModbusResponse::unitId() to tell the addressed unit apart.
+        */
+        ModbusUnit<T>& units(uint8_t first, uint8_t last){
+            _allocateUnitTable();
+            uint16_t unitId{first};
+            while (unitId <= last && _unitTable[unitId]){
+                unitId++;
+            }
+            if (unitId > last){
+                return unit(first);
+            }
+            ModbusUnit<T> *table{_addUnit(unitId)};
+            for (; unitId <= last; unitId++){
+                if (!_unitTable[unitId]){
+                    _unitTable[unitId] = table;
+                }
+            }
+            return *table;
+        };
+
+        /*
+        True if requests to unitId are answered.
+        */
+        bool serves(uint8_t unitId) const {
+            return _unitTable ? _unitTable[unitId] != nullptr : unitId == _slaveAddress;
         };
 
 
@@ -361,13 +988,31 @@ class ModbusServer{
         Transfers ownership/memory management to caller
         */
         ModbusResponse<T>* remove(ModbusResponse<T> *response){
-            size_t idx{_responses.index(response)};
-            return _responses.remove(idx);
+            return _primary.remove(response);
+        }
+
+        /*
+        Serves fc 01 - 06, 15, 16, 22 and 23 straight from bank.
+        Responses registered by responseTo take precedence.
+        */
+        void serve(RegisterBankBase &bank){
+            _primary.serve(bank);
+        }
+
+        /*
+        Number of responses dropped from routing, as their range overlaps
+        with another response of the same function code.
+        Up to date right after each responseTo, range or with. The routing
+        index is rebuilt on the call if responses changed.
+        */
+        uint16_t overlapCount(){
+            return _primary.overlapCount();
         }
 
 
         void start(){
             if (!_isRunning){
+                _buildRoutes();
                 _isRunning = true;
                 _mainTask.set(
                     _pollingInterval,
@@ -392,6 +1037,15 @@ class ModbusServer{
             return _slaveAddress;
             };
 
+        /*
+        Receives requests into buffer of MODBUS_MAX_FRAME_SIZE bytes, owned by the caller.
+        Request data handed to handlers points into it. Set before start.
+        Required with MODERNBUS_EXTERNAL_FRAME_BUFFER.
+        */
+        void setFrameBuffer(uint8_t *buffer){
+            _parser.setFrameBuffer(buffer);
+        };
+
         /*
         The intervall in wich the provider is polled for new data
         default: 100 ms
@@ -406,7 +1060,16 @@ class ModbusServer{
             return _errorCount;
         }
 
-        RequestParser& getParser(){
+#ifdef MODERNBUS_METRICS
+        /*
+        Request, exception and latency metrics. Snapshot and reset from any thread.
+        */
+        ServerMetrics& metrics(){
+            return _metrics;
+        }
+#endif
+
+        FrameParser& getParser(){
             return _parser;
         }
 
@@ -415,74 +1078,183 @@ class ModbusServer{
         }
 
     protected:
-        Scheduler *_scheduler;
+        ExecutorLoop *_scheduler;
         T* _provider;
-        RequestParser _parser{};
+        FrameParser _parser{true};
         uint8_t _slaveAddress{};
         
-        Task _mainTask{};
+        ExecutorTimer _mainTask{};
         uint32_t _pollingInterval{100};
 
         uint16_t _errorCount{};
 
         bool _isRunning {false};
 
-        TinyLinkedList<ModbusResponse<T>*> _responses{};
         ModbusExceptionResponse<T> _exceptionResponse{};
+        BankResponse<T> _bankResponse;
+        ModbusUnit<T> _primary;
+        // 256 entry table by unit id. Only allocated if more than one unit is served.
+        ModbusUnit<T> **_unitTable{nullptr};
+        TinyLinkedList<ModbusUnit<T>*> _units{};
+        // table and id of the frame being received
+        ModbusUnit<T> *_unit;
+        uint8_t _unitId{};
+        // allocated by the first deferred response
+        DeferredResponse<T> *_deferred{nullptr};
+        RequestContext _request{};
+        // time the last request byte was taken from the provider
+        uint32_t _lastByteAt{0};
+#ifdef MODERNBUS_METRICS
+        ServerMetrics _metrics{};
+        uint32_t _frameStart{0};
+        uint32_t _completedAt{0};
+        bool _awaitingReply{false};
+#endif
         
         /*
         This method polls the provider for data
         The polling is driven by the scheduler every intervall.
         */
         void _retrieveRequest(){
+            if (_deferred && _deferred->_flush()){
+                _mainTask.delay(_provider->_calculateTXTime(_deferred->_size));
+                return;
+            }
             // while provider could deliver more than just frame we additional check 
             while (_provider->available()){
-                uint8_t msg = _provider->read();
-                _parser.parse(msg);
+                if (_parser.isIdle()){
+                    uint8_t msg = _provider->read();
+                    if (_unitTable && _unitTable[msg]){
+                        // a frame to a served unit starts. Let the parser accept it.
+                        _parser.setSlaveAddress(msg);
+                        _unit = _unitTable[msg];
+                        _unitId = msg;
+                    }
+#ifdef MODERNBUS_METRICS
+                    _frameStart = micros();
+#endif
+                    MODERNBUS_TRACE_POINT(serverReceive, this, 1);
+                    _parser.parse(&msg, 1);
+                    _lastByteAt = micros();
+                } else {
+                    // never more than the frame lacks, the rest may be the next frame
+                    uint8_t chunk[MODERNBUS_READ_CHUNK];
+                    size_t len{_provider->available()};
+                    if (len > _parser.dataToReceive()){
+                        len = _parser.dataToReceive();
+                    }
+                    if (len > sizeof(chunk)){
+                        len = sizeof(chunk);
+                    }
+                    len = _provider->readBytes(chunk, len);
+                    MODERNBUS_TRACE_POINT(serverReceive, this, len);
+                    _parser.parse(chunk, len);
+                    _lastByteAt = micros();
+                }
+                if (_parser.isComplete()){
+                    _onComplete();
+                } else if (_parser.isError()){
+                    _onParserError();
+                }
             }
             // inform provider that we have not reached the end of the frame
-            if (_parser.state() != ParserState::slaveAddress && !_parser.isComplete() && !_parser.isError()){
+            if (!_parser.isIdle()){
                 _provider->_informNotComplete(_parser.dataToReceive());
-                _parser.reset();
+                // the rest may still be on the line. Drop the frame once the line was silent for longer than a frame gap.
+                if (micros() - _lastByteAt > _frameGap()){
+                    _parser.reset();
+                }
+            }
+            if (_deferred && _deferred->isPending()){
+                // completion may come from any thread. Poll for it.
+                _mainTask.delay(1);
             }
         }
 
+        /*
+        Silence in us after which a partial frame is dropped.
+        3.5 characters rounded up to full ms plus 1 ms.
+        */
+        uint32_t _frameGap(){
+            return (_provider->_calculateTXTime(4) + 1) * 1000UL;
+        }
+
         void _onComplete(){
+            MODERNBUS_TRACE_POINT(serverComplete, this, _parser.frameLength());
+            _request.update(_parser);
+            _serveRequest();
+        }
+
+        void _serveRequest(){
+            _selectUnit();
+#ifdef MODERNBUS_METRICS
+            _completedAt = micros();
+            _awaitingReply = true;
+            _metrics.parse().record(_completedAt - _frameStart);
+            _metrics.request(_request.functionCode);
+#endif
+            if (_deferred && _deferred->isPending()){
+                // still busy with the deferred request
+                _exceptionResponse._functionCode = _request.functionCode;
+                _exceptionResponse._sendException(SLAVE_DEVICE_BUSY);
+                return;
+            }
             // the parser does not recognize if a function code or address is wrong
             // so the server needs to throw an exception in that case
+#ifdef MODERNBUS_METRICS
+            uint32_t handlerStart = micros();
+#endif
             ModbusResponse<T>* response{_findResponse()};
             if (response){
-                response->_update(&_parser);
+                response->_slaveAddress = _unitId;
+                response->_update(_request);
                 response->_callHandler();
                 // as long tx we do not need poll
                 size_t txDelay = _provider->_calculateTXTime(response->_size);
                 _mainTask.delay(txDelay);
+            } else if (_unit->_bank && _unit->_bank->serves(_request.functionCode)){
+                _bankResponse._serve(*_unit->_bank, _request);
+                _mainTask.delay(_provider->_calculateTXTime(_bankResponse._size));
             } else {
                 _onServerError();
             }
+#ifdef MODERNBUS_METRICS
+            _metrics.handler().record(micros() - handlerStart);
+#endif
         }
 
         ModbusResponse<T>* _findResponse(){
-            ModbusResponse<T>* response{nullptr};
-            _responses.iter.reset();
-            while (_responses.iter()){
-                response = _responses.iter.next();
-                
-                if (response->functionCode() == _parser.functionCode()){
-                    
-                    if (_parser.address() >= response->address()){  
-                        return response;
-                    } else {
-                        _exceptionResponse._errorCode = ErrorCode::illegalDataAddress;
-                    }
-                } else {
-                    _exceptionResponse._errorCode = ErrorCode::illegalFunction;
-                }
+            ErrorCode error{ErrorCode::noError};
+            ModbusResponse<T>* response{_unit->_routing().find(_request.functionCode, _request.address, _requestQuantity(), error)};
+            if (!response){
+                _exceptionResponse._errorCode = error;
+                _exceptionResponse._functionCode = _request.functionCode;
+                _exceptionResponse._myAddress = _request.address;
+            }
+            return response;
+        }
 
+        /*
+        Registers addressed by the request. fc 05, 06 and 22 address a single one.
+        */
+        uint16_t _requestQuantity() const {
+            uint8_t functionCode{_request.functionCode};
+            if (functionCode == 5 || functionCode == 6 || functionCode == FC_MASK_WRITE_REGISTER){
+                return 1;
+            }
+            return _request.quantity;
+        }
+
+        /*
+        Builds the routing index of units whose responses changed.
+        Else the first request to a unit builds it.
+        */
+        void _buildRoutes(){
+            _primary._routing();
+            _units.iter.reset();
+            while (_units.iter()){
+                _units.iter.next()->_routing();
             }
-            _exceptionResponse._functionCode = _parser.functionCode();
-            _exceptionResponse._myAddress = _parser.address();
-            return nullptr;
         }
 
         void _onServerError(){
@@ -498,19 +1270,72 @@ class ModbusServer{
         Assign Request Address and Function code
         */
         void _onParserError(){
+            MODERNBUS_TRACE_POINT(serverError, this, static_cast<uint16_t>(_parser.errorCode()));
+            _selectUnit();
             _errorCount++;
+#ifdef MODERNBUS_METRICS
+            _metrics.parserError();
+#endif
             _exceptionResponse._errorCode = _parser.errorCode();
             _exceptionResponse._functionCode = _parser.functionCode();
             _onServerError();
         }
 
 
+        /*
+        Addresses all responses of the current frame to its unit.
+        */
+        void _selectUnit(){
+            _exceptionResponse._slaveAddress = _unitId;
+            _bankResponse._slaveAddress = _unitId;
+        }
+
+        /*
+        Called right before the first byte of a response is written.
+        */
+        void _onTransmit(){
+            MODERNBUS_TRACE_POINT(serverTransmit, this, 0);
+#ifdef MODERNBUS_METRICS
+            if (_awaitingReply){
+                _awaitingReply = false;
+                _metrics.turnaround().record(micros() - _completedAt);
+            }
+#endif
+        }
+
+        void _onException(uint8_t exceptionCode){
+#ifdef MODERNBUS_METRICS
+            _metrics.exception(exceptionCode);
+#else
+            (void)exceptionCode;
+#endif
+        }
+
+        DeferredResponse<T>& _deferredResponse(){
+            if (!_deferred){
+                _deferred = new DeferredResponse<T>{this};
+            }
+            return *_deferred;
+        }
+
+        void _allocateUnitTable(){
+            if (!_unitTable){
+                _unitTable = new ModbusUnit<T>*[256]{};
+                _unitTable[_slaveAddress] = &_primary;
+            }
+        }
+
+        ModbusUnit<T>* _addUnit(uint8_t unitId){
+            ModbusUnit<T> *unit{new ModbusUnit<T>{unitId, this}};
+            _units.append(unit);
+            return unit;
+        }
+
         void _free(){
             end();
-            _responses.iter.reset();
-            while(_responses.iter()){
-                auto r = _responses.iter.next();
-                delete r;
+            _units.iter.reset();
+            while(_units.iter()){
+                delete _units.iter.next();
             }
         }   
 };
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <mbparser.h>
 
+#include "modernbus_payload.h"
+
 
 class ServerResponse;
 // avoid circular reference
@@ -16,19 +18,32 @@ class ModbusRequest;
     #include <functional>
     using ResponseHandler = std::function<void(ServerResponse *response)>;
     using ErrorHandler = std::function<void(ServerResponse *response, ErrorCode errorCode)>;
+    using WriteHandler = std::function<void(uint16_t address, ErrorCode errorCode)>;
 #endif
 
 #ifndef STD_FUNCTIONAL
     using ResponseHandler = void(*)(ServerResponse *response);
-    using ErrorHanlder = void(*)(ServerResponse *response, ErrorCode errorCode);
+    using ErrorHandler = void(*)(ServerResponse *response, ErrorCode errorCode);
+    using WriteHandler = void(*)(uint16_t address, ErrorCode errorCode);
 #endif
 
 
+/*
+Receives the payload of each successful response before the handler is called.
+See ProcessImage for a lock free implementation.
+*/
+class ResponseSink{
+    public:
+        virtual void publish(const uint8_t* payload, uint16_t len, uint32_t timestamp) = 0;
+        virtual ~ResponseSink() = default;
+};
+
+
 /*
 SeverResponse is dataclass abstracting a modbus server/slave response.
 */
 class ServerResponse{
-    template <typename>
+    template <typename, uint16_t, uint16_t>
     friend class ModbusClient;
     friend class ModbusRequest;
     public:
@@ -39,6 +54,18 @@ class ServerResponse{
         uint8_t *payload() const {return _payload;};
         uint16_t byteCount() const {return _byteCount;};
 
+        /*
+        Typed view on the payload, e.g. response->as<float, WordOrder::CDAB>()[0].
+        Views assume the wire order. Do not combine with the swap option of the request.
+        */
+        template <typename V, WordOrder O = WordOrder::ABCD>
+        PayloadView<V, O> as() const {return PayloadView<V, O>{_payload, _byteCount};};
+
+        /*
+        Bit view on the payload of coils and discrete inputs (fc 01, 02).
+        */
+        BitView bits() const {return BitView{_payload, _byteCount};};
+
     private:
         ServerResponse(ModbusRequest *request);
         ModbusRequest *_request;
@@ -0,0 +1,348 @@
+#if !defined(MODERNBUS_SNIFFER_H)
+#define MODERNBUS_SNIFFER_H
+
+#include <Arduino.h>
+#include "modernbus_executor.h"
+#include "modernbus_frame.h"
+#include "modernbus_util.h"
+#include "modernbus_frame_parser.h"
+
+
+/*
+One frame seen on the bus. data is valid during the handler only.
+*/
+struct SniffedFrame{
+    const uint8_t *data{nullptr};
+    uint16_t length{0};
+    // micros() at the first byte
+    uint32_t timestamp{0};
+};
+
+/*
+A request and its response as seen on the bus.
+request.length is 0 if the sniffer missed the request,
+response.length is 0 for broadcasts and unanswered requests.
+*/
+struct SniffedTransaction{
+    uint8_t slaveAddress{0};
+    // without the exception bit
+    uint8_t functionCode{0};
+    uint16_t address{0};
+    uint16_t quantity{0};
+    // 0 unless answered with an exception
+    uint8_t exceptionCode{0};
+    SniffedFrame request{};
+    SniffedFrame response{};
+
+    bool isBroadcast() const {
+        return slaveAddress == 0;
+    }
+
+    bool isAnswered() const {
+        return response.length > 0;
+    }
+
+    /*
+    First request byte to first response byte in us. 0 if not both seen.
+    */
+    uint32_t responseTime() const {
+        return request.length && response.length ? response.timestamp - request.timestamp : 0;
+    }
+};
+
+#ifndef STD_FUNCTIONAL
+    using SnifferHandler = void(*)(const SniffedTransaction &transaction);
+#endif
+
+#ifdef STD_FUNCTIONAL
+    #include <functional>
+
+    using SnifferHandler = std::function<void(const SniffedTransaction &transaction)>;
+#endif
+
+
+/*
+Listen only monitor of a RTU bus. Never writes to the provider.
+
+The byte stream is split into frames by the inter frame gap (t3.5)
+and by crc plus the frame length the header announces, so frames
+read back to back in one batch are split as well.
+A frame answering the pending request (same slave address and function code)
+is its response, any other frame a new request.
+
+    BusSniffer<SerialProvider<HardwareSerial>> sniffer{&scheduler, &provider, 921600};
+    sniffer.onTransaction([](const SniffedTransaction &t){ ... });
+    sniffer.start();
+
+Frames are kept in two fixed buffers, the handler gets views on them.
+Nothing is allocated while sniffing.
+*/
+template <typename T>
+class BusSniffer{
+    public:
+        BusSniffer(ExecutorLoop *scheduler, T *provider, uint32_t baudRate)
+        :   _scheduler{scheduler},
+            _provider{provider},
+            // 11 bits per character
+            _charTime{static_cast<uint32_t>(11000000UL / baudRate)},
+            // fixed above 19200 baud by the spec
+            _frameGap{static_cast<uint32_t>(baudRate > 19200 ? 1750 : 38500000UL / baudRate)}
+        {
+            _scheduler->addTask(_mainTask);
+            _mainTask.watch(_provider->_descriptor());
+            _mainTask.wakeOnData(true);
+        };
+
+        BusSniffer(const BusSniffer&) = delete;
+
+        ~BusSniffer(){
+            _scheduler->deleteTask(_mainTask);
+        };
+
+        /*
+        Called for each transaction. Also called for unanswered requests
+        once the next request starts or the response timeout passed.
+        */
+        void onTransaction(SnifferHandler handler){
+            _handler = handler;
+        };
+
+        /*
+        Time a slave may take to answer. default: 1000 ms
+        */
+        void setResponseTimeout(uint32_t ms){
+            _responseTimeout = ms * 1000;
+        };
+
+        /*
+        The interval in which the provider is polled.
+        Keep it below the time the receive buffer takes to fill. default: 1 ms
+        */
+        void setInterval(uint32_t t){
+            _pollingInterval = t;
+            _mainTask.setInterval(_pollingInterval);
+        };
+
+        void start(){
+            if (!_isRunning){
+                _isRunning = true;
+                _mainTask.set(
+                    _pollingInterval,
+                    TASK_FOREVER,
+                    [this](){_receive();}
+                );
+                _mainTask.enable();
+            }
+        };
+
+        void end(){
+            if (_isRunning){
+                _isRunning = false;
+                _mainTask.disable();
+            }
+        };
+
+        bool isRunning() const {
+            return _isRunning;
+        };
+
+        /*
+        Frames with valid crc.
+        */
+        uint32_t frameCount() const {
+            return _frameCount;
+        };
+
+        /*
+        Frames dropped as their crc or length did not fit.
+        */
+        uint32_t errorCount() const {
+            return _errorCount;
+        };
+
+    private:
+        ExecutorLoop *_scheduler;
+        T *_provider;
+        ExecutorTimer _mainTask{};
+        uint32_t _pollingInterval{1};
+        bool _isRunning{false};
+        SnifferHandler _handler{nullptr};
+
+        uint32_t _charTime;
+        uint32_t _frameGap;
+        uint32_t _responseTimeout{1000000UL};
+
+        // frame being received and pending request. Swapped, never copied.
+        uint8_t _buffers[2][MODBUS_MAX_FRAME_SIZE];
+        uint8_t *_frame{_buffers[0]};
+        uint8_t *_request{_buffers[1]};
+        uint16_t _length{0};
+        uint16_t _crc{0xFFFF};
+        uint32_t _frameStart{0};
+        uint32_t _lastByte{0};
+
+        bool _pending{false};
+        uint16_t _requestLength{0};
+        uint32_t _requestStart{0};
+        uint32_t _requestEnd{0};
+
+        uint32_t _frameCount{0};
+        uint32_t _errorCount{0};
+
+        void _receive(){
+            uint32_t now{static_cast<uint32_t>(micros())};
+            size_t count{_provider->available()};
+            if (!count){
+                _checkTimeout(now);
+                return;
+            }
+            // the batch arrived back to back, its last byte just now
+            uint32_t at{static_cast<uint32_t>(now - (count - 1) * _charTime)};
+            if (_length && static_cast<int32_t>(at - _lastByte) > static_cast<int32_t>(_frameGap)){
+                // silence in the middle of a frame
+                _drop();
+            }
+            if (static_cast<int32_t>(at - _lastByte) < static_cast<int32_t>(_charTime)){
+                at = _lastByte + _charTime;
+            }
+            while (count--){
+                _onByte(_provider->read(), at);
+                at += _charTime;
+            }
+            _lastByte = at - _charTime;
+        };
+
+        void _onByte(uint8_t value, uint32_t at){
+            if (_length == MODBUS_MAX_FRAME_SIZE){
+                _drop();
+            }
+            if (!_length){
+                _frameStart = at;
+                _crc = 0xFFFF;
+            }
+            _frame[_length++] = value;
+            // crc over a frame including its crc is 0
+            _crc = crc16_update(_crc, value);
+            if (_length >= 4 && !_crc && _isFrameEnd()){
+                _onFrame(at);
+            }
+        };
+
+        bool _isFrameEnd() const {
+            uint16_t request{_expectedLength(true)};
+            uint16_t response{_expectedLength(false)};
+            if (!request && !response){
+                // unknown function code. crc decides.
+                return true;
+            }
+            return _length == request || _length == response;
+        };
+
+        /*
+        Length of the frame being received as request or response.
+        0 for unknown function codes, 0xFFFF while not known yet.
+        */
+        uint16_t _expectedLength(bool isRequest) const {
+            uint8_t functionCode{_frame[1]};
+            if (functionCode & 0x80){
+                return 5;
+            }
+            switch (functionCode){
+                case 1: case 2: case 3: case 4:
+                    return isRequest ? 8 : 5 + _frame[2];
+                case 5: case 6:
+                    return 8;
+                case 15: case 16:
+                    return isRequest ? (_length > 6 ? 9 + _frame[6] : 0xFFFF) : 8;
+                case FC_MASK_WRITE_REGISTER:
+                    return 10;
+                case FC_READ_WRITE_REGISTERS:
+                    return isRequest ? (_length > 10 ? 13 + _frame[10] : 0xFFFF) : 5 + _frame[2];
+                default:
+                    return 0;
+            }
+        };
+
+        void _onFrame(uint32_t end){
+            _frameCount++;
+            uint16_t length{_length};
+            uint16_t asRequest{_expectedLength(true)};
+            uint16_t asResponse{_expectedLength(false)};
+            _length = 0;
+            bool answers{_pending && _frame[0] == _request[0] && (_frame[1] & 0x7F) == _request[1]};
+            if (answers && (length == asResponse || !asResponse)){
+                _pending = false;
+                _emit(_request, _requestLength, _requestStart, _frame, length, _frameStart);
+                return;
+            }
+            if (_frame[1] & 0x80 || (asRequest && length != asRequest)){
+                // response to a request not seen
+                _emit(nullptr, 0, 0, _frame, length, _frameStart);
+                return;
+            }
+            if (_pending){
+                _pending = false;
+                _emit(_request, _requestLength, _requestStart, nullptr, 0, 0);
+            }
+            if (!_frame[0]){
+                // broadcasts are not answered
+                _emit(_frame, length, _frameStart, nullptr, 0, 0);
+                return;
+            }
+            uint8_t *request{_request};
+            _request = _frame;
+            _frame = request;
+            _requestLength = length;
+            _requestStart = _frameStart;
+            _requestEnd = end;
+            _pending = true;
+        };
+
+        void _checkTimeout(uint32_t now){
+            if (_pending && now - _requestEnd > _responseTimeout){
+                _pending = false;
+                _emit(_request, _requestLength, _requestStart, nullptr, 0, 0);
+            }
+        };
+
+        void _drop(){
+            _errorCount++;
+            _length = 0;
+        };
+
+        void _emit(const uint8_t *request, uint16_t requestLength, uint32_t requestStart,
+                   const uint8_t *response, uint16_t responseLength, uint32_t responseStart){
+            if (!_handler){
+                return;
+            }
+            SniffedTransaction transaction{};
+            transaction.request = SniffedFrame{request, requestLength, requestStart};
+            transaction.response = SniffedFrame{response, responseLength, responseStart};
+            const uint8_t *frame{request ? request : response};
+            transaction.slaveAddress = frame[0];
+            transaction.functionCode = frame[1] & 0x7F;
+            if (response && response[1] & 0x80){
+                transaction.exceptionCode = response[2];
+            }
+            _decode(transaction, request, response);
+            _handler(transaction);
+        };
+
+        /*
+        Address and quantity from the request or, if missed, from the response.
+        */
+        void _decode(SniffedTransaction &transaction, const uint8_t *request, const uint8_t *response) const {
+            uint8_t functionCode{transaction.functionCode};
+            bool single{functionCode == 5 || functionCode == 6 || functionCode == FC_MASK_WRITE_REGISTER};
+            bool multiple{functionCode == 15 || functionCode == 16};
+            if (request && (single || multiple || (functionCode >= 1 && functionCode <= 4) || functionCode == FC_READ_WRITE_REGISTERS)){
+                transaction.address = (request[2] << 8) | request[3];
+                transaction.quantity = single ? 1 : (request[4] << 8) | request[5];
+            } else if (!request && !transaction.exceptionCode && (single || multiple)){
+                transaction.address = (response[2] << 8) | response[3];
+                transaction.quantity = single ? 1 : (response[4] << 8) | response[5];
+            }
+        };
+};
+
+#endif // MODERNBUS_SNIFFER_H
@@ -0,0 +1,391 @@
+#if defined(__linux__)
+
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "modernbus_tcp_server.h"
+#include "modernbus_frame_parser.h"
+
+#define TCP_MAX_EVENTS 32
+#define MBAP_SIZE 7
+// epoll data of the listener and the stop event. Connections are index + 2
+#define LISTEN_EVENT 0
+#define STOP_EVENT 1
+
+ShardedTcpServer::ShardedTcpServer(RegisterBankBase &bank, uint8_t workers)
+:   _bank{bank},
+    _workerCount{workers}
+{
+    if (!_workerCount){
+        unsigned int cores{std::thread::hardware_concurrency()};
+        _workerCount = cores ? (cores > 255 ? 255 : cores) : 1;
+    }
+}
+
+ShardedTcpServer::~ShardedTcpServer(){
+    stop();
+}
+
+bool ShardedTcpServer::start(uint16_t port){
+    if (_running){
+        return true;
+    }
+    _workers = new Worker[_workerCount];
+    _port = port;
+    for (uint8_t idx = 0; idx < _workerCount; idx++){
+        Worker &worker{_workers[idx]};
+        // the first listener resolves port 0, the others share its port
+        bool ready{_listen(worker, _port)};
+        if (ready){
+            worker.epollFd = epoll_create1(EPOLL_CLOEXEC);
+            worker.stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ready = worker.epollFd >= 0 && worker.stopFd >= 0;
+        }
+        if (!ready){
+            _release(idx + 1);
+            return false;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = LISTEN_EVENT;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, worker.listenFd, &event);
+        event.data.u64 = STOP_EVENT;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, worker.stopFd, &event);
+    }
+    _running = true;
+    for (uint8_t idx = 0; idx < _workerCount; idx++){
+        Worker &worker{_workers[idx]};
+        worker.thread = std::thread{[this, &worker](){_run(worker);}};
+    }
+    return true;
+}
+
+void ShardedTcpServer::stop(){
+    if (!_running){
+        return;
+    }
+    _running = false;
+    for (uint8_t idx = 0; idx < _workerCount; idx++){
+        uint64_t one{1};
+        ssize_t written{write(_workers[idx].stopFd, &one, sizeof(one))};
+        (void)written;
+    }
+    for (uint8_t idx = 0; idx < _workerCount; idx++){
+        Worker &worker{_workers[idx]};
+        worker.thread.join();
+        for (Connection &connection: worker.connections){
+            if (connection.fd >= 0){
+                close(connection.fd);
+            }
+        }
+    }
+    _release(_workerCount);
+}
+
+/*
+Closes the descriptors of the first count workers and frees all workers.
+*/
+void ShardedTcpServer::_release(uint8_t count){
+    for (uint8_t idx = 0; idx < count; idx++){
+        Worker &worker{_workers[idx]};
+        for (int fd: {worker.listenFd, worker.stopFd, worker.epollFd}){
+            if (fd >= 0){
+                close(fd);
+            }
+        }
+    }
+    delete [] _workers;
+    _workers = nullptr;
+}
+
+void ShardedTcpServer::onRequest(TcpRequestHandler handler){
+    _handler = handler;
+}
+
+void ShardedTcpServer::beginUpdate(){
+    while (_writing.test_and_set(std::memory_order_acquire));
+    _lock.writeBegin();
+}
+
+void ShardedTcpServer::endUpdate(){
+    _lock.writeEnd();
+    _writing.clear(std::memory_order_release);
+}
+
+uint32_t ShardedTcpServer::requestCount() const{
+    uint32_t count{0};
+    for (uint8_t idx = 0; _workers && idx < _workerCount; idx++){
+        count += requestCount(idx);
+    }
+    return count;
+}
+
+uint32_t ShardedTcpServer::requestCount(uint8_t idx) const{
+    if (!_workers || idx >= _workerCount){
+        return 0;
+    }
+    return _workers[idx].requests.load(std::memory_order_relaxed);
+}
+
+bool ShardedTcpServer::_listen(Worker &worker, uint16_t port){
+    worker.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (worker.listenFd < 0){
+        return false;
+    }
+    int on{1};
+    setsockopt(worker.listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(worker.listenFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(worker.listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(worker.listenFd, SOMAXCONN) < 0){
+        return false;
+    }
+    socklen_t length{sizeof(address)};
+    getsockname(worker.listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+    _port = ntohs(address.sin_port);
+    return true;
+}
+
+void ShardedTcpServer::_run(Worker &worker){
+    epoll_event events[TCP_MAX_EVENTS];
+    while (true){
+        int count{epoll_wait(worker.epollFd, events, TCP_MAX_EVENTS, -1)};
+        for (int idx = 0; idx < count; idx++){
+            uint64_t data{events[idx].data.u64};
+            if (data == STOP_EVENT){
+                return;
+            }
+            if (data == LISTEN_EVENT){
+                _accept(worker);
+                continue;
+            }
+            Connection &connection{worker.connections[data - 2]};
+            if (events[idx].events & (EPOLLERR | EPOLLHUP)){
+                _close(worker, connection);
+                continue;
+            }
+            if (events[idx].events & EPOLLIN){
+                _receive(worker, connection);
+            } else if (events[idx].events & EPOLLOUT){
+                // replies drained. Requests may still wait for room.
+                _flush(worker, connection);
+                if (connection.fd >= 0 && connection.inLen){
+                    _answer(worker, connection);
+                }
+            }
+        }
+    }
+}
+
+void ShardedTcpServer::_accept(Worker &worker){
+    while (true){
+        int fd{accept4(worker.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (fd < 0){
+            return;
+        }
+        Connection *free{nullptr};
+        uint16_t slot{0};
+        for (; slot < MODERNBUS_TCP_CONNECTIONS; slot++){
+            if (worker.connections[slot].fd < 0){
+                free = &worker.connections[slot];
+                break;
+            }
+        }
+        if (!free){
+            // all connections of this worker in use
+            close(fd);
+            continue;
+        }
+        int on{1};
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        free->fd = fd;
+        free->inLen = 0;
+        free->outLen = 0;
+        free->outSent = 0;
+        free->events = EPOLLIN;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = slot + 2;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void ShardedTcpServer::_receive(Worker &worker, Connection &connection){
+    if (connection.inLen < sizeof(connection.in)){
+        ssize_t received{recv(connection.fd, connection.in + connection.inLen, sizeof(connection.in) - connection.inLen, 0)};
+        if (received <= 0){
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                _close(worker, connection);
+            }
+            return;
+        }
+        connection.inLen += received;
+    }
+    _answer(worker, connection);
+}
+
+void ShardedTcpServer::_answer(Worker &worker, Connection &connection){
+    // answer all complete frames. Pipelined requests are answered in order.
+    uint16_t consumed{0};
+    while (connection.inLen - consumed >= MBAP_SIZE){
+        const uint8_t *frame{connection.in + consumed};
+        uint16_t length = 6 + ((frame[4] << 8) | frame[5]);
+        if (length > MODBUS_TCP_FRAME || length < MBAP_SIZE + 1){
+            _close(worker, connection);
+            return;
+        }
+        if (connection.inLen - consumed < length){
+            break;
+        }
+        if (sizeof(connection.out) - connection.outLen < MODBUS_TCP_FRAME){
+            // make room. Nothing else answers the frames left if the master sent all its requests.
+            _flush(worker, connection);
+            if (connection.fd < 0){
+                return;
+            }
+            if (sizeof(connection.out) - connection.outLen < MODBUS_TCP_FRAME){
+                // the master does not read its replies. Wait for it.
+                break;
+            }
+        }
+        connection.outLen += _process(frame, length, connection.out + connection.outLen);
+        worker.requests.fetch_add(1, std::memory_order_relaxed);
+        consumed += length;
+    }
+    memmove(connection.in, connection.in + consumed, connection.inLen - consumed);
+    connection.inLen -= consumed;
+    _flush(worker, connection);
+}
+
+void ShardedTcpServer::_flush(Worker &worker, Connection &connection){
+    while (connection.outSent < connection.outLen){
+        ssize_t sent{send(connection.fd, connection.out + connection.outSent, connection.outLen - connection.outSent, MSG_NOSIGNAL)};
+        if (sent < 0){
+            if (errno == EAGAIN || errno == EWOULDBLOCK){
+                break;
+            }
+            _close(worker, connection);
+            return;
+        }
+        connection.outSent += sent;
+    }
+    bool pending{connection.outSent < connection.outLen};
+    if (!pending){
+        connection.outLen = 0;
+        connection.outSent = 0;
+    }
+    // wait for the socket to become writable as long as replies are pending.
+    // Without room for another reply stop reading, requests would only pile up.
+    bool room{sizeof(connection.out) - connection.outLen >= MODBUS_TCP_FRAME};
+    _arm(worker, connection, (room ? EPOLLIN : 0) | (pending ? EPOLLOUT : 0));
+}
+
+void ShardedTcpServer::_arm(Worker &worker, Connection &connection, uint32_t events){
+    if (connection.events == events){
+        return;
+    }
+    connection.events = events;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = (&connection - worker.connections) + 2;
+    epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void ShardedTcpServer::_close(Worker &worker, Connection &connection){
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    close(connection.fd);
+    connection.fd = -1;
+}
+
+uint16_t ShardedTcpServer::_process(const uint8_t *frame, uint16_t len, uint8_t *reply){
+    // mbap header: transaction id, protocol id, length, unit id
+    if (frame[2] != 0 || frame[3] != 0){
+        return 0;
+    }
+    const uint8_t *pdu{frame + MBAP_SIZE};
+    uint16_t pduLen = len - MBAP_SIZE;
+    uint8_t *replyPdu{reply + MBAP_SIZE};
+    uint16_t replyLen{0};
+    if (_bank.serves(pdu[0])){
+        replyLen = _serveBank(pdu, pduLen, replyPdu);
+    } else if (!_handler || !_handler(frame[6], pdu, pduLen, replyPdu, replyLen)){
+        replyPdu[0] = pdu[0] | 0x80;
+        replyPdu[1] = static_cast<uint8_t>(ErrorCode::illegalFunction);
+        replyLen = 2;
+    }
+    memcpy(reply, frame, MBAP_SIZE);
+    reply[4] = highByte(replyLen + 1);
+    reply[5] = lowByte(replyLen + 1);
+    return MBAP_SIZE + replyLen;
+}
+
+uint16_t ShardedTcpServer::_serveBank(const uint8_t *pdu, uint16_t len, uint8_t *reply){
+    uint8_t functionCode{pdu[0]};
+    uint16_t address = (pdu[1] << 8) | pdu[2];
+    uint16_t quantity = (pdu[3] << 8) | pdu[4];
+    uint8_t byteCount = len > 5 ? pdu[5] : 0;
+    ErrorCode error{len < 5 ? ErrorCode::illegalDataValue : ErrorCode::noError};
+    if (error == ErrorCode::noError && functionCode == FC_MASK_WRITE_REGISTER){
+        error = len < 7 ? ErrorCode::illegalDataValue : _bank.validate(functionCode, address, 1, 0);
+    } else if (error == ErrorCode::noError && functionCode == FC_READ_WRITE_REGISTERS){
+        byteCount = len > 9 ? pdu[9] : 0;
+        error = len < 10 + byteCount ? ErrorCode::illegalDataValue
+            : _bank.validateReadWrite(address, quantity, (pdu[5] << 8) | pdu[6], (pdu[7] << 8) | pdu[8], byteCount);
+    } else if (error == ErrorCode::noError){
+        error = _bank.validate(functionCode, address, quantity, byteCount);
+    }
+    if (error == ErrorCode::noError && (functionCode == 15 || functionCode == 16) && len < 6 + byteCount){
+        error = ErrorCode::illegalDataValue;
+    }
+    if (error == ErrorCode::noError && functionCode == 5 && !((pdu[3] == 0xFF || pdu[3] == 0x00) && pdu[4] == 0x00)){
+        error = ErrorCode::illegalDataValue;
+    }
+    if (error != ErrorCode::noError){
+        reply[0] = functionCode | 0x80;
+        reply[1] = static_cast<uint8_t>(error);
+        return 2;
+    }
+    reply[0] = functionCode;
+    if (functionCode <= 4){
+        // lock free read. Retried if a writer was active meanwhile.
+        uint32_t sequence;
+        do {
+            sequence = _lock.readBegin();
+            reply[1] = _bank.read(functionCode, address, quantity, reply + 2);
+        } while (_lock.readRetry(sequence));
+        return 2 + reply[1];
+    }
+    beginUpdate();
+    if (functionCode == FC_READ_WRITE_REGISTERS){
+        // write, then read within the same update
+        _bank.write(functionCode, (pdu[5] << 8) | pdu[6], (pdu[7] << 8) | pdu[8], pdu + 10);
+        reply[1] = _bank.read(functionCode, address, quantity, reply + 2);
+        endUpdate();
+        return 2 + reply[1];
+    }
+    if (functionCode == 5 || functionCode == 6 || functionCode == FC_MASK_WRITE_REGISTER){
+        _bank.write(functionCode, address, 1, pdu + 3);
+    } else {
+        _bank.write(functionCode, address, quantity, pdu + 6);
+    }
+    endUpdate();
+    if (functionCode == FC_MASK_WRITE_REGISTER){
+        // echo address, and mask and or mask
+        memcpy(reply + 1, pdu + 1, 6);
+        return 7;
+    }
+    // echo address and quantity or value
+    memcpy(reply + 1, pdu + 1, 4);
+    return 5;
+}
+
+#endif // __linux__
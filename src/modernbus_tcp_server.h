@@ -0,0 +1,144 @@
+#if !defined(MODERNBUS_TCP_SERVER_H)
+#define MODERNBUS_TCP_SERVER_H
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "modernbus_register_bank.h"
+#include "modernbus_seqlock.h"
+
+// connections per worker
+#ifndef MODERNBUS_TCP_CONNECTIONS
+#define MODERNBUS_TCP_CONNECTIONS 64
+#endif
+
+// max modbus tcp frame: mbap header 7 + pdu 253
+#define MODBUS_TCP_FRAME 260
+
+/*
+Handler of requests the bank does not serve.
+pdu starts at the function code. Write the reply pdu to reply and set replyLen.
+Return false to answer illegal function.
+Called on the worker thread that received the request.
+*/
+using TcpRequestHandler = std::function<bool(uint8_t unitId, const uint8_t* pdu, uint16_t len, uint8_t* reply, uint16_t& replyLen)>;
+
+
+/*
+Modbus TCP server sharded over several cores (Linux).
+
+Each worker thread owns a listener on the same port (SO_REUSEPORT),
+an epoll loop and its connections. The kernel spreads new connections
+over the listeners. All workers serve the same register bank:
+
+    RegisterBank<0, 0, 1000, 1000> bank{};
+    ShardedTcpServer server{bank, 4};
+    server.start(502);
+
+Reads of the bank are lock free. Writes by masters and by the application
+(between beginUpdate and endUpdate) are published through a sequence lock,
+so a reply never holds a half written value. Only writers wait for each other.
+The bank's write handler is called on the worker thread.
+*/
+class ShardedTcpServer{
+    public:
+        /*
+        workers 0 starts one worker per core.
+        */
+        ShardedTcpServer(RegisterBankBase &bank, uint8_t workers = 0);
+        ShardedTcpServer(const ShardedTcpServer&) = delete;
+        ~ShardedTcpServer();
+
+        /*
+        Binds all workers to port and starts them. Port 0 picks a free port.
+        Returns false if the port could not be bound.
+        */
+        bool start(uint16_t port);
+
+        /*
+        Stops the workers and closes all connections.
+        */
+        void stop();
+
+        /*
+        Serves function codes the bank does not serve. Set before start().
+        */
+        void onRequest(TcpRequestHandler handler);
+
+        /*
+        Application side update of the bank, e.g.
+            server.beginUpdate(); bank.setInputRegisters<float>(0, t); server.endUpdate();
+        */
+        void beginUpdate();
+        void endUpdate();
+
+        uint16_t port() const {return _port;};
+        uint8_t workerCount() const {return _workerCount;};
+        bool isRunning() const {return _running;};
+
+        /*
+        Requests served by all workers.
+        */
+        uint32_t requestCount() const;
+
+        /*
+        Requests served by worker idx.
+        */
+        uint32_t requestCount(uint8_t idx) const;
+
+    private:
+        struct Connection{
+            int fd{-1};
+            uint16_t inLen{0};
+            uint16_t outLen{0};
+            uint16_t outSent{0};
+            // epoll events armed for the connection
+            uint32_t events{0};
+            uint8_t in[MODBUS_TCP_FRAME];
+            uint8_t out[2 * MODBUS_TCP_FRAME];
+        };
+
+        struct Worker{
+            std::thread thread{};
+            int epollFd{-1};
+            int listenFd{-1};
+            int stopFd{-1};
+            Connection connections[MODERNBUS_TCP_CONNECTIONS];
+            // workers count on their own cache line
+            alignas(64) std::atomic<uint32_t> requests{0};
+        };
+
+        RegisterBankBase &_bank;
+        TcpRequestHandler _handler{nullptr};
+        uint8_t _workerCount;
+        Worker *_workers{nullptr};
+        uint16_t _port{0};
+        bool _running{false};
+        SeqLock _lock{};
+        std::atomic_flag _writing = ATOMIC_FLAG_INIT;
+
+        bool _listen(Worker &worker, uint16_t port);
+        void _release(uint8_t count);
+        void _run(Worker &worker);
+        void _accept(Worker &worker);
+        void _receive(Worker &worker, Connection &connection);
+        void _answer(Worker &worker, Connection &connection);
+        void _flush(Worker &worker, Connection &connection);
+        void _arm(Worker &worker, Connection &connection, uint32_t events);
+        void _close(Worker &worker, Connection &connection);
+
+        /*
+        Answers one request frame. Returns the length of the reply frame
+        or 0 if the frame is not answered.
+        */
+        uint16_t _process(const uint8_t* frame, uint16_t len, uint8_t* reply);
+        uint16_t _serveBank(const uint8_t* pdu, uint16_t len, uint8_t* reply);
+};
+
+#endif // __linux__
+
+#endif // MODERNBUS_TCP_SERVER_H
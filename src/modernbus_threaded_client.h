@@ -0,0 +1,202 @@
+#if !defined(MODERNBUS_THREADED_CLIENT_H)
+#define MODERNBUS_THREADED_CLIENT_H
+
+/*
+Threaded mode of the client for multi threaded hosts.
+
+A dedicated I/O thread owns loop, client and bus. Any thread may submit
+requests through a lock free queue:
+
+    ThreadedModbusClient<Provider> bus{&provider};
+    bus.start();
+    // any thread
+    ModbusFuture level = bus.submit(frame, len);
+    if (level.wait(500) && level.ok()){ ... }
+
+Handlers of sent requests are called on the I/O thread.
+Polled requests must be added through client() before start().
+*/
+
+#if defined(__has_include)
+#if __has_include(<thread>) && __has_include(<atomic>)
+    #define MODERNBUS_THREADS 1
+#endif
+#endif
+
+#ifdef MODERNBUS_THREADS
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifdef MODERNBUS_EPOLL
+    #include <sys/eventfd.h>
+    #include <unistd.h>
+#endif
+
+#include "modernbus_client.h"
+#include "modernbus_mpsc.h"
+
+// number of requests submitted but not yet taken by the I/O thread
+#ifndef MODERNBUS_SUBMIT_DEPTH
+#define MODERNBUS_SUBMIT_DEPTH 64
+#endif
+
+// sleep of the I/O thread after a pass of the TaskScheduler which ran no task
+#ifndef MODERNBUS_IDLE_SLEEP_US
+#define MODERNBUS_IDLE_SLEEP_US 200
+#endif
+
+
+template <typename T, uint16_t MaxRequests = 0, uint16_t QueueDepth = 0>
+class ThreadedModbusClient{
+    public:
+        ThreadedModbusClient(T *provider)
+        :   _client{&_loop, provider}
+        {
+            _loop.addTask(_drainTask);
+            #ifdef MODERNBUS_EPOLL
+                // submitters signal the eventfd. Else submissions are taken every ms.
+                _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                _drainTask.watch(_eventFd);
+                _drainTask.wakeOnData(true);
+                _drainTask.set(100, TASK_FOREVER, [this](){_drain();});
+            #else
+                _drainTask.set(1, TASK_FOREVER, [this](){_drain();});
+            #endif
+        };
+
+        ThreadedModbusClient(const ThreadedModbusClient&) = delete;
+
+        ~ThreadedModbusClient(){
+            stop();
+            // submissions never handed to the client
+            ModbusRequest *request{_pending};
+            _pending = nullptr;
+            while (request || _submissions.pop(request)){
+                if (request->getErrorHandler() != nullptr){
+                    request->getErrorHandler()(&request->response(), ErrorCode::slaveDeviceFailure);
+                }
+                request = nullptr;
+            }
+            _loop.deleteTask(_drainTask);
+            #ifdef MODERNBUS_EPOLL
+                close(_eventFd);
+            #endif
+        };
+
+        /*
+        Starts the I/O thread.
+        */
+        void start(){
+            if (_running.exchange(true)){
+                return;
+            }
+            _thread = std::thread{[this](){_run();}};
+        };
+
+        /*
+        Stops and joins the I/O thread. Submissions not yet handed to the client stay
+        queued, those queued in the client fail (see ModbusClient::stop).
+        */
+        void stop(){
+            if (!_running.exchange(false)){
+                return;
+            }
+            #ifdef MODERNBUS_EPOLL
+                _loop.wakeup();
+            #endif
+            _thread.join();
+        };
+
+        /*
+        Queues a single request. Any thread.
+        Returns false if the submission queue is full.
+        */
+        bool send(ModbusRequest *request){
+            if (!_submissions.push(request)){
+                _rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _signal();
+            return true;
+        };
+
+        /*
+        Queues a copy of frame and returns a future of its response. Any thread.
+        */
+        ModbusFuture submit(const uint8_t* frame, uint16_t frameSize, uint32_t timeout = 500){
+            FutureState *state{FutureState::create(frame, frameSize, timeout)};
+            if (state && !send(state->request())){
+                state->complete(FutureState::failed, ErrorCode::slaveDeviceFailure);
+            }
+            return ModbusFuture{state};
+        };
+
+        /*
+        The wrapped client. Only touch it before start() or from handlers.
+        */
+        ModbusClient<T, MaxRequests, QueueDepth>& client(){return _client;};
+
+        bool isRunning() const {return _running.load(std::memory_order_relaxed);};
+        uint32_t rejectedCount() const {return _rejected.load(std::memory_order_relaxed);};
+
+    private:
+        ExecutorLoop _loop{};
+        ModbusClient<T, MaxRequests, QueueDepth> _client;
+        ExecutorTimer _drainTask{};
+        MpscQueue<ModbusRequest*, MODERNBUS_SUBMIT_DEPTH> _submissions{};
+        ModbusRequest *_pending{nullptr};
+        std::thread _thread{};
+        std::atomic<bool> _running{false};
+        std::atomic<uint32_t> _rejected{0};
+        int _eventFd{-1};
+
+        void _run(){
+            _client.start();
+            _drainTask.enable();
+            while (_running.load(std::memory_order_acquire)){
+                bool idle{_loop.execute()};
+            #ifndef MODERNBUS_EPOLL
+                // EpollLoop sleeps until work is due, TaskScheduler returns right away
+                if (idle){
+                    std::this_thread::sleep_for(std::chrono::microseconds(MODERNBUS_IDLE_SLEEP_US));
+                }
+            #else
+                (void)idle;
+            #endif
+            }
+            _drainTask.disable();
+            _client.stop();
+        };
+
+        // I/O thread. Moves submissions into the client.
+        void _drain(){
+            #ifdef MODERNBUS_EPOLL
+                uint64_t counter;
+                while (read(_eventFd, &counter, sizeof(counter)) > 0);
+            #endif
+            ModbusRequest *request{_pending};
+            _pending = nullptr;
+            while (request || _submissions.pop(request)){
+                if (!_client.send(request)){
+                    // client queue is full. Retry with the next drain
+                    _pending = request;
+                    break;
+                }
+                request = nullptr;
+            }
+        };
+
+        void _signal(){
+            #ifdef MODERNBUS_EPOLL
+                uint64_t one{1};
+                ssize_t written{write(_eventFd, &one, sizeof(one))};
+                (void)written;
+            #endif
+        };
+};
+
+#endif // MODERNBUS_THREADS
+
+#endif // MODERNBUS_THREADED_CLIENT_H
@@ -0,0 +1,68 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "modernbus_trace.h"
+#include "modernbus_util.h"
+
+#ifdef MODERNBUS_TRACE
+TraceBuffer<MODERNBUS_TRACE_SIZE> modernbusTrace{};
+#endif
+
+const char* traceEventName(TraceEvent event){
+    switch (event){
+        case TraceEvent::clientBegin: return "clientBegin";
+        case TraceEvent::clientTransmit: return "clientTransmit";
+        case TraceEvent::clientEnd: return "clientEnd";
+        case TraceEvent::clientReceive: return "clientReceive";
+        case TraceEvent::clientComplete: return "clientComplete";
+        case TraceEvent::clientError: return "clientError";
+        case TraceEvent::clientTimeout: return "clientTimeout";
+        case TraceEvent::serverReceive: return "serverReceive";
+        case TraceEvent::serverComplete: return "serverComplete";
+        case TraceEvent::serverError: return "serverError";
+        case TraceEvent::serverTransmit: return "serverTransmit";
+        case TraceEvent::serverEnd: return "serverEnd";
+    }
+    return "unknown";
+}
+
+void encodeTraceHeader(uint8_t *dst){
+    memcpy(dst, TRACE_MAGIC, 4);
+    putWord(dst + 4, TRACE_VERSION);
+    putWord(dst + 6, TRACE_RECORD_SIZE);
+}
+
+size_t encodeTraceRecords(const TraceRecord *records, size_t count, uint8_t *dst){
+    for (size_t idx = 0; idx < count; idx++){
+        const TraceRecord &record{records[idx]};
+        uint8_t *out{dst + idx * TRACE_RECORD_SIZE};
+        putLong(out, record.timestamp);
+        out[4] = static_cast<uint8_t>(record.event);
+        out[5] = 0;
+        putWord(out + 6, record.count);
+        putLong(out + 8, record.request & 0xFFFFFFFF);
+        putLong(out + 12, record.request >> 32);
+    }
+    return count * TRACE_RECORD_SIZE;
+}
+
+TraceReader::TraceReader(const uint8_t *log, size_t size)
+:   _log{log},
+    _size{size}
+{
+    _valid = size >= TRACE_HEADER_SIZE && !memcmp(log, TRACE_MAGIC, 4)
+        && getWord(log + 4) == TRACE_VERSION && getWord(log + 6) == TRACE_RECORD_SIZE;
+}
+
+bool TraceReader::next(TraceRecord &record){
+    if (!_valid || _offset + TRACE_RECORD_SIZE > _size){
+        return false;
+    }
+    const uint8_t *src{_log + _offset};
+    record.timestamp = getLong(src);
+    record.event = static_cast<TraceEvent>(src[4]);
+    record.count = getWord(src + 6);
+    record.request = getLong(src + 8) | (static_cast<uint64_t>(getLong(src + 12)) << 32);
+    _offset += TRACE_RECORD_SIZE;
+    return true;
+}
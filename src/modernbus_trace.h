@@ -0,0 +1,214 @@
+#if !defined(MODERNBUS_TRACE_H)
+#define MODERNBUS_TRACE_H
+
+#include <Arduino.h>
+
+/*
+Binary trace of the client and server state machines.
+
+With MODERNBUS_TRACE defined client and server write a record at each
+state transition into the global ring buffer modernbusTrace. Without it
+the trace points compile to nothing and neither TraceBuffer nor
+<atomic> are pulled in.
+
+Trace log, little endian:
+
+    header   "MBTR", uint16 version, uint16 record size
+    record   uint32 timestamp (us), uint8 event, uint8 reserved, uint16 count, uint64 request
+    ...
+
+host/modernbus_trace.cpp turns a trace log into Chrome trace JSON.
+*/
+#define TRACE_MAGIC "MBTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 16
+
+// records kept by modernbusTrace, a power of two
+#ifndef MODERNBUS_TRACE_SIZE
+#define MODERNBUS_TRACE_SIZE 256
+#endif
+
+enum class TraceEvent : uint8_t {
+    // client. request is the ModbusRequest
+    // request frame about to be sent, count is its size
+    clientBegin = 1,
+    // request frame written to the provider, count is its size
+    clientTransmit = 2,
+    // transmission ended, waiting for the response
+    clientEnd = 3,
+    // response bytes taken from the provider, count is their number
+    clientReceive = 4,
+    // response complete, count is the frame length
+    clientComplete = 5,
+    // response broken, count is the error code
+    clientError = 6,
+    // no complete response in time, count is the number of bytes missing
+    clientTimeout = 7,
+
+    // server. request is the ModbusServer
+    // request bytes taken from the provider, count is their number
+    serverReceive = 16,
+    // request complete, count is the frame length
+    serverComplete = 17,
+    // request broken, count is the error code
+    serverError = 18,
+    // first response byte about to be written
+    serverTransmit = 19,
+    // response written, count is its size
+    serverEnd = 20
+};
+
+struct TraceRecord{
+    uint32_t timestamp{0};
+    TraceEvent event{TraceEvent::clientBegin};
+    uint16_t count{0};
+    uint64_t request{0};
+};
+
+/*
+Name of an event, "unknown" for ids not listed in TraceEvent.
+*/
+const char* traceEventName(TraceEvent event);
+
+
+#ifdef MODERNBUS_TRACE
+
+#include <atomic>
+
+/*
+Lock free ring buffer of trace records. Any thread may record. Once full
+the oldest records are overwritten, so recording never waits.
+
+Each slot carries a sequence number, odd while being written. Readers
+keep their own cursor and skip records overwritten before they got to them:
+
+    uint32_t cursor{modernbusTrace.recorded()};
+    ...
+    TraceRecord records[32];
+    size_t count = modernbusTrace.read(cursor, records, 32);
+
+N must be a power of two.
+*/
+template <uint16_t N>
+class TraceBuffer{
+    static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of two");
+
+    public:
+        TraceBuffer() = default;
+        TraceBuffer(const TraceBuffer&) = delete;
+
+        void record(TraceEvent event, const void *request, uint16_t count){
+            uint32_t position{_head.fetch_add(1, std::memory_order_relaxed)};
+            Slot &slot{_slots[position & _mask]};
+            slot.sequence.store(position * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.record.timestamp = micros();
+            slot.record.event = event;
+            slot.record.count = count;
+            slot.record.request = reinterpret_cast<uintptr_t>(request);
+            slot.sequence.store(position * 2 + 2, std::memory_order_release);
+        };
+
+        /*
+        Copies up to max records from cursor on and advances cursor.
+        Returns the number of records copied. Stops at a record not written yet,
+        so it is read by the next call.
+        */
+        size_t read(uint32_t &cursor, TraceRecord *records, size_t max) const {
+            uint32_t head{_head.load(std::memory_order_acquire)};
+            if (head - cursor > N){
+                cursor = head - N;
+            }
+            size_t count{0};
+            while (cursor != head && count < max){
+                const Slot &slot{_slots[cursor & _mask]};
+                uint32_t expected{cursor * 2 + 2};
+                uint32_t sequence{slot.sequence.load(std::memory_order_acquire)};
+                if (static_cast<int32_t>(sequence - expected) < 0){
+                    // claimed but not written yet, still holds an older lap
+                    break;
+                }
+                if (sequence == expected){
+                    records[count] = slot.record;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.sequence.load(std::memory_order_relaxed) == expected){
+                        count++;
+                    }
+                }
+                // otherwise overwritten by a newer lap
+                cursor++;
+            }
+            return count;
+        };
+
+        /*
+        Records written since start. Also the cursor of the next record.
+        */
+        uint32_t recorded() const {return _head.load(std::memory_order_relaxed);};
+
+        uint16_t capacity() const {return N;};
+
+    private:
+        static constexpr uint32_t _mask{N - 1};
+
+        struct Slot{
+            std::atomic<uint32_t> sequence{0};
+            TraceRecord record{};
+        };
+
+        Slot _slots[N];
+        alignas(64) std::atomic<uint32_t> _head{0};
+};
+
+extern TraceBuffer<MODERNBUS_TRACE_SIZE> modernbusTrace;
+
+#endif // MODERNBUS_TRACE
+
+
+/*
+Writes the trace log header to dst, TRACE_HEADER_SIZE bytes.
+*/
+void encodeTraceHeader(uint8_t *dst);
+
+/*
+Writes count records to dst, TRACE_RECORD_SIZE bytes each.
+Returns the number of bytes written.
+*/
+size_t encodeTraceRecords(const TraceRecord *records, size_t count, uint8_t *dst);
+
+
+/*
+Iterates the records of a trace log held in memory.
+*/
+class TraceReader{
+    public:
+        TraceReader(const uint8_t *log, size_t size);
+
+        /*
+        False if the header is missing or of another version.
+        */
+        bool isValid() const {return _valid;};
+
+        /*
+        Reads the next record. Returns false at the end of the log
+        or at a record cut off.
+        */
+        bool next(TraceRecord &record);
+
+    private:
+        const uint8_t *_log;
+        size_t _size;
+        size_t _offset{TRACE_HEADER_SIZE};
+        bool _valid{false};
+};
+
+
+#ifdef MODERNBUS_TRACE
+    #define MODERNBUS_TRACE_POINT(event, request, count) \
+        modernbusTrace.record(TraceEvent::event, (request), (count))
+#else
+    #define MODERNBUS_TRACE_POINT(event, request, count) do {} while (0)
+#endif
+
+#endif // MODERNBUS_TRACE_H
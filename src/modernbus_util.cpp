@@ -1,14 +1,51 @@
 #include <Arduino.h>
 #include "modernbus_util.h"
 
+// crc of a nibble. Two lookups per byte instead of eight shifts,
+// for 32 bytes of table.
+static const uint16_t crcNibble[16] {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
 uint16_t crc16_update(uint16_t crc, uint8_t a) {
-    int i;
     crc ^= (uint16_t)a;
-    for (i = 0; i < 8; ++i) {
-        if (crc & 1)
-            crc = (crc >> 1) ^ 0xA001;
-        else
-            crc = (crc >> 1);
+    crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+    crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+    return crc;
+}
+
+uint16_t crc16(const uint8_t *data, uint16_t len) {
+    uint16_t crc{0xFFFF};
+    for (uint16_t idx = 0; idx < len; idx++){
+        crc = crc16_update(crc, data[idx]);
     }
     return crc;
 }
+
+void putWord(uint8_t *dst, uint16_t value){
+    dst[0] = lowByte(value);
+    dst[1] = highByte(value);
+}
+
+void putLong(uint8_t *dst, uint32_t value){
+    putWord(dst, value & 0xFFFF);
+    putWord(dst + 2, value >> 16);
+}
+
+void putLongLong(uint8_t *dst, uint64_t value){
+    putLong(dst, value & 0xFFFFFFFF);
+    putLong(dst + 4, value >> 32);
+}
+
+uint16_t getWord(const uint8_t *src){
+    return src[0] | (src[1] << 8);
+}
+
+uint32_t getLong(const uint8_t *src){
+    return getWord(src) | (static_cast<uint32_t>(getWord(src + 2)) << 16);
+}
+
+uint64_t getLongLong(const uint8_t *src){
+    return getLong(src) | (static_cast<uint64_t>(getLong(src + 4)) << 32);
+}
@@ -6,5 +6,36 @@
 
 uint16_t crc16_update(uint16_t crc, uint8_t a);
 
+// modbus crc of len bytes
+uint16_t crc16(const uint8_t* data, uint16_t len);
+
+// little endian fields of capture and trace logs
+void putWord(uint8_t* dst, uint16_t value);
+void putLong(uint8_t* dst, uint32_t value);
+void putLongLong(uint8_t* dst, uint64_t value);
+uint16_t getWord(const uint8_t* src);
+uint32_t getLong(const uint8_t* src);
+uint64_t getLongLong(const uint8_t* src);
+
+/*
+micros() extended to 64 bit, so it does not wrap after 71.6 minutes.
+A wrap is only noticed if now() is called at least once in between.
+*/
+class WideMicros{
+    public:
+        uint64_t now(){
+            uint32_t low = micros();
+            if (low < _last){
+                _high++;
+            }
+            _last = low;
+            return (static_cast<uint64_t>(_high) << 32) | low;
+        };
+
+    private:
+        uint32_t _last{0};
+        uint32_t _high{0};
+};
+
 #endif // MODERNBUS_UTIL_H
 
@@ -0,0 +1,190 @@
+#include <Arduino.h>
+#include <new>
+#include <string.h>
+
+#include "modernbus_write_buffer.h"
+
+// limits of a single fc 15 and fc 16 request
+#define MAX_COILS_PER_WRITE 1968
+#define MAX_REGISTERS_PER_WRITE 123
+
+WriteBufferBase::WriteBufferBase(PendingWrite *writes, uint16_t depth)
+:   _writes{writes},
+    _depth{depth}
+{}
+
+WriteBufferBase::~WriteBufferBase(){
+    if (_request){
+        _request->~ModbusRequest();
+    }
+}
+
+bool WriteBufferBase::add(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value, WriteHandler handler, uint32_t now){
+    if (functionCode != 5 && functionCode != 6){
+        return false;
+    }
+    int16_t idx{_find(slaveAddress, functionCode, address, false)};
+    if (idx >= 0 && !(handler && _writes[idx].handler)){
+        // last write wins
+        PendingWrite &write{_writes[idx]};
+        write.value = value;
+        if (handler){
+            write.handler = handler;
+        }
+        return true;
+    }
+    if (_size == _depth){
+        return false;
+    }
+    // window starts with the first write waiting
+    bool waiting{false};
+    for (uint16_t i = 0; i < _size; i++){
+        waiting = waiting || !_writes[i].inFlight;
+    }
+    if (!waiting){
+        _firstQueued = now;
+    }
+    if (idx >= 0){
+        // last write wins. The replaced one waits for the result of its successor.
+        _writes[idx].superseded = true;
+    }
+    _writes[_size++] = PendingWrite{slaveAddress, functionCode, address, value, handler, false, false};
+    return true;
+}
+
+ModbusRequest *WriteBufferBase::next(uint32_t now){
+    if (_inFlight || now - _firstQueued < _window){
+        return nullptr;
+    }
+    for (uint16_t idx = 0; idx < _size; idx++){
+        if (!_writes[idx].inFlight){
+            _setRequest(_buildFrame(_writes[idx]));
+            _inFlight = true;
+            return _request;
+        }
+    }
+    return nullptr;
+}
+
+void WriteBufferBase::setWindow(uint16_t window){
+    _window = window;
+}
+
+uint16_t WriteBufferBase::pending() const{
+    return _size;
+}
+
+uint16_t WriteBufferBase::window() const{
+    return _window;
+}
+
+uint32_t WriteBufferBase::mergedCount() const{
+    return _merged;
+}
+
+void WriteBufferBase::_onEcho(ServerResponse *response){
+    static_cast<WriteBufferBase*>(response->request()->getExtension())->_complete(ErrorCode::noError);
+}
+
+void WriteBufferBase::_onFailure(ServerResponse *response, ErrorCode errorCode){
+    static_cast<WriteBufferBase*>(response->request()->getExtension())->_complete(errorCode);
+}
+
+void WriteBufferBase::_complete(ErrorCode errorCode){
+    uint16_t idx{0};
+    while (idx < _size){
+        if (!_writes[idx].inFlight){
+            idx++;
+            continue;
+        }
+        PendingWrite done{_writes[idx]};
+        for (uint16_t i = idx; i + 1 < _size; i++){
+            _writes[i] = _writes[i + 1];
+        }
+        _size--;
+        // handler may queue further writes
+        if (done.handler){
+            done.handler(done.address, errorCode);
+        }
+    }
+    _inFlight = false;
+}
+
+int16_t WriteBufferBase::_find(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, bool inFlight) const{
+    for (uint16_t idx = 0; idx < _size; idx++){
+        const PendingWrite &write{_writes[idx]};
+        if (write.address == address && write.slaveAddress == slaveAddress
+            && write.functionCode == functionCode && write.inFlight == inFlight && !write.superseded){
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/*
+Puts the queued write to address in flight, together with the writes it replaced.
+*/
+void WriteBufferBase::_send(uint8_t slaveAddress, uint8_t functionCode, uint16_t address){
+    for (uint16_t idx = 0; idx < _size; idx++){
+        PendingWrite &write{_writes[idx]};
+        if (write.address == address && write.slaveAddress == slaveAddress
+            && write.functionCode == functionCode){
+            write.inFlight = true;
+        }
+    }
+}
+
+uint16_t WriteBufferBase::_buildFrame(const PendingWrite &first){
+    uint8_t slaveAddress{first.slaveAddress};
+    uint8_t functionCode{first.functionCode};
+    bool coils{functionCode == 5};
+    uint16_t maxRun = coils ? MAX_COILS_PER_WRITE : MAX_REGISTERS_PER_WRITE;
+    uint16_t start{first.address};
+    uint16_t end{first.address};
+    while (start > 0 && end - start + 1 < maxRun && _find(slaveAddress, functionCode, start - 1, false) >= 0){
+        start--;
+    }
+    while (end < 0xFFFF && end - start + 1 < maxRun && _find(slaveAddress, functionCode, end + 1, false) >= 0){
+        end++;
+    }
+    uint16_t quantity = end - start + 1;
+
+    if (quantity == 1){
+        const PendingWrite &write{_writes[_find(slaveAddress, functionCode, start, false)]};
+        uint16_t value = coils ? (write.value ? 0xFF00 : 0x0000) : write.value;
+        _send(slaveAddress, functionCode, start);
+        return buildWriteSingleFrame(_frame, slaveAddress, functionCode, start, value);
+    }
+
+    // payload is placed right where buildWriteMultipleFrame expects it
+    uint8_t *payload{_frame + 7};
+    uint8_t byteCount = coils ? (quantity + 7) / 8 : quantity * 2;
+    memset(payload, 0, byteCount);
+    for (uint16_t address = start; ; address++){
+        const PendingWrite &write{_writes[_find(slaveAddress, functionCode, address, false)]};
+        uint16_t offset = address - start;
+        if (coils){
+            if (write.value){
+                payload[offset >> 3] |= 1 << (offset & 0x07);
+            }
+        } else {
+            payload[2 * offset] = highByte(write.value);
+            payload[2 * offset + 1] = lowByte(write.value);
+        }
+        _send(slaveAddress, functionCode, address);
+        if (address == end){
+            break;
+        }
+    }
+    _merged += quantity - 1;
+    return buildWriteMultipleFrame(_frame, slaveAddress, coils ? 15 : 16, start, quantity, payload, byteCount);
+}
+
+void WriteBufferBase::_setRequest(uint16_t frameSize){
+    if (_request){
+        _request->~ModbusRequest();
+    }
+    _request = new (_requestStorage) ModbusRequest{_frame, frameSize, false, 0, _onEcho, _frame};
+    _request->setExtension(this);
+    _request->setOnError(_onFailure);
+}
@@ -0,0 +1,100 @@
+#if !defined(MODERNBUS_WRITE_BUFFER_H)
+#define MODERNBUS_WRITE_BUFFER_H
+
+#include <Arduino.h>
+
+#include "modernbus_request.h"
+#include "modernbus_frame.h"
+
+/*
+One queued single write.
+*/
+struct PendingWrite{
+    uint8_t slaveAddress;
+    uint8_t functionCode;
+    uint16_t address;
+    uint16_t value;
+    WriteHandler handler;
+    bool inFlight;
+    // replaced by a later write, only kept for its handler
+    bool superseded;
+};
+
+
+/*
+Write behind buffer of a ModbusClient.
+
+Single writes (fc 05, 06) are collected for a time window.
+Once the window is over, writes to neighbouring addresses of the same slave
+are merged into one fc 15 or fc 16 request. A repeated write to an address
+overwrites the queued value (last write wins). A replaced write with a handler
+keeps its slot and is reported together with the write replacing it.
+When the echo arrives or the write fails, the handler of every merged write is called.
+
+Use WriteBuffer<Depth> to provide the storage.
+*/
+class WriteBufferBase{
+    public:
+        WriteBufferBase(const WriteBufferBase&) = delete;
+        ~WriteBufferBase();
+
+        /*
+        Queues a write. Coils (fc 05) are on for any value other than zero.
+        Returns false if function code is not 05 or 06 or the buffer is full.
+        Replacing a queued write with a handler takes a slot as well.
+        */
+        bool add(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t value, WriteHandler handler, uint32_t now);
+
+        /*
+        Returns the next merged request if the window is over and no merged request is in flight.
+        Else returns nullptr.
+        */
+        ModbusRequest* next(uint32_t now);
+
+        /*
+        Time in ms writes are collected before they are sent. Default 10 ms.
+        */
+        void setWindow(uint16_t window);
+
+        uint16_t pending() const;
+        uint16_t window() const;
+        uint32_t mergedCount() const;
+
+    protected:
+        WriteBufferBase(PendingWrite* writes, uint16_t depth);
+
+    private:
+        PendingWrite* _writes;
+        uint16_t _depth;
+        uint16_t _size{0};
+        uint16_t _window{10};
+        uint32_t _firstQueued{0};
+        uint32_t _merged{0};
+        bool _inFlight{false};
+
+        alignas(ModbusRequest) uint8_t _requestStorage[sizeof(ModbusRequest)];
+        ModbusRequest* _request{nullptr};
+        uint8_t _frame[MODBUS_MAX_FRAME_SIZE];
+
+        static void _onEcho(ServerResponse* response);
+        static void _onFailure(ServerResponse* response, ErrorCode errorCode);
+        void _complete(ErrorCode errorCode);
+        int16_t _find(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, bool inFlight) const;
+        void _send(uint8_t slaveAddress, uint8_t functionCode, uint16_t address);
+        uint16_t _buildFrame(const PendingWrite& first);
+        void _setRequest(uint16_t frameSize);
+};
+
+
+template <uint16_t Depth>
+class WriteBuffer: public WriteBufferBase{
+    public:
+        WriteBuffer()
+        :   WriteBufferBase{_storage, Depth}
+        {};
+
+    private:
+        PendingWrite _storage[Depth]{};
+};
+
+#endif // MODERNBUS_WRITE_BUFFER_H
@@ -37,6 +37,7 @@ class MockStream{
     uint8_t _unavailableAfter{0};
     uint32_t _unavailableFor{0};
     uint32_t _lastPoll{};
+    int _baudRate{1152000};
     
     public:
     MockStream(size_t buffSize = 200)
@@ -57,7 +58,11 @@ class MockStream{
     }
 
     int baudRate(){
-        return 1152000;
+        return _baudRate;
+    }
+
+    void setBaudRate(int baudRate){
+        _baudRate = baudRate;
     }
 
     void begin(bool prime=false){
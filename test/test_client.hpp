@@ -8,7 +8,61 @@
 #include "../src/modernbus_client.h"
 #include "../src/modernbus_server_response.h"
 #include "../src/modernbus_provider.h"
+#include "../src/modernbus_process_image.h"
+#include "../src/modernbus_threaded_client.h"
+#include <atomic>
+#include <new>
+#ifdef MODERNBUS_EPOLL
+    #include <unistd.h>
+#endif
 
+// heap allocations of the whole test run
+std::atomic<uint32_t> allocationCount{0};
+
+/*
+Replacements of the global allocation functions, counting allocations.
+Kept out of line, GCC otherwise sees free() of a pointer taken from a new
+expression once inlined (-Wmismatched-new-delete).
+*/
+#define TEST_ALLOCATION __attribute__((noinline))
+
+TEST_ALLOCATION void* operator new(size_t size){
+    allocationCount++;
+    void *ptr{malloc(size ? size : 1)};
+    if (!ptr){
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+TEST_ALLOCATION void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+TEST_ALLOCATION void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+TEST_ALLOCATION void* operator new[](size_t size){
+    return operator new(size);
+}
+
+TEST_ALLOCATION void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+TEST_ALLOCATION void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+TEST_ALLOCATION void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocationCount++;
+    return malloc(size ? size : 1);
+}
+
+TEST_ALLOCATION void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
 
 
 /*
@@ -18,7 +72,7 @@ This makes it possible to investigate the client write/read behaviour.
 
 using providerType = SerialProvider<MockStream>;
 
-Scheduler clientScheduler{};
+ExecutorLoop clientScheduler{};
 
 void GivenNothing_WhenInit_ThenNoError(){
     MockStream mStream{};
@@ -332,6 +386,716 @@ void GivenClientPollingRequest_WhenResponseTakesLong_ThenTimeOutOccurs(){
 
 }
 
+void GivenPooledClient_WhenPolling_ThenRequestsTakenFromPool(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ModbusClient<providerType, 2, 1> client {&clientScheduler, &testProvider};
+    assert(client.requestsAvailable() == 2);
+    bool called{false};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), [&called](ServerResponse *response){
+        called = true;
+        assert(response->byteCount() == 80);
+    });
+    assert(client.requestsAvailable() == 1);
+
+    ModbusRequest request{WriteRequest05, sizeof(WriteRequest05), false, 0, [](ServerResponse *response){}};
+    assert(client.send(&request));
+    assert(!client.send(&request)); // queue depth is one
+
+    client.start();
+    while(!called){
+        clientScheduler.execute();
+    }
+    client.reset();
+    assert(client.requestsAvailable() == 2);
+}
+
+void GivenPooledClient_WhenPollFails_ThenNullAndSlotKept(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    auto handler = [](ServerResponse *response){};
+
+    ModbusClient<providerType, 2, 1> client {&clientScheduler, &testProvider};
+    uint8_t large[MODERNBUS_POOL_FRAME_SIZE + 1]{};
+    assert(client.tryPoll(large, sizeof(large), handler) == nullptr);
+    assert(client.requestsAvailable() == 2);
+    assert(client.tryPoll(ReadRequest04, sizeof(ReadRequest04), handler) != nullptr);
+    assert(client.tryPoll(ReadRequest01, sizeof(ReadRequest01), handler) != nullptr);
+    // pool exhausted
+    assert(client.tryPoll(ReadRequest04, sizeof(ReadRequest04), handler) == nullptr);
+    client.reset();
+
+    // a slot is left, but an appended request filled the client
+    ModbusClient<providerType, 2, 1> appended {&clientScheduler, &testProvider};
+    ModbusRequest request{ReadRequest04, sizeof(ReadRequest04), false, 0, handler};
+    assert(appended.append(&request));
+    assert(appended.tryPoll(ReadRequest04, sizeof(ReadRequest04), handler) != nullptr);
+    assert(appended.requestsAvailable() == 1);
+    assert(appended.tryPoll(ReadRequest01, sizeof(ReadRequest01), handler) == nullptr);
+    assert(appended.requestsAvailable() == 1);
+    appended.reset();
+}
+
+void GivenPooledClient_WhenFrameSent_ThenSlotReturnedOnceDone(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(WriteRequest05, sizeof(WriteRequest05)); // echo msg
+    mStream.begin();
+
+    ModbusClient<providerType, 1, 1> client {&clientScheduler, &testProvider};
+    bool called{false};
+    ModbusRequest *request{client.send(WriteRequest05, sizeof(WriteRequest05), [&called](ServerResponse *response){
+        called = true;
+        assert(response->functionCode() == 0x05);
+    })};
+    assert(request != nullptr);
+    assert(request->frame() != WriteRequest05);
+    assert(client.requestsAvailable() == 0);
+    // pool exhausted
+    assert(client.send(WriteRequest05, sizeof(WriteRequest05), [](ServerResponse *response){}) == nullptr);
+
+    client.start();
+    while(client.requestsAvailable() == 0){
+        clientScheduler.execute();
+    }
+    assert(called);
+    assert(client.requestCount() == 1);
+    client.reset();
+}
+
+void GivenRequestList_WhenEarlierRemoved_ThenRoundRobinKept(){
+    auto handler = [](ServerResponse *response){};
+    ModbusRequest first{ReadRequest04, sizeof(ReadRequest04), false, 0, handler};
+    ModbusRequest second{ReadRequest04, sizeof(ReadRequest04), false, 0, handler};
+    ModbusRequest third{ReadRequest04, sizeof(ReadRequest04), false, 0, handler};
+    RequestList<3> list{};
+    list.append(&first);
+    list.append(&second);
+    list.append(&third);
+    assert(list.loopNext() == &first);
+    assert(list.loopNext() == &second);
+    // third is next and must not be skipped
+    assert(list.remove(&first) == &first);
+    assert(list.loopNext() == &third);
+    assert(list.loopNext() == &second);
+}
+
+void GivenFinishedSingleRequest_WhenClientStopped_ThenNotFailedAgain(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(WriteRequest05, sizeof(WriteRequest05)); // echo msg
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    uint8_t called{0};
+    ModbusRequest request{WriteRequest05, sizeof(WriteRequest05), false, 0, [&called](ServerResponse *response){
+        called++;
+    }};
+    request.setOnError([](ServerResponse *response, ErrorCode error){
+        assert(false);
+    });
+    client.send(&request);
+    client.start();
+    while(!called){
+        clientScheduler.execute();
+    }
+    client.stop();
+    assert(called == 1);
+}
+
+void GivenResponse_WhenViewedTyped_ThenDecodedInWordOrder(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    bool called{false};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), [&called](ServerResponse *response){
+        called = true;
+        auto values = response->as<float>();
+        assert(values.size() == 20);
+        assert(values[0] > 3.66f && values[0] < 3.67f); // 0x406A9FBE
+        float block[20];
+        assert(values.copyTo(block, 20) == 20);
+        assert(block[19] == values[19]);
+
+        auto swapped = response->as<uint32_t, WordOrder::CDAB>();
+        assert(swapped[0] == 0x9FBE406A);
+        assert(response->as<uint16_t>()[1] == 0x9FBE);
+        assert((response->as<int16_t, WordOrder::BADC>()[0] == 0x6A40));
+        assert(response->bits()[6]); // 0x40
+        assert(!response->bits()[0]);
+    });
+    client.start();
+    while(!called){
+        clientScheduler.execute();
+    }
+}
+
+void GivenProcessImage_WhenPolled_ThenBlockHoldsLastPayload(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ProcessImage<100, 2> image{};
+    ImageBlock *block = image.block(80);
+    assert(block);
+    assert(image.block(40) == nullptr); // exceeds the image
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), false, 2, [](ServerResponse *response){}).publishTo(block);
+    client.start();
+    while(!block->updates()){
+        clientScheduler.execute();
+    }
+    uint8_t copy[80];
+    uint32_t acquired{0};
+    assert(block->read(copy, sizeof(copy), &acquired) == 80);
+    assert(acquired == block->timestamp());
+    for (int i = 0; i < 80; i++){
+        assert(copy[i] == Response04[i + 3]);
+    }
+}
+
+void GivenOnChange_WhenPayloadUnchanged_ThenHandlerSuppressed(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    uint8_t called{0};
+    ModbusRequest &request = client.poll(ReadRequest04, sizeof(ReadRequest04), [&called](ServerResponse *response){
+        called++;
+    }).onChange(3);
+    client.start();
+    while(client.completeCount() < 7){
+        clientScheduler.execute();
+    }
+    // first response, then every third identical one due to heartbeat
+    assert(called == 3);
+    assert(request.suppressedCount() == 4);
+}
+
+void GivenChangeFilterStorage_WhenSignedDeadband_ThenNoHeapAndStepAcrossZeroSmall(){
+    ChangeFilterStorage<4> storage{};
+    uint32_t allocations{allocationCount};
+    ChangeFilter filter{};
+    filter.setStorage(storage.shadow, sizeof(storage.shadow), storage.deadbands, 2);
+    filter.enable(4, 0);
+    assert(filter.setDeadband(0, 5, 2));
+    filter.setSigned(true);
+
+    uint8_t minusOne[4]{0xFF, 0xFF, 0x00, 0x01};
+    uint8_t plusTwo[4]{0x00, 0x02, 0x00, 0x01};
+    uint8_t plusTen[4]{0x00, 0x0A, 0x00, 0x01};
+    assert(filter.accept(minusOne, 4));
+    // 3 is within the band, unsigned it would be 65533
+    assert(!filter.accept(plusTwo, 4));
+    assert(filter.accept(plusTen, 4));
+    assert(storage.shadow[1] == 0x0A);
+    assert(allocationCount == allocations);
+}
+
+void GivenDeadband_WhenRegisterChangesWithinBand_ThenNotAccepted(){
+    ChangeFilter filter{};
+    filter.enable(4, 0);
+    filter.setDeadband(0, 5, 2);
+    uint8_t first[] {0x00, 0x10, 0x00, 0x10};
+    uint8_t small[] {0x00, 0x15, 0x00, 0x10};
+    uint8_t large[] {0x00, 0x16, 0x00, 0x10};
+    uint8_t other[] {0x00, 0x10, 0x00, 0x11};
+    assert(filter.accept(first, 4));
+    assert(!filter.accept(small, 4));
+    assert(filter.accept(large, 4));
+    assert(filter.accept(other, 4)); // second register has no band
+    assert(filter.suppressed() == 1);
+}
+
+void GivenWriteBuffer_WhenNeighbouringWrites_ThenMergedIntoFC16(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response16, sizeof(Response16));
+    mStream.begin();
+
+    WriteBuffer<4> writes{};
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.setWriteBuffer(&writes);
+    uint8_t done{0};
+    auto handler = [&done](uint16_t address, ErrorCode error){
+        assert(error == ErrorCode::noError);
+        done++;
+    };
+    assert(client.queueWrite(0x01, 0x06, 0x0001, 0x000A, handler));
+    assert(client.queueWrite(0x01, 0x06, 0x0002, 0x0000));
+    assert(client.queueWrite(0x01, 0x06, 0x0002, 0x0102, handler)); // last write wins
+    assert(!client.queueWrite(0x01, 0x03, 0x0002, 0x0102));
+    assert(writes.pending() == 2);
+    client.start();
+    while(done < 2){
+        clientScheduler.execute();
+    }
+    // one transaction for both registers
+    assert(client.requestCount() == 1);
+    assert(mStream.compare(WriteRequest16));
+    assert(writes.pending() == 0);
+    assert(writes.mergedCount() == 1);
+}
+
+void GivenWriteBuffer_WhenReplacedWriteFails_ThenBothHandlersGetError(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    uint8_t exception[5] {0x01, 0x86, 0x02};
+    mStream.append(exception, appendCRC(exception, 3));
+    mStream.begin();
+
+    WriteBuffer<4> writes{};
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.setWriteBuffer(&writes);
+    uint8_t failed{0};
+    auto handler = [&failed](uint16_t address, ErrorCode error){
+        assert(address == 0x0002);
+        assert(error == ErrorCode::illegalDataAddress);
+        failed++;
+    };
+    assert(client.queueWrite(0x01, 0x06, 0x0002, 0x0001, handler));
+    assert(client.queueWrite(0x01, 0x06, 0x0002, 0x0102, handler)); // last write wins
+    // the replaced write waits for the result
+    assert(failed == 0);
+    assert(writes.pending() == 2);
+    client.start();
+    while(failed < 2){
+        clientScheduler.execute();
+    }
+    assert(client.requestCount() == 1);
+    assert(writes.pending() == 0);
+}
+
+void GivenLargeWrite16_WhenEchoed_ThenWaitSizedForEcho(){
+    MockStream mStream{};
+    mStream.setBaudRate(9600);
+    providerType testProvider{mStream};
+    uint8_t echo[8] {0x01, 0x10, 0x00, 0x00, 0x00, 60};
+    mStream.append(echo, appendCRC(echo, 6));
+    mStream.begin();
+
+    // 129 byte request, the echo has 8 bytes. A read reply of 60 registers 125.
+    uint8_t frame[7 + 120 + 2]{};
+    ModbusRequest request{frame, buildWriteMultipleFrame(frame, 1, 16, 0, 60, frame + 7, 120), false, 0, [](ServerResponse *response){}};
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.start();
+    unsigned long start{millis()};
+    client.send(&request);
+    while(client.completeCount() < 1){
+        clientScheduler.execute();
+    }
+    // 135 ms to send, 8 ms for the echo
+    assert(millis() - start < 200);
+}
+
+void GivenReadWriteRequest23_WhenResponseReceived_ThenRegistersRead(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    uint8_t response[9] {0x01, 0x17, 0x04, 0x00, 0x01, 0xAB, 0xCD};
+    mStream.append(response, appendCRC(response, 7));
+    mStream.begin();
+
+    uint8_t data[] {0xAB, 0xCD};
+    uint8_t request[15];
+    uint16_t len{buildReadWriteFrame(request, 1, 0x0010, 2, 0x0011, 1, data, 2)};
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    static uint16_t read[2];
+    client.poll(request, len, [](ServerResponse *response){
+        assert(response->functionCode() == 23);
+        assert(response->address() == 0x0010);
+        assert(response->byteCount() == 4);
+        read[0] = response->payload()[0] << 8 | response->payload()[1];
+        read[1] = response->payload()[2] << 8 | response->payload()[3];
+    });
+    client.start();
+    while(client.completeCount() < 1){
+        clientScheduler.execute();
+    }
+    assert(client.errorCount() == 0);
+    assert(read[0] == 0x0001);
+    assert(read[1] == 0xABCD);
+}
+
+void GivenFrameBuffer_WhenPolling_ThenPayloadInBufferAndNothingAllocated(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    static uint8_t frameBuffer[MODBUS_MAX_FRAME_SIZE];
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.setFrameBuffer(frameBuffer);
+    static bool inBuffer{true};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), false, 2, [](ServerResponse *response){
+        inBuffer = inBuffer && response->payload() == frameBuffer + 3;
+    });
+    client.start();
+    while(client.completeCount() < 1){
+        clientScheduler.execute();
+    }
+    uint32_t allocations{allocationCount};
+    while(client.completeCount() < 20){
+        clientScheduler.execute();
+    }
+    assert(allocationCount == allocations);
+    assert(inBuffer);
+    assert(client.errorCount() == 0);
+}
+
+#ifdef MODERNBUS_METRICS
+void GivenClientMetrics_WhenPolling_ThenRoundTripsJitterAndOccupancyRecorded(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), false, 2, [](ServerResponse *response){}).every(10);
+    client.start();
+    while(client.completeCount() < 6){
+        clientScheduler.execute();
+    }
+    ClientMetricsSnapshot snapshot{};
+    client.metrics().snapshot(snapshot);
+    assert(snapshot.roundTrip.count == client.completeCount());
+    assert(snapshot.roundTrip.max > 0);
+    assert(snapshot.slaveCount == 1);
+    assert(snapshot.slaves[0].slaveAddress == 0x01);
+    assert(snapshot.slaves[0].roundTrip.count == snapshot.roundTrip.count);
+    assert(snapshot.untrackedRoundTrips == 0);
+    // every transmission but the first has a period
+    assert(snapshot.pollJitter.count >= snapshot.roundTrip.count - 1);
+    // wire time of request and response bytes
+    size_t frames{(sizeof(ReadRequest04) + sizeof(Response04)) * testProvider._charTime()};
+    assert(snapshot.busyTime == snapshot.roundTrip.count * frames);
+    assert(snapshot.windowTime >= snapshot.busyTime);
+    assert(snapshot.occupancy() > 0 && snapshot.occupancy() <= 1000);
+
+    client.metrics().reset();
+    client.metrics().snapshot(snapshot);
+    assert(snapshot.roundTrip.count == 0 && snapshot.busyTime == 0);
+
+    // a window of 8 slots. Busy time older than the window is dropped.
+    BusOccupancy bus{};
+    uint32_t slot{MODERNBUS_METRICS_SLOT_MS * 1000UL};
+    bus.busy(slot * 100, 1000);
+    bus.busy(slot * 101, 3000);
+    uint32_t busy{0};
+    uint32_t window{0};
+    bus.snapshot(slot * 101 + 10, busy, window);
+    assert(busy == 4000);
+    assert(window == slot + 10 + 1000);
+    bus.snapshot(slot * 108 + 10, busy, window);
+    assert(busy == 3000);
+    bus.busy(slot * 120, 500);
+    bus.snapshot(slot * 120, busy, window);
+    assert(busy == 500);
+    assert(window == 7 * slot);
+}
+#endif
+
+void GivenTraceRecords_WhenEncoded_ThenReadBackUntilCutOff(){
+    int request{0};
+    TraceRecord records[4];
+    for (uint16_t idx = 0; idx < 4; idx++){
+        records[idx].timestamp = 0xFFFFFFF0 + idx * 8;
+        records[idx].event = TraceEvent::clientReceive;
+        records[idx].count = idx;
+        records[idx].request = reinterpret_cast<uintptr_t>(&request);
+    }
+    uint8_t log[TRACE_HEADER_SIZE + 4 * TRACE_RECORD_SIZE];
+    encodeTraceHeader(log);
+    assert(encodeTraceRecords(records, 4, log + TRACE_HEADER_SIZE) == 4 * TRACE_RECORD_SIZE);
+    // the last record is cut off
+    TraceReader reader{log, sizeof(log) - 1};
+    assert(reader.isValid());
+    TraceRecord decoded{};
+    for (uint16_t idx = 0; idx < 3; idx++){
+        assert(reader.next(decoded));
+        assert(decoded.timestamp == records[idx].timestamp);
+        assert(decoded.event == TraceEvent::clientReceive);
+        assert(decoded.count == records[idx].count);
+        assert(decoded.request == records[idx].request);
+    }
+    assert(!reader.next(decoded));
+}
+
+#ifdef MODERNBUS_TRACE
+void GivenTraceBuffer_WhenOverrun_ThenNewestRecordsRead(){
+    TraceBuffer<4> buffer{};
+    uint32_t cursor{buffer.recorded()};
+    int request{0};
+    for (uint16_t idx = 0; idx < 6; idx++){
+        buffer.record(TraceEvent::clientReceive, &request, idx);
+    }
+    TraceRecord records[8];
+    // the two oldest were overwritten
+    assert(buffer.read(cursor, records, 8) == 4);
+    assert(cursor == 6);
+    assert(records[0].count == 2 && records[3].count == 5);
+    assert(records[0].request == reinterpret_cast<uintptr_t>(&request));
+    assert(buffer.read(cursor, records, 8) == 0);
+}
+
+void GivenTracePoints_WhenPolling_ThenTransitionsRecordedInOrder(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    ModbusRequest &request = client.poll(ReadRequest04, sizeof(ReadRequest04), false, 2, [](ServerResponse *response){});
+    uint32_t cursor{modernbusTrace.recorded()};
+    client.start();
+    while(client.completeCount() < 1){
+        clientScheduler.execute();
+    }
+    TraceRecord records[MODERNBUS_TRACE_SIZE];
+    size_t count{modernbusTrace.read(cursor, records, MODERNBUS_TRACE_SIZE)};
+    assert(count >= 5);
+    assert(records[0].event == TraceEvent::clientBegin && records[0].count == sizeof(ReadRequest04));
+    assert(records[1].event == TraceEvent::clientTransmit);
+    assert(records[2].event == TraceEvent::clientEnd);
+    uint16_t received{0};
+    size_t idx{3};
+    while (records[idx].event == TraceEvent::clientReceive){
+        received += records[idx++].count;
+    }
+    assert(received == sizeof(Response04));
+    assert(records[idx].event == TraceEvent::clientComplete && records[idx].count == sizeof(Response04));
+    for (idx = 0; idx < 5; idx++){
+        assert(records[idx].request == reinterpret_cast<uintptr_t>(&request));
+        assert(idx == 0 || records[idx].timestamp - records[idx - 1].timestamp < 1000000);
+    }
+}
+#endif
+
+#ifdef MODERNBUS_EPOLL
+void GivenEpollTimer_WhenDescriptorReadable_ThenRunsBeforeDue(){
+    EpollLoop loop{};
+    EpollLoop::Timer timer{};
+    int pipeFds[2];
+    assert(pipe(pipeFds) == 0);
+    uint16_t runs{0};
+    uint64_t ranAt{0};
+    loop.addTask(timer);
+    timer.set(TASK_IMMEDIATE, TASK_FOREVER, [&](){runs++; ranAt = EpollLoop::now(); timer.delay(10);});
+    timer.watch(pipeFds[0]);
+    timer.wakeOnData(true);
+    timer.enable();
+    uint64_t start{EpollLoop::now()};
+    // data arrives while the timer is delayed by 10 ms
+    assert(write(pipeFds[1], "x", 1) == 1);
+    loop.execute();
+    assert(runs == 1);
+    loop.execute();
+    assert(runs == 2);
+    assert(ranAt - start < 5000);
+
+    // microsecond delay
+    timer.wakeOnData(false);
+    timer.setCallback([&](){runs++; timer.delayMicros(500);});
+    timer.delayMicros(500);
+    start = EpollLoop::now();
+    while (runs < 5){
+        loop.execute();
+    }
+    assert(EpollLoop::now() - start >= 1500);
+    assert(EpollLoop::now() - start < 100000);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+void GivenEpollTimer_WhenIterationsSet_ThenDisabledAfterLastRun(){
+    EpollLoop loop{};
+    EpollLoop::Timer timer{};
+    uint16_t runs{0};
+    loop.addTask(timer);
+    // the loop would sleep for good once the timer is disabled
+    timer.set(1, 3, [&runs, &loop](){runs++; loop.wakeup();});
+    timer.enable();
+    // idle as Scheduler::execute
+    assert(!loop.execute());
+    while (timer.isEnabled()){
+        loop.execute();
+    }
+    assert(runs == 3);
+    timer.set(1, 0, [&runs](){runs++;});
+    assert(!timer.enable());
+}
+#endif
+
+#ifdef MODERNBUS_FUTURES
+void GivenSubmittedFrames_WhenAllCompleted_ThenFuturesHoldResponses(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.setAutoReset(true);
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.start();
+    ModbusFuture futures[3];
+    futures[0] = client.submit(ReadRequest04, sizeof(ReadRequest04));
+    futures[1] = client.submit(ReadRequest04, sizeof(ReadRequest04));
+    futures[2] = client.submit(ReadRequest04, sizeof(ReadRequest04));
+    assert(!futures[0].isReady());
+    assert(futures[1].cancel());
+    assert(!futures[1].cancel());
+
+    assert(whenAll(clientScheduler, futures, 3, 5000));
+    assert(futures[0].ok());
+    assert(futures[0].byteCount() == 80);
+    assert((futures[0].as<uint16_t>()[1] == 0x9FBE));
+    assert(futures[1].isCancelled());
+    assert(futures[2].ok());
+    assert(client.completeCount() == 2);
+
+    ModbusFuture invalid{client.submit(ReadRequest04, 2)};
+    assert(invalid.isReady());
+    assert(!invalid.ok());
+}
+
+void GivenQueuedFutures_WhenClientResetOrDestroyed_ThenFailedAndReleased(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+
+    ModbusFuture reset;
+    ModbusFuture destroyed;
+    ModbusFuture cancelled;
+    {
+        ModbusClient<providerType> client {&clientScheduler, &testProvider};
+        reset = client.submit(ReadRequest04, sizeof(ReadRequest04));
+        client.reset();
+        assert(reset.isReady());
+        assert(reset.error() == ErrorCode::slaveDeviceFailure);
+
+        destroyed = client.submit(ReadRequest04, sizeof(ReadRequest04));
+        cancelled = client.submit(ReadRequest04, sizeof(ReadRequest04));
+        assert(cancelled.cancel());
+        assert(!destroyed.isReady());
+    }
+    assert(destroyed.isReady());
+    assert(!destroyed.ok());
+    assert(destroyed.error() == ErrorCode::slaveDeviceFailure);
+    assert(cancelled.isCancelled());
+
+#ifdef MODERNBUS_THREADS
+    ModbusFuture submitted;
+    {
+        ThreadedModbusClient<providerType> bus{&testProvider};
+        submitted = bus.submit(ReadRequest04, sizeof(ReadRequest04));
+    }
+    assert(submitted.isReady());
+    assert(!submitted.ok());
+#endif
+    // client references are dropped, the heap check of the suite frees the states with the futures
+}
+#endif
+
+#ifdef MODERNBUS_THREADS
+void GivenThreadedClient_WhenManyThreadsSubmit_ThenAllCompleted(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    mStream.append(Response04, sizeof(Response04));
+    mStream.setAutoReset(true);
+    mStream.begin();
+
+    ThreadedModbusClient<providerType> bus{&testProvider};
+    bus.start();
+    std::atomic<uint16_t> completed{0};
+    std::thread producers[4];
+    for (std::thread &producer: producers){
+        producer = std::thread{[&](){
+            for (uint8_t idx = 0; idx < 5; idx++){
+                ModbusFuture future{bus.submit(ReadRequest04, sizeof(ReadRequest04))};
+                if (future.wait(2000) && future.ok() && future.byteCount() == 80){
+                    completed++;
+                }
+            }
+        }};
+    }
+    for (std::thread &producer: producers){
+        producer.join();
+    }
+    bus.stop();
+    assert(completed == 20);
+    assert(bus.client().completeCount() == 20);
+    assert(bus.rejectedCount() == 0);
+}
+#endif
+
+#ifdef MODERNBUS_COROUTINES
+ModbusTask readThenWrite(ModbusClient<providerType> &client, uint8_t &step){
+    TransactionResult read = co_await client.read(0x01, 0x04, 0x0001, 0x28);
+    assert(read.ok());
+    assert(read.byteCount == 80);
+    assert(read.as<uint16_t>()[0] == 0x406A);
+    step++;
+    TransactionResult write = co_await client.write(0x01, 0x05, 0x00AC, 0xFF00);
+    assert(write.ok());
+    assert(write.address == 0x00AC);
+    step++;
+}
+
+void GivenCoroutine_WhenAwaitingTransactions_ThenRunInSequence(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+    // stream starts with the second entry
+    mStream.append(WriteRequest05, sizeof(WriteRequest05));
+    mStream.append(Response04, sizeof(Response04));
+    mStream.setAutoReset(true);
+    mStream.begin();
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    client.start();
+    uint8_t step{0};
+    assert(readThenWrite(client, step).valid());
+    while(step < 2){
+        clientScheduler.execute();
+    }
+    assert(mStream.compare(WriteRequest05));
+    assert(client.completeCount() == 2);
+}
+
+ModbusTask readUntilStopped(ModbusClient<providerType> &client, ErrorCode &error){
+    TransactionResult read = co_await client.read(0x01, 0x04, 0x0001, 0x28);
+    error = read.error;
+}
+
+void GivenAwaitingCoroutine_WhenClientStopped_ThenResumedWithErrorAndSlotReturned(){
+    MockStream mStream{};
+    providerType testProvider{mStream};
+
+    ModbusClient<providerType> client {&clientScheduler, &testProvider};
+    uint16_t available{coroutineSlotsAvailable()};
+    ErrorCode error{ErrorCode::noError};
+    // one in flight, one still queued
+    assert(readUntilStopped(client, error).valid());
+    ErrorCode queued{ErrorCode::noError};
+    assert(readUntilStopped(client, queued).valid());
+    client.start();
+    while(client.requestCount() < 1){
+        clientScheduler.execute();
+    }
+    assert(coroutineSlotsAvailable() == available - 2);
+    client.stop();
+    assert(error == ErrorCode::slaveDeviceFailure);
+    assert(queued == ErrorCode::slaveDeviceFailure);
+    assert(coroutineSlotsAvailable() == available);
+}
+#endif
+
 
 void runClientTest(){
     printf("\n\n -- Testing Modernbus Client -- \n\n");
@@ -364,6 +1128,70 @@ void runClientTest(){
     printf(".");
     GivenClientPollingRequest_WhenResponseTakesLong_ThenTimeOutOccurs();
     printf(".");
+    GivenPooledClient_WhenPolling_ThenRequestsTakenFromPool();
+    printf(".");
+    GivenPooledClient_WhenPollFails_ThenNullAndSlotKept();
+    printf(".");
+    GivenPooledClient_WhenFrameSent_ThenSlotReturnedOnceDone();
+    printf(".");
+    GivenRequestList_WhenEarlierRemoved_ThenRoundRobinKept();
+    printf(".");
+    GivenFinishedSingleRequest_WhenClientStopped_ThenNotFailedAgain();
+    printf(".");
+    GivenResponse_WhenViewedTyped_ThenDecodedInWordOrder();
+    printf(".");
+    GivenProcessImage_WhenPolled_ThenBlockHoldsLastPayload();
+    printf(".");
+    GivenOnChange_WhenPayloadUnchanged_ThenHandlerSuppressed();
+    printf(".");
+    GivenChangeFilterStorage_WhenSignedDeadband_ThenNoHeapAndStepAcrossZeroSmall();
+    printf(".");
+    GivenDeadband_WhenRegisterChangesWithinBand_ThenNotAccepted();
+    printf(".");
+    GivenWriteBuffer_WhenNeighbouringWrites_ThenMergedIntoFC16();
+    printf(".");
+    GivenWriteBuffer_WhenReplacedWriteFails_ThenBothHandlersGetError();
+    printf(".");
+    GivenLargeWrite16_WhenEchoed_ThenWaitSizedForEcho();
+    printf(".");
+    GivenReadWriteRequest23_WhenResponseReceived_ThenRegistersRead();
+    printf(".");
+    GivenFrameBuffer_WhenPolling_ThenPayloadInBufferAndNothingAllocated();
+    printf(".");
+#ifdef MODERNBUS_METRICS
+    GivenClientMetrics_WhenPolling_ThenRoundTripsJitterAndOccupancyRecorded();
+    printf(".");
+#endif
+    GivenTraceRecords_WhenEncoded_ThenReadBackUntilCutOff();
+    printf(".");
+#ifdef MODERNBUS_TRACE
+    GivenTraceBuffer_WhenOverrun_ThenNewestRecordsRead();
+    printf(".");
+    GivenTracePoints_WhenPolling_ThenTransitionsRecordedInOrder();
+    printf(".");
+#endif
+#ifdef MODERNBUS_EPOLL
+    GivenEpollTimer_WhenDescriptorReadable_ThenRunsBeforeDue();
+    printf(".");
+    GivenEpollTimer_WhenIterationsSet_ThenDisabledAfterLastRun();
+    printf(".");
+#endif
+#ifdef MODERNBUS_FUTURES
+    GivenSubmittedFrames_WhenAllCompleted_ThenFuturesHoldResponses();
+    printf(".");
+    GivenQueuedFutures_WhenClientResetOrDestroyed_ThenFailedAndReleased();
+    printf(".");
+#endif
+#ifdef MODERNBUS_THREADS
+    GivenThreadedClient_WhenManyThreadsSubmit_ThenAllCompleted();
+    printf(".");
+#endif
+#ifdef MODERNBUS_COROUTINES
+    GivenCoroutine_WhenAwaitingTransactions_ThenRunInSequence();
+    printf(".");
+    GivenAwaitingCoroutine_WhenClientStopped_ThenResumedWithErrorAndSlotReturned();
+    printf(".");
+#endif
 
     printf("\n");
     runningTime = millis() - runningTime;
@@ -4,15 +4,21 @@
 #include "../src/modernbus_client.h"
 #include "../src/modernbus_server.h"
 #include "../src/modernbus_crosslink.h"
+#include "../src/modernbus_capture.h"
+#include "../src/modernbus_replay.h"
+#if defined(__linux__)
+    #include <unistd.h>
+#endif
 
 CrossLinkManager manager{};
 CrossLinkStream clientStream{manager.first};
 CrossLinkProvider clientProvider{clientStream};
 CrossLinkStream serverStream{manager.second};
 CrossLinkProvider serverProvider{serverStream};
-Scheduler scheduler{};
+ExecutorLoop scheduler{};
 
 using ResponseT = ModbusResponse<CrossLinkProvider>;
+using SimulatedResponseT = ModbusResponse<SimulatedLinkProvider>;
 
 
 void GivenClientAndServer_WhenBothUsingCrosslink_ThenNoError(){
@@ -101,6 +107,197 @@ void GivenRequest04_WhenWithMap_ThenNoError(){
 
 }
 
+void GivenSimulatedLink_WhenBytesWritten_ThenAvailableAtLineSpeed(){
+    SimulatedLink link{};
+    link.configure(LineSettings{9600, 8, LineParity::even, 1, 500, 0});
+    // start, 8 data, parity and stop bit
+    assert(link.charTime() == 1146);
+    uint32_t start = micros();
+    for (uint8_t idx = 0; idx < 10; idx++){
+        link.first.write(idx);
+    }
+    assert(link.second.available() == 0);
+    while (link.second.available() < 10){}
+    assert(micros() - start >= 10 * 1146 + 500);
+    for (uint8_t idx = 0; idx < 10; idx++){
+        assert(link.second.read() == idx);
+    }
+    assert(link.second.read() == -1);
+
+    // the answer starts a turnaround after the question arrived
+    link.configure(LineSettings{9600, 8, LineParity::none, 1, 0, 2000});
+    start = micros();
+    link.first.write(0x01);
+    link.second.write(0x02);
+    while (!link.first.available()){}
+    assert(micros() - start >= 1042 + 2000 + 1042);
+    assert(link.first.read() == 0x02);
+    assert(link.second.read() == 0x01);
+
+    LineFaults faults{};
+    faults.bitErrorRate = 1000000;
+    link.first.setFaults(faults);
+    for (uint8_t idx = 0; idx < 8; idx++){
+        link.first.write(0x00);
+    }
+    while (link.second.available() < 8){}
+    for (uint8_t idx = 0; idx < 8; idx++){
+        uint8_t value = link.second.read();
+        assert(value && !(value & (value - 1)));
+    }
+    assert(link.first.stats().corrupted == 8);
+
+    faults = LineFaults{};
+    faults.dropRate = 1000000;
+    link.first.setFaults(faults);
+    link.first.write(0x03);
+    link.first.write(0x04);
+    delayMicroseconds(3 * 1042);
+    assert(link.second.available() == 0);
+    assert(link.first.stats().dropped == 2);
+    assert(link.first.stats().sent == 21);
+}
+
+void GivenSimulatedLine_WhenResponsesSplitOrLost_ThenClientReassemblesAndTimesOut(){
+    SimulatedLink link{};
+    link.configure(LineSettings{19200, 8, LineParity::even, 1, 100, 200});
+    LineFaults faults{};
+    faults.splitRate = 50000;
+    faults.splitGap = 1000;
+    faults.jitter = 200;
+    link.second.setFaults(faults);
+    SimulatedLinkProvider clientLine{link.first};
+    SimulatedLinkProvider serverLine{link.second};
+    ModbusClient<SimulatedLinkProvider> client{&scheduler, &clientLine};
+    ModbusServer<SimulatedLinkProvider> server{&scheduler, &serverLine, 0x01};
+    server.setInterval(1);
+    client.poll(ReadRequest04, sizeof(ReadRequest04), [](ServerResponse *response){
+        assert(response->payload()[0] == 0x00);
+        assert(response->payload()[79] == 0x4f);
+    });
+    server.responseTo(0x04, 0x01, [](SimulatedResponseT *response){
+        response->send(Payload04, sizeof(Payload04));
+    });
+    client.start();
+    server.start();
+    while(client.completeCount() < 5){
+        scheduler.execute();
+    }
+    assert(client.errorCount() == 0);
+    assert(link.second.stats().split > 0);
+
+    // lost responses time out, the next ones complete again
+    faults = LineFaults{};
+    faults.dropRate = 1000000;
+    link.second.setFaults(faults);
+    while(client.timeoutCount() < 1){
+        scheduler.execute();
+    }
+    link.second.setFaults(LineFaults{});
+    uint32_t completed{client.completeCount()};
+    while(client.completeCount() < completed + 2){
+        scheduler.execute();
+    }
+}
+
+#if defined(__linux__)
+void GivenCapturedSession_WhenReplayedFastest_ThenClientGetsCapturedResponses(){
+    const char *path{"/tmp/modernbus_test.mbcap"};
+    unlink(path);
+    {
+        CaptureFile capture{path, 19200};
+        CaptureProvider<CrossLinkProvider> provider{capture, clientStream};
+        ModbusClient<CaptureProvider<CrossLinkProvider>> client{&scheduler, &provider};
+        ModbusServer<CrossLinkProvider> server{&scheduler, &serverProvider, 0x01};
+        client.poll(ReadRequest04, sizeof(ReadRequest04), [](ServerResponse *response){});
+        server.responseTo(0x04, 0x01, [](ResponseT *response){
+            response->send(Payload04, sizeof(Payload04));
+        });
+        client.start();
+        server.start();
+        while(client.completeCount() < 5){
+            scheduler.execute();
+        }
+    }
+
+    CaptureLog log{path};
+    CaptureReader reader{log.data(), log.size()};
+    assert(reader.isValid());
+    assert(reader.baudRate() == 19200);
+    CaptureRecord record{};
+    uint8_t requests{0};
+    uint8_t responses{0};
+    while (reader.next(record)){
+        if (record.direction == CaptureDirection::tx){
+            assert(record.crcOk);
+            assert(record.length == sizeof(ReadRequest04));
+            assert(!memcmp(record.data, ReadRequest04, sizeof(ReadRequest04)));
+            requests++;
+        } else if (record.crcOk){
+            assert(record.length == sizeof(Payload04) + 5);
+            responses++;
+        }
+    }
+    assert(requests >= 5);
+    assert(responses >= 5);
+
+    ReplayProvider replay{log, ReplayMode::fastest};
+    assert(replay.isValid());
+    ModbusClient<ReplayProvider> client{&scheduler, &replay};
+    client.poll(ReadRequest04, sizeof(ReadRequest04), [](ServerResponse *response){
+        assert(response->payload()[0] == 0x00);
+        assert(response->payload()[79] == 0x4f);
+    });
+    client.start();
+    while(client.completeCount() < 5){
+        scheduler.execute();
+    }
+    assert(replay.bytesWritten() >= 5 * sizeof(ReadRequest04));
+    unlink(path);
+}
+#endif
+
+/*
+Capture sink into memory.
+*/
+class MemorySink: public CaptureSink{
+    public:
+        uint8_t log[256];
+        size_t size{0};
+
+    protected:
+        void _write(const uint8_t *data, size_t length) override {
+            memcpy(log + size, data, length);
+            size += length;
+        };
+};
+
+void GivenCaptureBeyondMicrosWrap_WhenRead_ThenTimestampsKeep64Bit(){
+    MemorySink sink{};
+    sink.begin(9600);
+    uint64_t late{(1ULL << 32) + 16};
+    sink.record(CaptureDirection::tx, 0xFFFFFFF0, ReadRequest04, sizeof(ReadRequest04));
+    sink.record(CaptureDirection::tx, late, ReadRequest04, sizeof(ReadRequest04));
+    assert(sink.size == CAPTURE_HEADER_SIZE + 2 * (CAPTURE_RECORD_HEADER_SIZE + sizeof(ReadRequest04)));
+
+    CaptureReader reader{sink.log, sink.size};
+    assert(reader.isValid());
+    CaptureRecord record{};
+    assert(reader.next(record) && record.timestamp == 0xFFFFFFF0);
+    assert(reader.next(record) && record.timestamp == late);
+    assert(record.crcOk && record.length == sizeof(ReadRequest04));
+    assert(!reader.next(record));
+
+    // version 1 log with a 32 bit timestamp
+    uint8_t v1[CAPTURE_HEADER_SIZE + CAPTURE_V1_RECORD_HEADER_SIZE + 2]{'M', 'B', 'C', 'P', 1, 0, 0, 0, 0x80, 0x25, 0, 0,
+        2, 0, 1, 0, 0x78, 0x56, 0x34, 0x12, 0xAA, 0xBB};
+    CaptureReader old{v1, sizeof(v1)};
+    assert(old.isValid() && old.baudRate() == 9600);
+    assert(old.next(record));
+    assert(record.timestamp == 0x12345678 && record.length == 2 && record.data[1] == 0xBB);
+    assert(!old.next(record));
+}
+
 void runIntegrationTests(){
     Serial.print("\n-- Testing integration of Modernbus --\n");
     GivenClientAndServer_WhenBothUsingCrosslink_ThenNoError();
@@ -111,5 +308,15 @@ void runIntegrationTests(){
     Serial.print(".");
     GivenRequest04_WhenWithMap_ThenNoError();
     Serial.print(".");
+    GivenSimulatedLink_WhenBytesWritten_ThenAvailableAtLineSpeed();
+    Serial.print(".");
+    GivenSimulatedLine_WhenResponsesSplitOrLost_ThenClientReassemblesAndTimesOut();
+    Serial.print(".");
+    GivenCaptureBeyondMicrosWrap_WhenRead_ThenTimestampsKeep64Bit();
+    Serial.print(".");
+#if defined(__linux__)
+    GivenCapturedSession_WhenReplayedFastest_ThenClientGetsCapturedResponses();
+    Serial.print(".");
+#endif
     Serial.print("\n-- Integration Test Done --\n");
 }
@@ -4,12 +4,21 @@
 #include "mock.hpp"
 #include "../src/modernbus_server.h"
 #include "../src/modernbus_provider.h"
+#include "../src/modernbus_mapped_source.h"
+#include "../src/modernbus_tcp_server.h"
+#include <thread>
+#if defined(__linux__)
+    #include <ctime>
+    #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
 
 
 
 using provideType = ProviderRS485<HardwareSerial>;
 
-Scheduler serverScheduler{};
+ExecutorLoop serverScheduler{};
 
 void GivenStreamWhenNewInstanceThenNoError(){
     ProviderRS485<HardwareSerial> provider{Serial, 0};
@@ -241,7 +250,613 @@ void GivenReadRequest04_WhenRegisterRequestedToLarge_ThenException(){
     }
     assert(mock.writeBuffer()[0] == 0x01);
     assert(mock.writeBuffer()[1] == 4 + 128);
-    assert(mock.writeBuffer()[2] == 3);
+    // registers 1 - 40 run past the mapped 0 - 3
+    assert(mock.writeBuffer()[2] == 2);
+}
+
+void GivenManyResponses_WhenRequest04RunsPastRange_ThenIllegalDataAddress(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    static uint16_t routedTo{0xFFFF};
+    // registered out of order, each serving 4 registers
+    for (uint16_t address = 400; address > 0; address -= 4){
+        server.responseTo(04, address, [](ModbusResponse<SerialProvider<MockStream>> *response){
+            routedTo = response->address();
+            response->sendException(ErrorCode::illegalDataValue);
+        }).range(4);
+    }
+    server.responseTo(04, 0x0000, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        routedTo = response->address();
+        response->sendException(ErrorCode::illegalDataValue);
+    }).range(4);
+    server.responseTo(03, 0x0001).with(Payload04, sizeof(Payload04));
+    assert(server.overlapCount() == 0);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    // registers 1 - 40 run past the range of 0 - 3
+    assert(routedTo == 0xFFFF);
+    assert(mock.writeBuffer()[1] == 04 + 128);
+    assert(mock.writeBuffer()[2] == 2);
+}
+
+void GivenRange_WhenRequestBehindRangeEnd_ThenIllegalDataAddress(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    // serves register 0 only. Request starts at 1
+    server.responseTo(04, 0x0000, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        ESP.restart();
+    }).range(1);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(mock.writeBuffer()[1] == 04 + 128);
+    assert(mock.writeBuffer()[2] == 2);
+}
+
+void GivenOverlappingMappings_WhenRouted_ThenOverlapCounted(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+
+    server.responseTo(04, 0x0000).with(Payload04, 20);      // 0 - 9
+    server.responseTo(04, 0x000A).with(Payload04, 20);      // 10 - 19
+    assert(server.overlapCount() == 0);
+    server.responseTo(04, 0x0005).with(Payload04, 4);       // 5 - 6
+    assert(server.overlapCount() == 1);
+    // open ended handlers end before the next response
+    server.responseTo(03, 0x0000, [](ModbusResponse<SerialProvider<MockStream>> *response){});
+    server.responseTo(03, 0x0010, [](ModbusResponse<SerialProvider<MockStream>> *response){});
+    assert(server.overlapCount() == 1);
+    server.responseTo(03, 0x0010, [](ModbusResponse<SerialProvider<MockStream>> *response){});
+    assert(server.overlapCount() == 2);
+}
+
+void GivenRegisterBank_WhenReadCoils_ThenPackedFromBank(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest01, sizeof(ReadRequest01));
+    mock.begin();
+
+    RegisterBank<200, 0, 10, 50> bank{};
+    bank.setCoil(10, true);
+    bank.setCoil(12, true);
+    bank.setCoil(22, true);
+    bank.setCoil(23, true); // not requested
+    server.serve(bank);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    // coils 10 - 22
+    assert(mock.writeBuffer()[1] == 0x01);
+    assert(mock.writeBuffer()[2] == 2);
+    assert(mock.writeBuffer()[3] == 0x05);
+    assert(mock.writeBuffer()[4] == 0x10);
+}
+
+void GivenRegisterBank_WhenReadRequest04_ThenRegistersFromBank(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    RegisterBank<0, 0, 0, 50> bank{};
+    bank.setInputRegister(1, 0x1234);
+    bank.setInputRegisters<float>(38, 1.0f);
+    server.serve(bank);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(mock.writeBuffer()[1] == 0x04);
+    assert(mock.writeBuffer()[2] == 80);
+    assert(mock.writeBuffer()[3] == 0x12);
+    assert(mock.writeBuffer()[4] == 0x34);
+    assert(mock.writeBuffer()[77] == 0x3F);
+    assert(mock.writeBuffer()[78] == 0x80);
+    assert((bank.inputRegisters<float>()[19] == 1.0f));
+}
+
+void GivenRegisterBank_WhenWriteRequest16_ThenWrittenAndNotified(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(WriteRequest16, sizeof(WriteRequest16));
+    mock.begin();
+
+    RegisterBank<0, 0, 10, 0> bank{};
+    static uint16_t written{0};
+    bank.onWrite([](uint8_t functionCode, uint16_t address, uint16_t quantity){
+        assert(functionCode == 16);
+        assert(address == 1);
+        written += quantity;
+    });
+    server.serve(bank);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(written == 2);
+    assert(bank.holdingRegister(1) == 0x000A);
+    assert(bank.holdingRegister(2) == 0x0102);
+    for (uint8_t idx = 0; idx < sizeof(Response16); idx++){
+        assert(mock.writeBuffer()[idx] == Response16[idx]);
+    }
+}
+
+void GivenRegisterBank_WhenRequestBehindArea_ThenIllegalDataAddress(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    // request reads 1 - 40
+    RegisterBank<0, 0, 0, 40> bank{};
+    server.serve(bank);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(mock.writeBuffer()[1] == 04 + 128);
+    assert(mock.writeBuffer()[2] == 2);
+}
+
+void GivenRegisterBank_WhenMaskWriteRequest22_ThenMaskedAndEchoed(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    // example of the spec: register 0x12 becomes 0x17
+    uint8_t request[10];
+    uint16_t len{buildMaskWriteFrame(request, 1, 0x0004, 0x00F2, 0x0025)};
+    mock.append(request, len);
+    mock.begin();
+
+    RegisterBank<0, 0, 10, 0> bank{};
+    bank.setHoldingRegister(4, 0x0012);
+    server.serve(bank);
+
+    server.start();
+    while (bank.holdingRegister(4) == 0x0012){
+        serverScheduler.execute();
+    }
+    assert(bank.holdingRegister(4) == 0x0017);
+    for (uint8_t idx = 0; idx < len; idx++){
+        assert(mock.writeBuffer()[idx] == request[idx]);
+    }
+}
+
+void GivenRegisterBank_WhenReadWriteRequest23_ThenWrittenBeforeRead(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    // writes register 3, reads 2 - 4
+    uint8_t data[] {0xAB, 0xCD};
+    uint8_t request[15];
+    uint16_t len{buildReadWriteFrame(request, 1, 0x0002, 3, 0x0003, 1, data, 2)};
+    mock.append(request, len);
+    mock.begin();
+
+    RegisterBank<0, 0, 10, 0> bank{};
+    bank.setHoldingRegister(2, 0x0102);
+    bank.setHoldingRegister(4, 0x0304);
+    server.serve(bank);
+
+    server.start();
+    while (bank.holdingRegister(3) != 0xABCD){
+        serverScheduler.execute();
+    }
+    uint8_t expected[] {0x01, 0x17, 0x06, 0x01, 0x02, 0xAB, 0xCD, 0x03, 0x04};
+    for (uint8_t idx = 0; idx < sizeof(expected); idx++){
+        assert(mock.writeBuffer()[idx] == expected[idx]);
+    }
+}
+
+void GivenMappedSource_WhenReadRequest04_ThenServedFromSnapshot(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    MappedSource<80> source{};
+    assert(source.publish(Payload04, sizeof(Payload04)));
+    assert(!source.publish(Payload04, 2, 79)); // exceeds the source
+    server.responseTo(04, 0x0000).with(source, 1);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(mock.writeBuffer()[0] == 0x01);
+    assert(mock.writeBuffer()[1] == 0x04);
+    assert(mock.writeBuffer()[2] == 0x27);
+    assert(mock.writeBuffer()[3] == 0x01);
+    assert(mock.writeBuffer()[40] == 0x26);
+    assert(source.updates() == 1);
+}
+
+void GivenMappedSource_WhenWriterUpdatesConcurrently_ThenSnapshotsNotTorn(){
+    static MappedSource<8> source{};
+    std::atomic<bool> done{false};
+    std::thread writer{[&](){
+        for (uint32_t value = 0; value < 20000; value++){
+            // both values are always updated together
+            uint8_t *live = source.beginUpdate();
+            PayloadCodec<uint32_t>::encode(value, live);
+            PayloadCodec<uint32_t>::encode(value, live + 4);
+            source.endUpdate();
+        }
+        done = true;
+    }};
+    uint32_t snapshots{0};
+    while (!done || snapshots == 0){
+        PayloadView<uint32_t> view{source.snapshot(), 8};
+        assert(view[0] == view[1]);
+        snapshots++;
+    }
+    writer.join();
+    assert(source.updates() == 20000);
+    assert(source.set<float>(2, 1.5f));
+    assert(!source.set<float>(3, 1.5f));
+    assert((PayloadView<float>{source.snapshot(), 8}[1] == 1.5f));
+}
+
+void GivenUnitRange_WhenFramesToSeveralUnits_ThenEachFrameParsedOnce(){
+    // fc 06 to units 0x11, 0x30 (not served), 0x01 and 0x12
+    static uint8_t frames[] {
+        0x11, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0x9B,
+        0x30, 0x06, 0x00, 0x02, 0x00, 0x02, 0xAD, 0xEA,
+        0x01, 0x06, 0x00, 0x01, 0x00, 0x03, 0x98, 0x0B,
+        0x12, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0xA8
+    };
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(frames, sizeof(frames));
+    mock.begin();
+
+    static uint8_t rack[3]{};
+    static uint8_t own{0};
+    server.units(0x10, 0x1F).responseTo(06, 0x0001, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        rack[response->unitId() - 0x10]++;
+        response->sendEcho();
+    });
+    server.responseTo(06, 0x0001, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        assert(response->unitId() == 1);
+        own++;
+        response->sendEcho();
+    });
+    assert(server.serves(0x01) && server.serves(0x10) && server.serves(0x1F));
+    assert(!server.serves(0x30));
+    assert(&server.unit(0x15) == &server.unit(0x10));
+    assert(&server.unit(0x01) != &server.unit(0x10));
+    // all ids served, no table added
+    assert(&server.units(0x10, 0x12) == &server.unit(0x10));
+    assert(&server.units(0x01, 0x01) == &server.unit(0x01));
+
+    server.start();
+    while (rack[2] == 0){
+        serverScheduler.execute();
+    }
+    assert(rack[0] == 0);
+    assert(rack[1] == 1);
+    assert(own == 1);
+    assert(server.errorCount() == 0);
+}
+
+void GivenUnit_WhenRequestToUnknownAddress_ThenExceptionFromThatUnit(){
+    static uint8_t frame[] {0x07, 0x04, 0x00, 0x01, 0x00, 0x28, 0x00, 0x00};
+    uint16_t crc = crc16(frame, 6);
+    frame[6] = lowByte(crc);
+    frame[7] = highByte(crc);
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(frame, sizeof(frame));
+    mock.begin();
+
+    // unit 1 would serve the request, unit 7 does not
+    server.responseTo(04, 0x0000).with(Payload04, sizeof(Payload04));
+    server.unit(7).responseTo(04, 0x0100).range(4);
+
+    server.start();
+    while (!server.getParser().isComplete() && !server.getParser().isError()){
+        serverScheduler.execute();
+    }
+    assert(mock.writeBuffer()[0] == 0x07);
+    assert(mock.writeBuffer()[1] == 04 + 128);
+    assert(mock.writeBuffer()[2] == 2);
+}
+
+void GivenDeferredResponse_WhenCompletedByOtherThread_ThenReplySent(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+    mock.setUnavailable(sizeof(ReadRequest04), 1000);
+
+    static DeferredResponse<SerialProvider<MockStream>> *deferred{nullptr};
+    server.responseTo(04, 0x0000, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        deferred = &response->defer(500);
+    });
+    server.start();
+    while (!deferred){
+        serverScheduler.execute();
+    }
+    assert(deferred->isPending());
+    assert(deferred->address() == 1 && deferred->quantity() == 40);
+    std::thread backend{[](){
+        delay(10);
+        assert(deferred->send(Payload04, 4));
+        assert(!deferred->sendEcho()); // already completed
+    }};
+    uint32_t start = millis();
+    while (millis() - start < 100){
+        serverScheduler.execute();
+    }
+    backend.join();
+    assert(!deferred->isPending());
+    uint8_t expected[] {0x01, 0x04, 0x04, 0x00, 0x01, 0x02, 0x03};
+    for (uint8_t idx = 0; idx < sizeof(expected); idx++){
+        assert(mock.writeBuffer()[idx] == expected[idx]);
+    }
+    assert(deferred->expiredCount() == 0);
+}
+
+void GivenDeferredResponse_WhenNotCompletedInTime_ThenBusyException(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+    mock.setUnavailable(sizeof(ReadRequest04), 1000);
+
+    static DeferredResponse<SerialProvider<MockStream>> *deferred{nullptr};
+    deferred = nullptr;
+    server.responseTo(04, 0x0001, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        deferred = &response->defer(20);
+    }).with(Payload04, sizeof(Payload04));
+    server.start();
+    while (!deferred){
+        serverScheduler.execute();
+    }
+    uint32_t start = millis();
+    while (millis() - start < 100){
+        serverScheduler.execute();
+    }
+    assert(!deferred->isPending());
+    assert(deferred->expiredCount() == 1);
+    assert(!deferred->send(Payload04, 4)); // too late
+    // the mapping is not sent in place of the deferred reply
+    assert(mock.writeBuffer()[0] == 0x01);
+    assert(mock.writeBuffer()[1] == 04 + 128);
+    assert(mock.writeBuffer()[2] == SLAVE_DEVICE_BUSY);
+}
+
+#ifdef MODERNBUS_METRICS
+void GivenMetrics_WhenRequestsServed_ThenCountedPerFunctionCode(){
+    MockStream mock{};
+    SerialProvider<MockStream> provider{mock};
+    ModbusServer<SerialProvider<MockStream>> server {&serverScheduler, &provider, 1};
+    mock.append(ReadRequest04, sizeof(ReadRequest04));
+    mock.begin();
+
+    static uint8_t calls{0};
+    calls = 0;
+    // first request answered, second one illegal data value
+    server.responseTo(04, 0x0000, [](ModbusResponse<SerialProvider<MockStream>> *response){
+        if (calls++ == 0){
+            response->send(Payload04, 80);
+        } else {
+            response->sendException(ErrorCode::illegalDataValue);
+        }
+    });
+    server.start();
+    while (calls < 2){
+        serverScheduler.execute();
+    }
+    ServerMetricsSnapshot snapshot{};
+    server.metrics().snapshot(snapshot);
+    assert(snapshot.requests[4] == 2);
+    assert(snapshot.requests[3] == 0);
+    assert(snapshot.exceptions[3] == 1);
+    assert(snapshot.parserErrors == 0);
+    assert(snapshot.handler.count == 2);
+    assert(snapshot.turnaround.count == 2);
+    assert(snapshot.parse.count == 2);
+    assert(snapshot.turnaround.percentile(100) >= snapshot.turnaround.percentile(50));
+
+    server.metrics().reset();
+    server.metrics().snapshot(snapshot);
+    assert(snapshot.requests[4] == 0 && snapshot.handler.count == 0);
+
+    LatencyHistogram histogram{};
+    for (uint32_t us: {0, 1, 3, 100, 100, 100, 100, 5000}){
+        histogram.record(us);
+    }
+    LatencySnapshot latency{};
+    histogram.snapshot(latency);
+    assert(latency.buckets[0] == 1 && latency.buckets[1] == 1 && latency.buckets[2] == 1);
+    assert(latency.buckets[7] == 4); // 64 - 127 us
+    assert(latency.percentile(50) == 127);
+    assert(latency.max == 5000);
+    assert(latency.mean() == 5404 / 8);
+}
+#endif
+
+#if defined(__linux__)
+// sends one modbus tcp request and returns the reply length
+size_t tcpTransaction(int fd, const uint8_t* request, size_t len, uint8_t* reply){
+    assert(send(fd, request, len, 0) == (ssize_t)len);
+    size_t received{0};
+    while (received < 7 || received < 6u + ((reply[4] << 8) | reply[5])){
+        ssize_t n = recv(fd, reply + received, 260 - received, 0);
+        assert(n > 0);
+        received += n;
+    }
+    return received;
+}
+
+int tcpConnect(uint16_t port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    return fd;
+}
+
+void GivenShardedTcpServer_WhenManyConnections_ThenServedFromSharedBank(){
+    static RegisterBank<0, 0, 16, 0> bank{};
+    for (uint16_t idx = 0; idx < 16; idx++){
+        bank.setHoldingRegister(idx, 0x0100 + idx);
+    }
+    ShardedTcpServer server{bank, 2};
+    assert(server.start(0));
+    assert(server.port() != 0);
+    assert(server.workerCount() == 2);
+
+    std::thread masters[4];
+    for (std::thread &master: masters){
+        master = std::thread{[&server](){
+            int fd = tcpConnect(server.port());
+            for (uint16_t transaction = 0; transaction < 200; transaction++){
+                // read 4 holding registers from 2
+                uint8_t request[] {highByte(transaction), lowByte(transaction), 0, 0, 0, 6, 1, 0x03, 0x00, 0x02, 0x00, 0x04};
+                uint8_t reply[260];
+                assert(tcpTransaction(fd, request, sizeof(request), reply) == 7 + 2 + 8);
+                assert(reply[0] == highByte(transaction) && reply[1] == lowByte(transaction));
+                assert(reply[7] == 0x03 && reply[8] == 8);
+                assert(reply[9] == 0x01 && reply[10] == 0x02);
+                assert(reply[15] == 0x01 && reply[16] == 0x05);
+            }
+            close(fd);
+        }};
+    }
+    for (std::thread &master: masters){
+        master.join();
+    }
+
+    int fd = tcpConnect(server.port());
+    uint8_t reply[260];
+    uint8_t write06[] {0, 1, 0, 0, 0, 6, 1, 0x06, 0x00, 0x03, 0xBE, 0xEF};
+    assert(tcpTransaction(fd, write06, sizeof(write06), reply) == sizeof(write06));
+    assert(reply[7] == 0x06 && reply[10] == 0xBE && reply[11] == 0xEF);
+    assert(bank.holdingRegister(3) == 0xBEEF);
+    uint8_t unknown08[] {0, 2, 0, 0, 0, 6, 1, 0x08, 0x00, 0x00, 0x00, 0x00};
+    assert(tcpTransaction(fd, unknown08, sizeof(unknown08), reply) == 9);
+    assert(reply[7] == 0x88 && reply[8] == 1);
+    uint8_t behind03[] {0, 3, 0, 0, 0, 6, 1, 0x03, 0x00, 0x0F, 0x00, 0x02};
+    assert(tcpTransaction(fd, behind03, sizeof(behind03), reply) == 9);
+    assert(reply[7] == 0x83 && reply[8] == 2);
+    close(fd);
+
+    assert(server.requestCount() == 4 * 200 + 3);
+    server.stop();
+    assert(!server.isRunning());
+}
+
+void GivenShardedTcpServer_WhenMasterPipelinesWithoutReading_ThenWorkerWaitsIdle(){
+    static RegisterBank<0, 0, 125, 0> bank{};
+    ShardedTcpServer server{bank, 1};
+    assert(server.start(0));
+    int fd = tcpConnect(server.port());
+    // a stalled worker fails the test instead of blocking it
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // replies of 259 bytes, more than the socket buffers hold
+    const uint32_t requests{40000};
+    std::thread master{[fd](){
+        uint8_t request[] {0, 0, 0, 0, 0, 6, 1, 0x03, 0x00, 0x00, 0x00, 125};
+        for (uint32_t idx = 0; idx < requests; idx++){
+            assert(send(fd, request, sizeof(request), 0) == (ssize_t)sizeof(request));
+        }
+    }};
+    delay(100);
+    // the worker waits for the master to read, it does not spin
+    std::clock_t start{std::clock()};
+    delay(200);
+    assert((std::clock() - start) * 1000 / CLOCKS_PER_SEC < 50);
+
+    uint8_t reply[4096];
+    size_t received{0};
+    while (received < requests * 259u){
+        ssize_t n = recv(fd, reply, sizeof(reply), 0);
+        assert(n > 0);
+        received += n;
+    }
+    master.join();
+    assert(received == requests * 259u);
+    assert(server.requestCount() == requests);
+    close(fd);
+    server.stop();
+}
+#endif
+
+void GivenFrameParser_WhenFramesSplitAcrossSpans_ThenEachParsedOnce(){
+    FrameParser parser{true};
+    parser.setSlaveAddress(1);
+    // noise, fc 16, fc 04, bad crc
+    uint8_t stream[3 + sizeof(WriteRequest16) + sizeof(ReadRequest04) + sizeof(BadCRCRequest04)] {0x07, 0x00, 0x55};
+    uint16_t len{3};
+    memcpy(stream + len, WriteRequest16, sizeof(WriteRequest16));
+    len += sizeof(WriteRequest16);
+    memcpy(stream + len, ReadRequest04, sizeof(ReadRequest04));
+    len += sizeof(ReadRequest04);
+    memcpy(stream + len, BadCRCRequest04, sizeof(BadCRCRequest04));
+    len += sizeof(BadCRCRequest04);
+
+    for (uint16_t span = 1; span <= len; span++){
+        uint8_t complete{0};
+        uint8_t errors{0};
+        uint16_t idx{0};
+        while (idx < len){
+            size_t chunk = len - idx < span ? len - idx : span;
+            idx += parser.parse(stream + idx, chunk);
+            if (parser.isComplete()){
+                complete++;
+                if (complete == 1){
+                    assert(parser.functionCode() == 0x10);
+                    assert(parser.address() == 0x0001);
+                    assert(parser.quantity() == 2);
+                    assert(parser.byteCount() == 4);
+                    assert(parser.data()[3] == 0x02);
+                } else {
+                    assert(parser.functionCode() == 0x04);
+                    assert(parser.quantity() == 0x28);
+                }
+            } else if (parser.isError()){
+                errors++;
+                assert(parser.errorCode() == ErrorCode::CRCError);
+            }
+        }
+        assert(complete == 2);
+        assert(errors == 1);
+        parser.reset();
+    }
 }
 
 void runServerTest(){
@@ -273,6 +888,48 @@ void runServerTest(){
     printf(".");
     GivenReadRequest04_WhenRegisterRequestedToLarge_ThenException();
     printf(".");
+    GivenManyResponses_WhenRequest04RunsPastRange_ThenIllegalDataAddress();
+    printf(".");
+    GivenRange_WhenRequestBehindRangeEnd_ThenIllegalDataAddress();
+    printf(".");
+    GivenOverlappingMappings_WhenRouted_ThenOverlapCounted();
+    printf(".");
+    GivenRegisterBank_WhenReadCoils_ThenPackedFromBank();
+    printf(".");
+    GivenRegisterBank_WhenReadRequest04_ThenRegistersFromBank();
+    printf(".");
+    GivenRegisterBank_WhenWriteRequest16_ThenWrittenAndNotified();
+    printf(".");
+    GivenRegisterBank_WhenRequestBehindArea_ThenIllegalDataAddress();
+    printf(".");
+    GivenRegisterBank_WhenMaskWriteRequest22_ThenMaskedAndEchoed();
+    printf(".");
+    GivenRegisterBank_WhenReadWriteRequest23_ThenWrittenBeforeRead();
+    printf(".");
+    GivenFrameParser_WhenFramesSplitAcrossSpans_ThenEachParsedOnce();
+    printf(".");
+    GivenMappedSource_WhenReadRequest04_ThenServedFromSnapshot();
+    printf(".");
+    GivenMappedSource_WhenWriterUpdatesConcurrently_ThenSnapshotsNotTorn();
+    printf(".");
+    GivenUnitRange_WhenFramesToSeveralUnits_ThenEachFrameParsedOnce();
+    printf(".");
+    GivenUnit_WhenRequestToUnknownAddress_ThenExceptionFromThatUnit();
+    printf(".");
+    GivenDeferredResponse_WhenCompletedByOtherThread_ThenReplySent();
+    printf(".");
+    GivenDeferredResponse_WhenNotCompletedInTime_ThenBusyException();
+    printf(".");
+#ifdef MODERNBUS_METRICS
+    GivenMetrics_WhenRequestsServed_ThenCountedPerFunctionCode();
+    printf(".");
+#endif
+#if defined(__linux__)
+    GivenShardedTcpServer_WhenManyConnections_ThenServedFromSharedBank();
+    printf(".");
+    GivenShardedTcpServer_WhenMasterPipelinesWithoutReading_ThenWorkerWaitsIdle();
+    printf(".");
+#endif
 
     printf("\n");
     runningTime = millis() - runningTime;
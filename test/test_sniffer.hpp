@@ -0,0 +1,92 @@
+#ifndef TEST_SNIFFER_H
+#define TEST_SNIFFER_H
+#include <Arduino.h>
+
+#include "fixture.hpp"
+#include "mock.hpp"
+#include "../src/modernbus_sniffer.h"
+#include "../src/modernbus_provider.h"
+
+
+ExecutorLoop snifferScheduler{};
+using snifferProvider = SerialProvider<MockStream>;
+
+
+void GivenRequestAndResponseInOneBatch_WhenSniffed_ThenPairedToTransaction(){
+    MockStream mock{};
+    snifferProvider provider{mock};
+    uint8_t bus[sizeof(ReadRequest04) + sizeof(Response04)];
+    memcpy(bus, ReadRequest04, sizeof(ReadRequest04));
+    memcpy(bus + sizeof(ReadRequest04), Response04, sizeof(Response04));
+    mock.append(bus, sizeof(bus));
+    mock.begin();
+
+    BusSniffer<snifferProvider> sniffer{&snifferScheduler, &provider, 921600};
+    static uint8_t count{0};
+    sniffer.onTransaction([](const SniffedTransaction &transaction){
+        assert(transaction.slaveAddress == 0x01);
+        assert(transaction.functionCode == 0x04);
+        assert(transaction.address == 0x0001);
+        assert(transaction.quantity == 0x28);
+        assert(transaction.exceptionCode == 0);
+        assert(transaction.request.length == sizeof(ReadRequest04));
+        assert(transaction.response.length == sizeof(Response04));
+        assert(transaction.response.data[2] == 80);
+        // 8 characters at 921600 baud
+        assert(transaction.responseTime() >= 8 * 11);
+        count++;
+    });
+    sniffer.start();
+    while (count < 3){
+        snifferScheduler.execute();
+    }
+    assert(sniffer.frameCount() >= 6);
+    assert(sniffer.errorCount() == 0);
+    assert(mock.bytesWritten() == 0);
+}
+
+void GivenMissedRequestAndException_WhenSniffed_ThenDecodedFromResponse(){
+    MockStream mock{};
+    snifferProvider provider{mock};
+    uint8_t exception[5] {0x01, 0x90, 0x02};
+    appendCRC(exception, 3);
+    uint8_t bus[sizeof(Response04) + sizeof(WriteRequest16) + sizeof(exception)];
+    memcpy(bus, Response04, sizeof(Response04));
+    memcpy(bus + sizeof(Response04), WriteRequest16, sizeof(WriteRequest16));
+    memcpy(bus + sizeof(Response04) + sizeof(WriteRequest16), exception, sizeof(exception));
+    mock.append(bus, sizeof(bus));
+    mock.begin();
+
+    BusSniffer<snifferProvider> sniffer{&snifferScheduler, &provider, 921600};
+    static uint8_t orphans{0};
+    static uint8_t exceptions{0};
+    sniffer.onTransaction([](const SniffedTransaction &transaction){
+        if (!transaction.request.length){
+            assert(transaction.functionCode == 0x04);
+            assert(transaction.response.length == sizeof(Response04));
+            orphans++;
+        } else {
+            assert(transaction.functionCode == 0x10);
+            assert(transaction.address == 0x0001);
+            assert(transaction.quantity == 2);
+            assert(transaction.exceptionCode == 0x02);
+            exceptions++;
+        }
+    });
+    sniffer.start();
+    while (exceptions < 2){
+        snifferScheduler.execute();
+    }
+    assert(orphans >= 2);
+}
+
+void runSnifferTest(){
+    printf("\n\n -- Testing Modernbus Sniffer -- \n\n");
+    GivenRequestAndResponseInOneBatch_WhenSniffed_ThenPairedToTransaction();
+    printf(".");
+    GivenMissedRequestAndException_WhenSniffed_ThenDecodedFromResponse();
+    printf(".");
+    printf("\n-- Modernbus Sniffer Tested --");
+}
+
+#endif